@@ -0,0 +1,151 @@
+/*
+ * In-process capture agent, preloaded into the target by tool --backend agent.
+ * It maps the shared memfd named by RV_AGENT_FD, whose watch table the tool filled in while
+ * the target was stopped at exec, and samples the armed watches from a thread of its own.
+ * Every change goes into the SPSC ring of the memfd as one record, so neither the target nor
+ * the monitor makes a system call per event.
+ */
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "rv_agent.h"
+
+static struct rv_agent_shared* shared;
+static size_t shared_size;
+static pthread_t sampler;
+static int64_t last[RV_AGENT_MAX_WATCHES];
+static uint32_t epochs[RV_AGENT_MAX_WATCHES];
+
+static int64_t read_watch(const struct rv_agent_watch* watch) {
+    const volatile void* p = (const volatile void*)(uintptr_t)watch->address;
+    switch (watch->size) {
+    case 1: return *(const volatile int8_t*)p;
+    case 2: return *(const volatile int16_t*)p;
+    case 4: return *(const volatile int32_t*)p;
+    case 8: return *(const volatile int64_t*)p;
+    default: {
+        int64_t value = 0;
+        memcpy(&value, (const void*)p, watch->size < 8 ? watch->size : 8);
+        return value;
+    }
+    }
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/* Function to push the armed watches that changed since the last sample as one position */
+static void sample(void) {
+    struct rv_ring* ring = rv_agent_ring(shared);
+    struct rv_record changed[RV_AGENT_MAX_WATCHES];
+    uint32_t count = 0;
+    uint64_t time = now_ns();
+
+    for (uint32_t i = 0; i < shared->watch_count; ++i) {
+        if (!__atomic_load_n(&shared->watches[i].armed, __ATOMIC_ACQUIRE)) {
+            continue;
+        }
+        /* A re-armed watch compares against the value the tool knows, not the one before */
+        uint32_t epoch = __atomic_load_n(&shared->watches[i].epoch, __ATOMIC_ACQUIRE);
+        if (epoch != epochs[i]) {
+            epochs[i] = epoch;
+            last[i] = __atomic_load_n(&shared->watches[i].baseline, __ATOMIC_RELAXED);
+        }
+        int64_t value = read_watch(&shared->watches[i]);
+        if (value != last[i]) {
+            last[i] = value;
+            changed[count].time_ns = time;
+            changed[count].value = value;
+            changed[count].id = i;
+            changed[count].flags = 0;
+            ++count;
+        }
+    }
+    if (count > 0) {
+        changed[count - 1].flags = RV_RECORD_END;
+    }
+    for (uint32_t i = 0; i < count; ++i) {
+        rv_ring_push(ring, &changed[i]);
+    }
+    __atomic_store_n(&shared->samples, shared->samples + 1, __ATOMIC_RELAXED);
+}
+
+static void* sampler_main(void* arg) {
+    (void)arg;
+    struct timespec period = {shared->interval_us / 1000000, (long)(shared->interval_us % 1000000) * 1000};
+    while (!__atomic_load_n(&shared->stop, __ATOMIC_RELAXED)) {
+        sample();
+        nanosleep(&period, NULL);
+    }
+    return NULL;
+}
+
+/* A forked child has no sampler and must not push into the parent's ring */
+static void forget_shared(void) {
+    shared = NULL;
+}
+
+__attribute__((constructor)) static void rv_agent_start(void) {
+    const char* fd_text = getenv("RV_AGENT_FD");
+    if (fd_text == NULL) {
+        return;
+    }
+    int fd = atoi(fd_text);
+    /* Programs the target starts are not monitored */
+    unsetenv("RV_AGENT_FD");
+    unsetenv("LD_PRELOAD");
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        return;
+    }
+    void* p = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        return;
+    }
+    shared = (struct rv_agent_shared*)p;
+    shared_size = st.st_size;
+    if (shared->magic != RV_AGENT_MAGIC || shared->watch_count > RV_AGENT_MAX_WATCHES) {
+        munmap(p, shared_size);
+        shared = NULL;
+        return;
+    }
+
+    for (uint32_t i = 0; i < shared->watch_count; ++i) {
+        last[i] = shared->watches[i].baseline;
+        epochs[i] = shared->watches[i].epoch;
+    }
+    pthread_atfork(NULL, NULL, forget_shared);
+
+    /* Signals meant for the target must never land on the sampler */
+    sigset_t all, saved;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &saved);
+    int started = pthread_create(&sampler, NULL, sampler_main, NULL) == 0;
+    pthread_sigmask(SIG_SETMASK, &saved, NULL);
+    if (started) {
+        __atomic_store_n(&shared->agent_pid, getpid(), __ATOMIC_RELEASE);
+    }
+}
+
+__attribute__((destructor)) static void rv_agent_stop(void) {
+    if (shared == NULL || !__atomic_load_n(&shared->agent_pid, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+    /* A last sample catches the writes since the previous one */
+    int stopped = __atomic_exchange_n(&shared->stop, 1, __ATOMIC_RELAXED);
+    pthread_join(sampler, NULL);
+    if (!stopped) {
+        sample();
+    }
+}
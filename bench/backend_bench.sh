@@ -0,0 +1,28 @@
+#!/bin/sh
+# Runs bench/write_loop under each capture backend and reports the tool's wall time, the
+# target's own loop time and the trace positions the monitor saw. The hooks backend runs
+# bench/write_loop_hooks, the same loop built with rv.h.
+#
+# Usage: ./bench/backend_bench.sh [backend...]   (default: step dr perf uffd agent hooks sites)
+cd "$(dirname "$0")/.." || exit 1
+backends=${*:-step dr perf uffd agent hooks sites}
+
+printf "%-8s %10s %12s %10s %14s\n" backend "wall s" "target s" positions "positions/s"
+for backend in $backends; do
+    target_program=bench/write_loop
+    if [ "$backend" = hooks ]; then
+        target_program=bench/write_loop_hooks
+    fi
+    start=$(date +%s.%N)
+    output=$(./tool --backend "$backend" "$target_program" '[] (counter >= 0)' 2>&1)
+    end=$(date +%s.%N)
+    target=$(echo "$output" | sed -n 's/^target: .* writes in \([0-9.]*\) s$/\1/p')
+    positions=$(echo "$output" | sed -n 's/^Final verdict: .* after \([0-9]*\) steps$/\1/p')
+    if [ -z "$positions" ]; then
+        echo "$backend: failed"
+        echo "$output" | grep Error
+        continue
+    fi
+    awk -v b="$backend" -v s="$start" -v e="$end" -v t="$target" -v p="$positions" \
+        'BEGIN { printf "%-8s %10.3f %12.6f %10d %14.0f\n", b, e - s, t, p, p / (e - s) }'
+done
@@ -0,0 +1,80 @@
+// Benchmark comparing the stream and memory-mapped ELFIO loaders on the work the tool
+// does at startup: load a binary and resolve a handful of names from its symbol tables.
+//
+// Usage: ./bench/elf_load_bench [elf_file] [iterations] [symbol...]
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <functional>
+#include <sys/resource.h>
+#include "elfio/elfio.hpp"
+
+using namespace std;
+
+// Function to resolve every name through the symbol tables of an already loaded file
+size_t resolve(const ELFIO::elfio& reader, const vector<string>& names) {
+    size_t found = 0;
+    for (const auto& section_ptr : reader.sections) {
+        if (section_ptr->get_type() != ELFIO::SHT_SYMTAB && section_ptr->get_type() != ELFIO::SHT_DYNSYM) {
+            continue;
+        }
+        ELFIO::symbol_section_accessor symbols(reader, section_ptr.get());
+        for (const auto& name : names) {
+            ELFIO::Elf64_Addr value;
+            ELFIO::Elf_Xword size;
+            unsigned char bind, type, other;
+            ELFIO::Elf_Half section_index;
+            if (symbols.get_symbol(name, value, size, bind, type, section_index, other)) {
+                ++found;
+            }
+        }
+    }
+    return found;
+}
+
+// Function to time one loader and print the mean cost and page faults per iteration
+void run(const string& label, int iterations, const function<bool(ELFIO::elfio&)>& load,
+         const vector<string>& names) {
+    rusage before, after;
+    getrusage(RUSAGE_SELF, &before);
+    auto start = chrono::steady_clock::now();
+
+    size_t found = 0;
+    for (int i = 0; i < iterations; ++i) {
+        ELFIO::elfio reader;
+        if (!load(reader)) {
+            cerr << label << ": load failed" << endl;
+            return;
+        }
+        found += resolve(reader, names);
+    }
+
+    auto elapsed = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+    getrusage(RUSAGE_SELF, &after);
+
+    cout << left << setw(14) << label
+         << right << setw(12) << fixed << setprecision(1) << elapsed / iterations << " us/load"
+         << setw(10) << (after.ru_minflt - before.ru_minflt) / iterations << " minflt"
+         << setw(8) << (after.ru_majflt - before.ru_majflt) / iterations << " majflt"
+         << setw(8) << found / iterations << " found" << endl;
+}
+
+int main(int argc, char* argv[]) {
+    string elf_file = argc > 1 ? argv[1] : "/proc/self/exe";
+    int iterations = argc > 2 ? stoi(argv[2]) : 200;
+    vector<string> names;
+    for (int i = 3; i < argc; ++i) {
+        names.push_back(argv[i]);
+    }
+    if (names.empty()) {
+        names = {"main", "_start"};
+    }
+
+    cout << "File: " << elf_file << ", " << iterations << " iterations" << endl;
+    run("stream", iterations, [&](ELFIO::elfio& r) { return r.load(elf_file); }, names);
+    run("stream-lazy", iterations, [&](ELFIO::elfio& r) { return r.load(elf_file, true); }, names);
+    run("mmap", iterations, [&](ELFIO::elfio& r) { return r.load_mapped(elf_file); }, names);
+    return 0;
+}
@@ -0,0 +1,96 @@
+// Benchmark comparing the former regex atom extraction with the LTL parser on machine-generated
+// specifications with thousands of atoms.
+//
+// Usage: ./bench/ltl_parse_bench [clauses] [variables] [iterations]
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <regex>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include "ltl.hpp"
+
+using namespace std;
+
+// The extraction tool.cpp used before it had a parser
+vector<string> extract_required_symbols(const string ltl_formula){
+    vector<string> required_symbols;
+
+    regex symbol_regex(R"(\b([a-zA-Z_][a-zA-Z0-9_]*)\b)");
+    auto words_begin = sregex_iterator(ltl_formula.begin(), ltl_formula.end(), symbol_regex);
+    auto words_end = sregex_iterator();
+
+    const vector<string> ltl_keywords = {"true", "false", "U", "V", "X"};
+    for (auto it = words_begin; it != words_end; ++it) {
+        string symbol = it->str();
+        if (find(ltl_keywords.begin(), ltl_keywords.end(), symbol) == ltl_keywords.end()) {
+            if (find(required_symbols.begin(), required_symbols.end(), symbol) == required_symbols.end())
+                required_symbols.push_back(symbol);
+        }
+    }
+    return required_symbols;
+}
+
+// Function to generate a conjunction of response/invariant clauses over a pool of variables.
+// Clauses draw their atoms from a small set of shapes, as generated specs do, so many
+// subformulas repeat.
+string generate_spec(int clauses, int variables, unsigned seed) {
+    mt19937 rng(seed);
+    auto var = [&]() { return "v" + to_string(rng() % variables); };
+    auto atom = [&]() {
+        switch (rng() % 3) {
+        case 0: return var();
+        case 1: return var() + " == " + to_string(rng() % 4);
+        default: return var() + " > " + to_string(rng() % 100);
+        }
+    };
+
+    string spec;
+    for (int i = 0; i < clauses; ++i) {
+        if (i > 0) {
+            spec += " && ";
+        }
+        switch (rng() % 3) {
+        case 0: spec += "[] ((" + atom() + " && " + atom() + ") -> <> " + atom() + ")"; break;
+        case 1: spec += "[] (" + atom() + " -> X (" + atom() + " U " + atom() + "))"; break;
+        default: spec += "[] !(" + atom() + " && " + atom() + ")"; break;
+        }
+    }
+    return spec;
+}
+
+template <class F>
+double time_us(int iterations, F f) {
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        f();
+    }
+    return chrono::duration<double, micro>(chrono::steady_clock::now() - start).count() / iterations;
+}
+
+int main(int argc, char* argv[]) {
+    int clauses = argc > 1 ? stoi(argv[1]) : 1000;
+    int variables = argc > 2 ? stoi(argv[2]) : 300;
+    int iterations = argc > 3 ? stoi(argv[3]) : 5;
+
+    string spec = generate_spec(clauses, variables, 1);
+    size_t regex_symbols = 0;
+    size_t parser_symbols = 0;
+    Formula formula;
+
+    double regex_us = time_us(iterations, [&]() { regex_symbols = extract_required_symbols(spec).size(); });
+    double parse_us = time_us(iterations, [&]() {
+        formula = parse_ltl(spec);
+        parser_symbols = formula.variables().size();
+    });
+
+    cout << "Spec: " << clauses << " clauses, " << spec.size() << " bytes" << endl;
+    cout << left << setw(8) << "regex" << right << setw(12) << fixed << setprecision(1) << regex_us
+         << " us  " << regex_symbols << " symbols" << endl;
+    cout << left << setw(8) << "parser" << right << setw(12) << parse_us
+         << " us  " << parser_symbols << " symbols, " << formula.predicates().size() << " predicates, "
+         << formula.size() << " shared subformulas" << endl;
+    return 0;
+}
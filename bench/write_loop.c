@@ -0,0 +1,31 @@
+// Write-heavy target for backend_bench.sh: stores to a watched global in a tight loop, like
+// the loop of sample.c, and prints how long the loop took. Built with RV_HOOKS as
+// bench/write_loop_hooks, the stores go through the RV_STORE hook of rv.h.
+#include <stdio.h>
+#include <time.h>
+
+#ifdef RV_HOOKS
+#include "rv.h"
+#define STORE(var, value) RV_STORE(var, value)
+#else
+#define STORE(var, value) ((var) = (value))
+#endif
+
+#ifndef ITERATIONS
+#define ITERATIONS 100000
+#endif
+
+volatile long counter = 0;
+
+int main() {
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long i = 1; i <= ITERATIONS; i++) {
+        STORE(counter, i);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("target: %d writes in %.6f s\n", ITERATIONS, seconds);
+    return 0;
+}
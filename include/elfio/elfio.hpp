@@ -95,6 +95,9 @@ class elfio
         convertor       = std::move( other.convertor );
         addr_translator = std::move( other.addr_translator );
         compression     = std::move( other.compression );
+#ifdef ELFIO_HAS_MMAP
+        mapping = std::move( other.mapping );
+#endif
 
         other.header = nullptr;
         other.sections_.clear();
@@ -116,6 +119,9 @@ class elfio
             addr_translator  = std::move( other.addr_translator );
             current_file_pos = other.current_file_pos;
             compression      = std::move( other.compression );
+#ifdef ELFIO_HAS_MMAP
+            mapping = std::move( other.mapping );
+#endif
 
             other.current_file_pos = 0;
             other.header           = nullptr;
@@ -175,10 +181,34 @@ class elfio
         if ( !is_lazy ) {
             pstream.reset();
         }
+#ifdef ELFIO_HAS_MMAP
+        mapping.reset();
+#endif
 
         return ret;
     }
 
+#ifdef ELFIO_HAS_MMAP
+    //------------------------------------------------------------------------------
+    //! \brief Load an ELF file by mapping it into memory
+    //! Section and segment data point straight into the mapping instead of being
+    //! copied, so only the pages of the data actually accessed are read from the
+    //! file. The data stays valid for as long as this object holds the file
+    //! \param file_name The name of the file to load
+    //! \return True if successful, false otherwise
+    bool load_mapped( const std::string& file_name )
+    {
+        auto file = std::make_unique<mapped_file>();
+        if ( !file->open( file_name ) ) {
+            return false;
+        }
+
+        pstream.reset();
+        mapping = std::move( file );
+        return load( mapping->get_stream() );
+    }
+#endif
+
     //------------------------------------------------------------------------------
     //! \brief Load an ELF file from a stream
     //! \param stream The input stream to load from
@@ -1234,6 +1264,10 @@ class elfio
 
     //------------------------------------------------------------------------------
   private:
+#ifdef ELFIO_HAS_MMAP
+    std::unique_ptr<mapped_file> mapping =
+        nullptr; //!< Mapping of the file loaded by load_mapped()
+#endif
     std::unique_ptr<std::ifstream> pstream =
         nullptr; //!< Pointer to the input stream
     std::unique_ptr<elf_header> header = nullptr; //!< Pointer to the ELF header
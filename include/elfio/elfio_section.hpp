@@ -239,7 +239,7 @@ template <class T> class section_impl : public section
                 can_be_loaded = false;
             }
         }
-        return data.get();
+        return ( nullptr != mapped_data ) ? mapped_data : data.get();
     }
 
     /**
@@ -249,7 +249,8 @@ template <class T> class section_impl : public section
     {
         if ( is_lazy ) {
             data.reset( nullptr );
-            is_loaded = false;
+            mapped_data = nullptr;
+            is_loaded   = false;
         }
     }
 
@@ -260,6 +261,7 @@ template <class T> class section_impl : public section
      */
     void set_data( const char* raw_data, Elf_Xword size ) override
     {
+        mapped_data = nullptr;
         if ( get_type() != SHT_NOBITS ) {
             data = std::unique_ptr<char[]>(
                 new ( std::nothrow ) char[(size_t)size] );
@@ -316,6 +318,11 @@ template <class T> class section_impl : public section
     insert_data( Elf_Xword pos, const char* raw_data, Elf_Xword size ) override
     {
         if ( get_type() != SHT_NOBITS ) {
+            // Data referring to a memory block is read-only, take a private copy first
+            if ( nullptr != mapped_data && !copy_mapped_data() ) {
+                return;
+            }
+
             // Check for valid position
             if ( pos > get_size() ) {
                 return; // Invalid position
@@ -430,8 +437,16 @@ template <class T> class section_impl : public section
                std::streampos header_offset,
                bool           is_lazy_ ) override
     {
-        pstream = &stream;
-        is_lazy = is_lazy_;
+        pstream     = &stream;
+        is_lazy     = is_lazy_;
+        mapped_base = nullptr;
+
+        // Data of a stream over a memory block is referred to in place
+        if ( auto* buffer =
+                 dynamic_cast<const memory_streambuf*>( stream.rdbuf() );
+             buffer != nullptr && translator->empty() ) {
+            mapped_base = buffer->get_base();
+        }
 
         if ( translator->empty() ) {
             stream.seekg( 0, std::istream::end );
@@ -486,8 +501,18 @@ template <class T> class section_impl : public section
         }
 
         // Check if we need to load data
-        if ( nullptr == data && SHT_NULL != get_type() &&
-             SHT_NOBITS != get_type() ) {
+        if ( nullptr == data && nullptr == mapped_data &&
+             SHT_NULL != get_type() && SHT_NOBITS != get_type() ) {
+            // Compressed data is inflated into a buffer of its own,
+            // so it can't stay in the memory block
+            if ( nullptr != mapped_base && !is_compressed() ) {
+                mapped_data = mapped_base + sh_offset;
+                data_size   = size;
+                is_loaded   = true;
+                return true;
+            }
+
+
             // Check if size can be safely converted to size_t
             if ( size > std::numeric_limits<size_t>::max() - 1 ) {
                 return false;
@@ -519,8 +544,8 @@ template <class T> class section_impl : public section
         }
 
         // Data already loaded or doesn't need loading
-        is_loaded = ( nullptr != data ) || ( SHT_NULL == get_type() ) ||
-                    ( SHT_NOBITS == get_type() );
+        is_loaded = ( nullptr != data ) || ( nullptr != mapped_data ) ||
+                    ( SHT_NULL == get_type() ) || ( SHT_NOBITS == get_type() );
         return is_loaded;
     }
 
@@ -541,12 +566,32 @@ template <class T> class section_impl : public section
 
         save_header( stream, header_offset );
         if ( get_type() != SHT_NOBITS && get_type() != SHT_NULL &&
-             get_size() != 0 && data != nullptr ) {
+             get_size() != 0 &&
+             ( data != nullptr || mapped_data != nullptr ) ) {
             save_data( stream, data_offset );
         }
     }
 
   private:
+    /**
+     * @brief Replace data referring to a memory block with a private copy.
+     * @return True if successful, false otherwise.
+     */
+    bool copy_mapped_data()
+    {
+        std::unique_ptr<char[]> copy(
+            new ( std::nothrow ) char[size_t( data_size ) + 1] );
+        if ( nullptr == copy ) {
+            return false;
+        }
+
+        std::copy( mapped_data, mapped_data + data_size, copy.get() );
+        copy.get()[data_size] = 0;
+        data                  = std::move( copy );
+        mapped_data           = nullptr;
+        return true;
+    }
+
     /**
      * @brief Save the header of the section to a stream.
      * @param stream Output stream.
@@ -574,7 +619,7 @@ template <class T> class section_impl : public section
             Elf_Xword decompressed_size = get_size();
             Elf_Xword compressed_size   = 0;
             auto      compressed_ptr    = compression->deflate(
-                data.get(), convertor, decompressed_size, compressed_size );
+                get_data(), convertor, decompressed_size, compressed_size );
             stream.write( compressed_ptr.get(), compressed_size );
         }
         else {
@@ -589,6 +634,10 @@ template <class T> class section_impl : public section
     Elf_Half                        index  = 0;    /**< Index of the section. */
     std::string                     name;          /**< Name of the section. */
     mutable std::unique_ptr<char[]> data;          /**< Pointer to the data. */
+    mutable const char*             mapped_data =
+        nullptr; /**< Pointer to the data inside the memory block loaded from. */
+    const char* mapped_base =
+        nullptr; /**< Start of the memory block loaded from, if any. */
     mutable Elf_Xword               data_size = 0; /**< Size of the data. */
     std::shared_ptr<endianness_convertor> convertor =
         nullptr; /**< Pointer to the endianness convertor. */
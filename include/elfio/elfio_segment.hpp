@@ -186,7 +186,7 @@ template <class T> class segment_impl : public segment
         if ( !is_loaded ) {
             load_data();
         }
-        return data.get();
+        return ( nullptr != mapped_data ) ? mapped_data : data.get();
     }
 
     //------------------------------------------------------------------------------
@@ -195,7 +195,8 @@ template <class T> class segment_impl : public segment
     {
         if ( is_lazy ) {
             data.reset( nullptr );
-            is_loaded = false;
+            mapped_data = nullptr;
+            is_loaded   = false;
         }
     }
 
@@ -286,8 +287,16 @@ template <class T> class segment_impl : public segment
                std::streampos header_offset,
                bool           is_lazy_ ) override
     {
-        pstream = &stream;
-        is_lazy = is_lazy_;
+        pstream     = &stream;
+        is_lazy     = is_lazy_;
+        mapped_base = nullptr;
+
+        // Data of a stream over a memory block is referred to in place
+        if ( auto* buffer =
+                 dynamic_cast<const memory_streambuf*>( stream.rdbuf() );
+             buffer != nullptr && translator->empty() ) {
+            mapped_base = buffer->get_base();
+        }
 
         if ( translator->empty() ) {
             stream.seekg( 0, std::istream::end );
@@ -340,6 +349,12 @@ template <class T> class segment_impl : public segment
             return false;
         }
 
+        if ( nullptr != mapped_base ) {
+            mapped_data = mapped_base + p_offset;
+            is_loaded   = true;
+            return true;
+        }
+
         data.reset( new ( std::nothrow ) char[(size_t)size + 1] );
 
         pstream->seekg( p_offset );
@@ -387,6 +402,10 @@ template <class T> class segment_impl : public segment
     T                     ph      = {};       //!< Segment header
     Elf_Half              index   = 0;        //!< Index of the segment
     mutable std::unique_ptr<char[]> data;     //!< Pointer to the segment data
+    mutable const char* mapped_data =
+        nullptr; //!< Pointer to the data inside the memory block loaded from
+    const char* mapped_base =
+        nullptr; //!< Start of the memory block loaded from, if any
     std::vector<Elf_Half>           sections; //!< Vector of section indices
     std::shared_ptr<endianness_convertor> convertor =
         nullptr; //!< Pointer to the endianness convertor
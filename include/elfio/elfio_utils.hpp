@@ -25,8 +25,20 @@ THE SOFTWARE.
 
 #include <cstdint>
 #include <ostream>
+#include <istream>
+#include <streambuf>
+#include <memory>
+#include <string>
 #include <cstring>
 
+#if defined( __unix__ ) || defined( __APPLE__ )
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define ELFIO_HAS_MMAP 1
+#endif
+
 #define ELFIO_GET_ACCESS_DECL( TYPE, NAME ) virtual TYPE get_##NAME() const = 0
 
 #define ELFIO_SET_ACCESS_DECL( TYPE, NAME ) \
@@ -333,6 +345,153 @@ inline static size_t strnlength( const char* s, size_t n )
     return found ? (size_t)( found - s ) : n;
 }
 
+//------------------------------------------------------------------------------
+//! \class memory_streambuf
+//! \brief Read-only stream buffer over a block of memory.
+//! Sections and segments loaded from a stream that uses this buffer refer to
+//! the block directly instead of copying their data out of it
+class memory_streambuf : public std::streambuf
+{
+  public:
+    //------------------------------------------------------------------------------
+    //! \brief Constructor
+    //! \param data The start of the memory block
+    //! \param size The size of the memory block
+    memory_streambuf( const char* data, size_t size )
+        : base( data ), length( size )
+    {
+        char* p = const_cast<char*>( data );
+        setg( p, p, p + size );
+    }
+
+    //------------------------------------------------------------------------------
+    //! \brief Get the start of the memory block
+    //! \return Pointer to the first byte of the block
+    const char* get_base() const { return base; }
+
+    //------------------------------------------------------------------------------
+    //! \brief Get the size of the memory block
+    //! \return Size of the block in bytes
+    size_t get_size() const { return length; }
+
+  protected:
+    //------------------------------------------------------------------------------
+    //! \brief Move the read position relative to the beginning, the current position or the end
+    //! \param off The offset to move by
+    //! \param dir The position the offset is relative to
+    //! \param which The sequence to move, only the input sequence is supported
+    //! \return The new position, or -1 on failure
+    pos_type seekoff( off_type                off,
+                      std::ios_base::seekdir  dir,
+                      std::ios_base::openmode which ) override
+    {
+        if ( !( which & std::ios_base::in ) ) {
+            return pos_type( off_type( -1 ) );
+        }
+
+        off_type pos = off;
+        if ( dir == std::ios_base::cur ) {
+            pos += gptr() - eback();
+        }
+        else if ( dir == std::ios_base::end ) {
+            pos += off_type( length );
+        }
+
+        if ( pos < 0 || pos > off_type( length ) ) {
+            return pos_type( off_type( -1 ) );
+        }
+
+        setg( eback(), eback() + pos, egptr() );
+        return pos_type( pos );
+    }
+
+    //------------------------------------------------------------------------------
+    //! \brief Move the read position to an absolute position
+    //! \param pos The position to move to
+    //! \param which The sequence to move, only the input sequence is supported
+    //! \return The new position, or -1 on failure
+    pos_type seekpos( pos_type pos, std::ios_base::openmode which ) override
+    {
+        return seekoff( off_type( pos ), std::ios_base::beg, which );
+    }
+
+  private:
+    const char* base   = nullptr; //!< Start of the memory block
+    size_t      length = 0;       //!< Size of the memory block
+};
+
+#ifdef ELFIO_HAS_MMAP
+//------------------------------------------------------------------------------
+//! \class mapped_file
+//! \brief Read-only memory mapping of a file, exposed as an input stream.
+//! Only the pages that are actually accessed are read from the file
+class mapped_file
+{
+  public:
+    mapped_file()                                = default;
+    mapped_file( const mapped_file& )            = delete;
+    mapped_file& operator=( const mapped_file& ) = delete;
+    ~mapped_file() { close(); }
+
+    //------------------------------------------------------------------------------
+    //! \brief Map a file into memory
+    //! \param file_name The name of the file to map
+    //! \return True if successful, false otherwise
+    bool open( const std::string& file_name )
+    {
+        close();
+
+        int fd = ::open( file_name.c_str(), O_RDONLY | O_CLOEXEC );
+        if ( fd < 0 ) {
+            return false;
+        }
+
+        struct stat st;
+        if ( ::fstat( fd, &st ) != 0 || st.st_size <= 0 ) {
+            ::close( fd );
+            return false;
+        }
+
+        void* p = ::mmap( nullptr, size_t( st.st_size ), PROT_READ,
+                          MAP_PRIVATE, fd, 0 );
+        ::close( fd );
+        if ( p == MAP_FAILED ) {
+            return false;
+        }
+
+        base   = static_cast<const char*>( p );
+        length = size_t( st.st_size );
+        buffer = std::make_unique<memory_streambuf>( base, length );
+        stream = std::make_unique<std::istream>( buffer.get() );
+        return true;
+    }
+
+    //------------------------------------------------------------------------------
+    //! \brief Unmap the file
+    void close()
+    {
+        stream.reset();
+        buffer.reset();
+        if ( base != nullptr ) {
+            ::munmap( const_cast<char*>( base ), length );
+            base   = nullptr;
+            length = 0;
+        }
+    }
+
+    //------------------------------------------------------------------------------
+    //! \brief Get the stream reading from the mapping
+    //! \return Reference to the stream
+    std::istream& get_stream() { return *stream; }
+
+  private:
+    const char*                       base   = nullptr; //!< Start of the mapping
+    size_t                            length = 0;       //!< Size of the mapping
+    std::unique_ptr<memory_streambuf> buffer;           //!< Buffer over the mapping
+    std::unique_ptr<std::istream>     stream;           //!< Stream over the buffer
+};
+#endif // ELFIO_HAS_MMAP
+
 //------------------------------------------------------------------------------
 //! \class compression_interface
 //! \brief Interface for compression and decompression
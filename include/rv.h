@@ -0,0 +1,211 @@
+/*
+ * Source instrumentation for programs monitored with tool --backend hooks. Usable from C and
+ * C++, header only, for any Linux target including the 32-bit ARM guests.
+ *
+ * Stores to monitored variables go through RV_STORE(var, value), or in C++ the variable is
+ * declared as rv::watched<T>. After the store, the hook looks the address up in the watch table
+ * the tool wrote to /dev/shm/rv-<pid> and pushes the new value into a ring of the storing
+ * thread in the same file. No system call and no trap happens per store, only a few loads.
+ * Every other store stays a plain store, and with RV_DISABLE defined the hooks are plain
+ * stores as well. Without a tool the first hook finds no file and all later ones return at
+ * once.
+ *
+ * A store is recorded only if var is a whole watched variable, not a member or element of one.
+ * Threads beyond RV_HOOKS_MAX_THREADS are not recorded, and a full ring makes the storing
+ * thread wait for the tool.
+ */
+#ifndef RV_H
+#define RV_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "rv_hooks.h"
+
+#if defined(RV_DISABLE)
+
+#define RV_STORE(var, value) ((void)((var) = (value)))
+
+#else
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+/* State shared by every translation unit that includes this header */
+__attribute__((weak)) struct rv_hooks_shared* rv_hooks_region;
+__attribute__((weak)) int rv_hooks_unavailable;
+__attribute__((weak)) __thread int rv_hooks_thread_slot; /* ring index + 1, or -1 if none */
+
+/* A forked child is not monitored and must not push into the parent's rings */
+static inline void rv_hooks_forget(void) {
+    rv_hooks_region = NULL;
+    rv_hooks_unavailable = 1;
+}
+
+/* Function to map the file of the tool on the first hook of the process */
+static __attribute__((noinline, cold, unused)) struct rv_hooks_shared* rv_hooks_open(void) {
+    char path[32];
+    snprintf(path, sizeof(path), "/dev/shm/rv-%d", (int)getpid());
+    int fd = open(path, O_RDWR | O_CLOEXEC);
+    struct stat st;
+    void* p = MAP_FAILED;
+    if (fd >= 0 && fstat(fd, &st) == 0 && (size_t)st.st_size >= RV_HOOKS_RING_OFFSET) {
+        p = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    struct rv_hooks_shared* shared = (struct rv_hooks_shared*)p;
+    if (p == MAP_FAILED || __atomic_load_n(&shared->magic, __ATOMIC_ACQUIRE) != RV_HOOKS_MAGIC ||
+        (size_t)st.st_size < rv_hooks_bytes(shared->ring_capacity)) {
+        if (p != MAP_FAILED) {
+            munmap(p, st.st_size);
+        }
+        __atomic_store_n(&rv_hooks_unavailable, 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+    struct rv_hooks_shared* expected = NULL;
+    if (!__atomic_compare_exchange_n(&rv_hooks_region, &expected, shared, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        /* Another thread mapped it first */
+        munmap(p, st.st_size);
+        return expected;
+    }
+    pthread_atfork(NULL, NULL, rv_hooks_forget);
+    return shared;
+}
+
+/* Function to read a stored value the way the tool decodes watched variables */
+static inline int64_t rv_hooks_value(const volatile void* address, size_t size) {
+    switch (size) {
+    case 1: return *(const volatile int8_t*)address;
+    case 2: return *(const volatile int16_t*)address;
+    case 4: return *(const volatile int32_t*)address;
+    default: {
+        int64_t value = 0;
+        memcpy(&value, (const void*)address, size < 8 ? size : 8);
+        return value;
+    }
+    }
+}
+
+static __attribute__((noinline, unused)) void rv_hooks_push(struct rv_hooks_shared* shared, uint32_t id,
+                                                    const volatile void* address, size_t size) {
+    if (rv_hooks_thread_slot == 0) {
+        uint32_t index = __atomic_fetch_add(&shared->thread_count, 1, __ATOMIC_RELAXED);
+        rv_hooks_thread_slot = index < RV_HOOKS_MAX_THREADS ? (int)index + 1 : -1;
+    }
+    if (rv_hooks_thread_slot < 0) {
+        __atomic_fetch_add(&shared->overflow, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    struct rv_record record;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    record.time_ns = (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+    record.value = rv_hooks_value(address, size);
+    record.id = id;
+    record.flags = RV_RECORD_END;
+
+    struct rv_ring* ring = rv_hooks_ring(shared, rv_hooks_thread_slot - 1);
+    while (rv_ring_full(ring)) {
+        if (__atomic_load_n(&shared->stop, __ATOMIC_RELAXED)) {
+            return;
+        }
+        sched_yield();
+    }
+    rv_ring_push(ring, &record);
+}
+
+/* Function to record a store that just happened, if its variable is watched and armed */
+static inline void rv_hooks_store(const volatile void* address, size_t size) {
+    struct rv_hooks_shared* shared = __atomic_load_n(&rv_hooks_region, __ATOMIC_ACQUIRE);
+    if (shared == NULL) {
+        if (__atomic_load_n(&rv_hooks_unavailable, __ATOMIC_RELAXED) || (shared = rv_hooks_open()) == NULL) {
+            return;
+        }
+    }
+    if (__atomic_load_n(&shared->stop, __ATOMIC_RELAXED)) {
+        return;
+    }
+    uint64_t key = (uint64_t)(uintptr_t)address;
+    uint32_t count = shared->watch_count;
+    for (uint32_t i = 0; i < count; ++i) {
+        if (shared->watches[i].address == key) {
+            if (__atomic_load_n(&shared->watches[i].armed, __ATOMIC_RELAXED)) {
+                rv_hooks_push(shared, i, address, size);
+            }
+            return;
+        }
+    }
+}
+
+/* Stores value to var and records it; var is evaluated once */
+#define RV_STORE(var, value)                              \
+    do {                                                  \
+        __typeof__(var)* rv_target_ = &(var);             \
+        *rv_target_ = (value);                            \
+        rv_hooks_store(rv_target_, sizeof(*rv_target_));  \
+    } while (0)
+
+#endif /* RV_DISABLE */
+
+#ifdef __cplusplus
+
+namespace rv {
+
+// A variable whose assignments are recorded, with the size and layout of T, so the tool
+// resolves and reads it like a plain T. Only assignments through the wrapper are recorded.
+template <typename T>
+class watched {
+public:
+    watched() = default;
+    constexpr watched(T value) : value(value) {}
+    watched(const watched&) = delete;
+
+    watched& operator=(T next) {
+        value = next;
+        record();
+        return *this;
+    }
+
+    watched& operator=(const watched& other) { return *this = other.value; }
+
+    operator T() const { return value; }
+
+    watched& operator+=(T delta) { return *this = value + delta; }
+    watched& operator-=(T delta) { return *this = value - delta; }
+    watched& operator++() { return *this = value + 1; }
+    watched& operator--() { return *this = value - 1; }
+    T operator++(int) {
+        T old = value;
+        *this = value + 1;
+        return old;
+    }
+    T operator--(int) {
+        T old = value;
+        *this = value - 1;
+        return old;
+    }
+
+private:
+    void record() {
+#if !defined(RV_DISABLE)
+        rv_hooks_store(&value, sizeof(T));
+#endif
+    }
+
+    T value;
+};
+
+} // namespace rv
+
+#endif /* __cplusplus */
+
+#endif /* RV_H */
@@ -0,0 +1,39 @@
+/*
+ * Shared memory between tool --backend agent and the agent library it preloads into the
+ * target. The tool creates it as a memfd inherited by the target (RV_AGENT_FD) and fills in
+ * the watch table before the target runs; the ring follows the table at RV_AGENT_RING_OFFSET.
+ */
+#ifndef RV_AGENT_H
+#define RV_AGENT_H
+
+#include <stdint.h>
+#include "rv_ring.h"
+
+#define RV_AGENT_MAGIC 0x31544e4547415652ull /* "RVAGENT1" */
+#define RV_AGENT_MAX_WATCHES 64
+
+struct rv_agent_watch {
+    uint64_t address;
+    uint64_t size;
+    int64_t baseline; /* value the tool last knew, from the exec stop or a re-arm */
+    uint32_t armed;   /* written by the tool while the target runs */
+    uint32_t epoch;   /* bumped by the tool after a new baseline */
+};
+
+struct rv_agent_shared {
+    uint64_t magic;
+    uint32_t watch_count;
+    uint32_t interval_us;
+    uint32_t stop;      /* set by the tool to end sampling */
+    int32_t agent_pid;  /* set by the agent once it runs */
+    uint64_t samples;   /* samples taken by the agent */
+    struct rv_agent_watch watches[RV_AGENT_MAX_WATCHES];
+};
+
+#define RV_AGENT_RING_OFFSET ((sizeof(struct rv_agent_shared) + 63) & ~(size_t)63)
+
+static inline struct rv_ring* rv_agent_ring(struct rv_agent_shared* shared) {
+    return (struct rv_ring*)((char*)shared + RV_AGENT_RING_OFFSET);
+}
+
+#endif /* RV_AGENT_H */
@@ -0,0 +1,46 @@
+/*
+ * Shared memory between tool --backend hooks and a target instrumented with rv.h. The tool
+ * creates /dev/shm/rv-<pid> and fills in the watch table before the target runs; each thread
+ * of the target that stores to a watched variable claims one of the rings that follow.
+ */
+#ifndef RV_HOOKS_H
+#define RV_HOOKS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "rv_ring.h"
+
+#define RV_HOOKS_MAGIC 0x31534b4f4f485652ull /* "RVHOOKS1" */
+#define RV_HOOKS_MAX_WATCHES 64
+#define RV_HOOKS_MAX_THREADS 32
+
+struct rv_hooks_watch {
+    uint64_t address;
+    uint64_t size;
+    uint32_t armed;   /* written by the tool while the target runs */
+    uint32_t reserved;
+};
+
+/* Written by the tool while the target is stopped at exec; the rings follow at
+ * RV_HOOKS_RING_OFFSET, each rv_ring_bytes(ring_capacity) long */
+struct rv_hooks_shared {
+    uint64_t magic;
+    uint32_t watch_count;
+    uint32_t ring_capacity;
+    uint32_t stop;          /* set by the tool when it stops reading */
+    uint32_t thread_count;  /* rings claimed by threads of the target */
+    uint64_t overflow;      /* stores of threads that found no ring left */
+    struct rv_hooks_watch watches[RV_HOOKS_MAX_WATCHES];
+};
+
+#define RV_HOOKS_RING_OFFSET ((sizeof(struct rv_hooks_shared) + 63) & ~(size_t)63)
+
+static inline struct rv_ring* rv_hooks_ring(struct rv_hooks_shared* shared, uint32_t index) {
+    return (struct rv_ring*)((char*)shared + RV_HOOKS_RING_OFFSET + index * rv_ring_bytes(shared->ring_capacity));
+}
+
+static inline size_t rv_hooks_bytes(uint32_t ring_capacity) {
+    return RV_HOOKS_RING_OFFSET + RV_HOOKS_MAX_THREADS * rv_ring_bytes(ring_capacity);
+}
+
+#endif /* RV_HOOKS_H */
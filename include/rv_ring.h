@@ -0,0 +1,75 @@
+/*
+ * Lock-free single-producer/single-consumer ring of fixed-size event records, laid out for
+ * shared memory between a monitored process and the monitor. Usable from C and C++.
+ */
+#ifndef RV_RING_H
+#define RV_RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* One observed write: the new value of variable id */
+struct rv_record {
+    uint64_t time_ns;  /* CLOCK_MONOTONIC */
+    int64_t value;
+    uint32_t id;
+    uint32_t flags;
+};
+
+/* Set on the last record of a group of writes that form one trace position */
+#define RV_RECORD_END 1u
+
+/* Head and tail are free-running counters on separate cache lines; records[i % capacity] */
+struct rv_ring {
+    uint64_t capacity; /* records, a power of two */
+    uint64_t dropped;  /* records lost to a full ring, written by the producer */
+    char pad0[48];
+    uint64_t head;     /* next record to write, written by the producer */
+    char pad1[56];
+    uint64_t tail;     /* next record to read, written by the consumer */
+    char pad2[56];
+    struct rv_record records[];
+};
+
+static inline size_t rv_ring_bytes(uint64_t capacity) {
+    return sizeof(struct rv_ring) + capacity * sizeof(struct rv_record);
+}
+
+static inline void rv_ring_init(struct rv_ring* ring, uint64_t capacity) {
+    ring->capacity = capacity;
+    ring->dropped = 0;
+    ring->head = 0;
+    ring->tail = 0;
+}
+
+static inline int rv_ring_full(struct rv_ring* ring) {
+    return __atomic_load_n(&ring->head, __ATOMIC_RELAXED) - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) >=
+           ring->capacity;
+}
+
+/* Returns 0 and counts a drop if the ring is full */
+static inline int rv_ring_push(struct rv_ring* ring, const struct rv_record* record) {
+    uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    uint64_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    if (head - tail >= ring->capacity) {
+        __atomic_store_n(&ring->dropped, ring->dropped + 1, __ATOMIC_RELAXED);
+        return 0;
+    }
+    ring->records[head & (ring->capacity - 1)] = *record;
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+/* Returns 0 if the ring is empty */
+static inline int rv_ring_pop(struct rv_ring* ring, struct rv_record* record) {
+    uint64_t tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+    uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    if (tail == head) {
+        return 0;
+    }
+    *record = ring->records[tail & (ring->capacity - 1)];
+    __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+#endif /* RV_RING_H */
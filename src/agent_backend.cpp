@@ -0,0 +1,184 @@
+#include <cerrno>
+#include <cstring>
+#include <ostream>
+#include <stdexcept>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/ptrace.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "backend.hpp"
+#include "rv_agent.h"
+
+using namespace std;
+
+// Records of the agent ring, a power of two
+static const uint64_t ring_capacity = 1 << 16;
+
+// How long the consumer sleeps on an empty ring, in milliseconds
+static const int idle_wait_ms = 1;
+
+// In-process capture: the target is started with the agent library preloaded (LD_PRELOAD) and a
+// memfd it inherits. At the exec stop the watch table is written into the memfd and the target
+// is released from ptrace; from then on the agent samples the armed watches from its own thread
+// and the monitor pops the records from the shared SPSC ring, with no system call per event on
+// either side. Sampling merges changes between two samples into one position, like the sample
+// backend, and targets that are not dynamically linked never load the agent.
+class AgentBackend : public Backend {
+public:
+    AgentBackend(string library, uint64_t interval_us) : library(move(library)), interval_us(interval_us) {}
+
+    ~AgentBackend() override {
+        if (shared != nullptr) {
+            munmap(shared, size);
+        }
+        if (memfd >= 0) {
+            close(memfd);
+        }
+        if (pidfd >= 0) {
+            close(pidfd);
+        }
+    }
+
+    const char* name() const override { return "agent"; }
+
+    vector<string> environment() override {
+        if (access(library.c_str(), R_OK) != 0) {
+            throw runtime_error("Agent library not found: " + library + " (build it with make)");
+        }
+        size = RV_AGENT_RING_OFFSET + rv_ring_bytes(ring_capacity);
+        // Inherited by the target, so no close-on-exec
+        memfd = memfd_create("rv-agent", 0);
+        if (memfd < 0 || ftruncate(memfd, size) != 0) {
+            throw runtime_error(string("Could not create the agent memfd: ") + strerror(errno));
+        }
+        void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+        if (p == MAP_FAILED) {
+            throw runtime_error(string("Could not map the agent memfd: ") + strerror(errno));
+        }
+        shared = static_cast<rv_agent_shared*>(p);
+        ring = rv_agent_ring(shared);
+        rv_ring_init(ring, ring_capacity);
+        return {"LD_PRELOAD=" + library, "RV_AGENT_FD=" + to_string(memfd)};
+    }
+
+    void attach(pid_t pid, const vector<Watch>& watches) override {
+        if (shared == nullptr) {
+            throw runtime_error("The agent backend needs the target started with its environment");
+        }
+        if (watches.size() > RV_AGENT_MAX_WATCHES) {
+            throw runtime_error("The agent watches at most " + to_string(RV_AGENT_MAX_WATCHES) + " variables");
+        }
+        this->pid = pid;
+        this->watches = watches;
+        vector<int64_t> initial = read_values(pid, watches);
+        for (size_t i = 0; i < watches.size(); ++i) {
+            shared->watches[i] = {watches[i].address, watches[i].size, initial[i], 1, 0};
+            variables.push_back(watches[i].variable);
+        }
+        armed.assign(watches.size(), true);
+        shared->watch_count = watches.size();
+        shared->interval_us = interval_us;
+        shared->magic = RV_AGENT_MAGIC;
+
+        pidfd = syscall(SYS_pidfd_open, pid, 0);
+        if (pidfd < 0) {
+            throw runtime_error(string("pidfd_open failed: ") + strerror(errno));
+        }
+        if (ptrace(PTRACE_DETACH, pid, nullptr, nullptr) != 0) {
+            throw runtime_error(string("PTRACE_DETACH failed: ") + strerror(errno));
+        }
+    }
+
+    void arm(const vector<bool>& armed) override {
+        // A disarmed variable is resynced by the caller, the agent's last sample of it is stale:
+        // it gets the current value as its baseline before sampling it again
+        vector<int64_t> current;
+        bool read = false;
+        for (size_t i = 0; i < armed.size(); ++i) {
+            if (armed[i] && !this->armed[i]) {
+                if (!read && !try_read_values(pid, watches, current)) {
+                    break;
+                }
+                read = true;
+                rv_agent_watch& watch = shared->watches[i];
+                __atomic_store_n(&watch.baseline, current[i], __ATOMIC_RELAXED);
+                __atomic_store_n(&watch.epoch, watch.epoch + 1, __ATOMIC_RELEASE);
+            }
+        }
+        for (size_t i = 0; i < armed.size(); ++i) {
+            __atomic_store_n(&shared->watches[i].armed, armed[i] ? 1u : 0u, __ATOMIC_RELEASE);
+        }
+        this->armed = armed;
+    }
+
+    bool next(vector<Change>& changes) override {
+        rv_record record;
+        for (;;) {
+            while (rv_ring_pop(ring, &record)) {
+                ++records;
+                if (record.id < variables.size()) {
+                    changes.push_back({variables[record.id], record.value});
+                }
+                if ((record.flags & RV_RECORD_END) && !changes.empty()) {
+                    return true;
+                }
+            }
+            if (exited) {
+                if (wait_tracee(pid, &status, 0) < 0) {
+                    throw runtime_error(string("waitpid failed: ") + strerror(errno));
+                }
+                return false;
+            }
+            // Only an idle ring costs a system call; the exit is seen after the last records.
+            // Without blocking it returns between positions, the rest of one is waited for.
+            pollfd fd = {pidfd, POLLIN, 0};
+            if (poll(&fd, 1, blocking || !changes.empty() ? idle_wait_ms : 0) > 0) {
+                exited = true;
+            } else if (!blocking && changes.empty()) {
+                return true;
+            }
+        }
+    }
+
+    void detach() override {
+        __atomic_store_n(&shared->stop, 1u, __ATOMIC_RELAXED);
+    }
+
+    vector<int> wait_fds() const override {
+        return {pidfd};
+    }
+
+    int poll_interval_ms() const override {
+        return idle_wait_ms;
+    }
+
+    void print_stats(ostream& out) const override {
+        if (shared->agent_pid == 0) {
+            out << "agent: never loaded into the target (is it dynamically linked?)" << endl;
+            return;
+        }
+        out << "agent: " << shared->samples << " samples every " << interval_us << " us, " << records
+            << " records, " << ring->dropped << " dropped" << endl;
+    }
+
+private:
+    string library;
+    uint64_t interval_us;
+    pid_t pid = 0;
+    int memfd = -1;
+    int pidfd = -1;
+    size_t size = 0;
+    rv_agent_shared* shared = nullptr;
+    rv_ring* ring = nullptr;
+    vector<Watch> watches;
+    vector<uint32_t> variables;
+    vector<bool> armed;
+    bool exited = false;
+    uint64_t records = 0;
+};
+
+unique_ptr<Backend> make_agent_backend(const string& library, uint64_t interval_us) {
+    return make_unique<AgentBackend>(library, interval_us);
+}
@@ -0,0 +1,262 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <sys/ptrace.h>
+#include <sys/signalfd.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "backend.hpp"
+#include "threads.hpp"
+
+using namespace std;
+
+// Function to find the agent library built next to the running tool
+static string default_agent_library() {
+    char path[4096];
+    ssize_t length = readlink("/proc/self/exe", path, sizeof(path) - 1);
+    if (length <= 0) {
+        return "agent/librv_agent.so";
+    }
+    string exe(path, length);
+    return exe.substr(0, exe.rfind('/') + 1) + "agent/librv_agent.so";
+}
+
+unique_ptr<Backend> make_backend(const string& name, const BackendOptions& options) {
+    if (name == "step") {
+        return make_step_backend();
+    }
+    if (name == "perf") {
+        return make_perf_backend();
+    }
+    if (name == "sample") {
+        return make_sample_backend(options.sample_interval_us);
+    }
+    if (name == "agent") {
+        return make_agent_backend(options.agent_library.empty() ? default_agent_library() : options.agent_library,
+                                  options.sample_interval_us);
+    }
+    if (name == "hooks") {
+        return make_hooks_backend();
+    }
+    if (name == "uprobe") {
+        return make_uprobe_backend();
+    }
+#if defined(__x86_64__)
+    if (name == "dr") {
+        return make_dr_backend();
+    }
+    if (name == "uffd") {
+        return make_uffd_backend();
+    }
+    if (name == "sites") {
+        return make_sites_backend();
+    }
+#endif
+    throw invalid_argument("Unknown backend: " + name);
+}
+
+// Function to decode the bytes of a watch into an integer
+static int64_t decode(const unsigned char* bytes, uint64_t size) {
+    uint64_t raw = 0;
+    memcpy(&raw, bytes, size < 8 ? size : 8);
+    switch (size) {
+    case 1: return (int8_t)raw;
+    case 2: return (int16_t)raw;
+    case 4: return (int32_t)raw;
+    default: return (int64_t)raw;
+    }
+}
+
+vector<int64_t> read_values(pid_t pid, const vector<Watch>& watches) {
+    vector<int64_t> values;
+    if (!try_read_values(pid, watches, values)) {
+        throw runtime_error("Could not read watched variables of process " + to_string(pid) + ": it has exited");
+    }
+    return values;
+}
+
+bool try_read_values(pid_t pid, const vector<Watch>& watches, vector<int64_t>& values) {
+    return ValueReader(watches).read(pid, values);
+}
+
+// Stops are waited for by the tracer thread only
+static uint64_t stop_count = 0;
+
+pid_t wait_tracee(pid_t pid, int* status, int options) {
+    pid_t waited = waitpid(pid, status, options);
+    if (waited > 0 && WIFSTOPPED(*status)) {
+        ++stop_count;
+    }
+    return waited;
+}
+
+uint64_t tracee_stops() {
+    return stop_count;
+}
+
+// Largest gap between two ranges on one 4 KiB page that is read rather than split into two iovecs
+static const uint64_t merge_gap = 64;
+
+ValueReader::ValueReader(const vector<Watch>& watches) : sizes(watches.size()), offsets(watches.size()) {
+    vector<size_t> order(watches.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        order[i] = i;
+        sizes[i] = watches[i].size;
+    }
+    sort(order.begin(), order.end(), [&](size_t a, size_t b) { return watches[a].address < watches[b].address; });
+
+    uint64_t start = 0, end = 0;
+    size_t length = 0;
+    for (size_t i : order) {
+        uint64_t address = watches[i].address;
+        uint64_t size = watches[i].size < 8 ? watches[i].size : 8;
+        bool same_page = (address >> 12) == (end >> 12);
+        if (remote.empty() || address > end + (same_page ? merge_gap : 0)) {
+            if (!remote.empty()) {
+                remote.back().iov_len = end - start;
+                length += end - start;
+            }
+            start = end = address;
+            remote.push_back({(void*)address, 0});
+        }
+        offsets[i] = length + (address - start);
+        end = max(end, address + size);
+    }
+    if (!remote.empty()) {
+        remote.back().iov_len = end - start;
+        length += end - start;
+    }
+    buffer.resize(length + 8);
+}
+
+bool ValueReader::read(pid_t pid, vector<int64_t>& values) {
+    values.resize(sizes.size());
+    if (remote.empty()) {
+        return true;
+    }
+    iovec local = {buffer.data(), buffer.size() - 8};
+    ssize_t n = process_vm_readv(pid, &local, 1, remote.data(), remote.size(), 0);
+    if (n < 0 && errno == ESRCH) {
+        return false;
+    }
+    if (n != (ssize_t)local.iov_len) {
+        throw runtime_error("Could not read watched variables of process " + to_string(pid) + ": " +
+                            (n < 0 ? strerror(errno) : "short read"));
+    }
+    for (size_t i = 0; i < sizes.size(); ++i) {
+        values[i] = decode(buffer.data() + offsets[i], sizes[i]);
+    }
+    return true;
+}
+
+vector<pair<uint64_t, uint64_t>> aligned_pieces(const Watch& watch) {
+    vector<pair<uint64_t, uint64_t>> pieces;
+    uint64_t address = watch.address;
+    uint64_t end = address + watch.size;
+    while (address < end) {
+        uint64_t length = 8;
+        while (length > 1 && (address % length != 0 || address + length > end)) {
+            length /= 2;
+        }
+        pieces.push_back({address, length});
+        address += length;
+    }
+    return pieces;
+}
+
+void block_tracer_signals() {
+    sigset_t all;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, nullptr);
+}
+
+RunningTracee::~RunningTracee() {
+    if (signal_fd >= 0) {
+        close(signal_fd);
+        sigprocmask(SIG_SETMASK, &saved_mask, nullptr);
+    }
+}
+
+void RunningTracee::attach(pid_t pid) {
+    this->pid = pid;
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &mask, &saved_mask);
+    signal_fd = signalfd(-1, &mask, SFD_CLOEXEC | SFD_NONBLOCK);
+    if (signal_fd < 0) {
+        throw runtime_error(string("signalfd failed: ") + strerror(errno));
+    }
+    if (ptrace(PTRACE_SETOPTIONS, pid, nullptr, (void*)PTRACE_O_TRACEEXIT) != 0) {
+        throw runtime_error(string("PTRACE_SETOPTIONS failed: ") + strerror(errno));
+    }
+}
+
+void RunningTracee::resume(int signal) {
+    if (ptrace(PTRACE_CONT, pid, nullptr, (void*)(long)signal) != 0) {
+        throw runtime_error(string("PTRACE_CONT failed: ") + strerror(errno));
+    }
+}
+
+bool RunningTracee::handle_stops(int& status) {
+    signalfd_siginfo info;
+    while (read(signal_fd, &info, sizeof(info)) == sizeof(info)) {
+    }
+    int stop;
+    while (!at_exit && wait_tracee(pid, &stop, WNOHANG) > 0) {
+        if (WIFEXITED(stop) || WIFSIGNALED(stop)) {
+            status = stop;
+            return false;
+        }
+        if (is_exit_stop(stop)) {
+            at_exit = true;
+        } else if (WIFSTOPPED(stop)) {
+            resume(WSTOPSIG(stop) == SIGTRAP ? 0 : WSTOPSIG(stop));
+        }
+    }
+    return true;
+}
+
+bool RunningTracee::interrupt(int& status) {
+    kill(pid, SIGSTOP);
+    for (;;) {
+        int stop;
+        if (wait_tracee(pid, &stop, 0) < 0) {
+            throw runtime_error(string("waitpid failed: ") + strerror(errno));
+        }
+        if (WIFEXITED(stop) || WIFSIGNALED(stop)) {
+            status = stop;
+            return false;
+        }
+        if (is_exit_stop(stop)) {
+            at_exit = true;
+            return false;
+        }
+        if (WSTOPSIG(stop) == SIGSTOP) {
+            return true;
+        }
+        resume(WSTOPSIG(stop) == SIGTRAP ? 0 : WSTOPSIG(stop));
+    }
+}
+
+void RunningTracee::finish(int& status) {
+    if (at_exit) {
+        resume(0);
+    }
+    while (wait_tracee(pid, &status, 0) >= 0 && WIFSTOPPED(status)) {
+        resume(WSTOPSIG(status) == SIGTRAP || WSTOPSIG(status) == SIGSTOP ? 0 : WSTOPSIG(status));
+    }
+}
+
+void RunningTracee::detach() {
+    int status;
+    if (!at_exit && !interrupt(status) && !at_exit) {
+        return;
+    }
+    // The SIGSTOP used to stop the tracee is swallowed here
+    if (ptrace(PTRACE_DETACH, pid, nullptr, nullptr) != 0) {
+        throw runtime_error(string("PTRACE_DETACH failed: ") + strerror(errno));
+    }
+}
@@ -0,0 +1,197 @@
+#ifndef RV_BACKEND_HPP
+#define RV_BACKEND_HPP
+
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+// A watched program variable at its runtime address. Values are read as little-endian integers
+// of the first size bytes (at most 8), sign extended for sizes 1, 2 and 4.
+struct Watch {
+    uint32_t variable;
+    std::string name;
+    uint64_t address;
+    uint64_t size;
+    // The other kinds observe the function at address instead. The variable of Call and Return
+    // is 1 at the positions where it is entered or returns, 0 elsewhere; the variable of
+    // CallCount and ReturnCount is the number of times it was entered or returned so far.
+    enum Kind : uint8_t { Value, Call, Return, CallCount, ReturnCount } kind = Value;
+};
+
+// A new value of a watched variable
+struct Change {
+    uint32_t variable;
+    int64_t value;
+    // Thread whose stop revealed it, 0 where the backend cannot tell
+    pid_t thread = 0;
+};
+
+// A way of capturing the writes to watched variables of a tracee. All changes returned by one
+// call of next() happened at the same point of the execution and form one trace position.
+class Backend {
+public:
+    virtual ~Backend() = default;
+
+    virtual const char* name() const = 0;
+
+    // Whether watches of the kind are supported, most backends only read values
+    virtual bool supports(Watch::Kind kind) const { return kind == Watch::Value; }
+
+    // Function to give the NAME=value entries the tracee must be started with, called once
+    // before it is started
+    virtual std::vector<std::string> environment() { return {}; }
+
+    // Function to start capturing in a tracee stopped under ptrace, with every watch armed.
+    // Backends that do not need ptrace stops may detach and let the tracee run.
+    virtual void attach(pid_t pid, const std::vector<Watch>& watches) = 0;
+
+    // Function to choose the armed watches of the stopped tracee (armed[i] for watches[i]).
+    // Changes of disarmed watches are not reported.
+    virtual void arm(const std::vector<bool>& armed) = 0;
+
+    // Whether all the watches can be armed at once, which --record and lagging shards under
+    // --workers ask for
+    virtual bool can_arm_all(const std::vector<Watch>& /*watches*/) const { return true; }
+
+    // Function to resume the tracee until watched variables change and append their new values
+    // to changes. Returns false once the tracee has exited.
+    virtual bool next(std::vector<Change>& changes) = 0;
+
+    // Function to remove all instrumentation from the tracee and detach from it, it then runs on
+    // untraced. The tracee may be stopped or still running from a next() that did not wait.
+    virtual void detach() = 0;
+
+    // Function to print counters of the capture
+    virtual void print_stats(std::ostream& /*out*/) const {}
+
+    // Wait status of the exited tracee
+    int exit_status() const { return status; }
+
+    // Function to let next() return true with no changes when the tracee has nothing to report,
+    // instead of waiting, so that one tracer can take turns between many tracees. It calls next()
+    // again once a descriptor of wait_fds() is readable, the tracee stops (the tracer gets
+    // SIGCHLD) or poll_interval_ms() milliseconds have passed.
+    void set_blocking(bool blocking) { this->blocking = blocking; }
+
+    // Descriptors that next() waits on, which may change with arm()
+    virtual std::vector<int> wait_fds() const { return {}; }
+
+    // How often next() must be called to look for news that no descriptor signals, -1 for never
+    virtual int poll_interval_ms() const { return -1; }
+
+protected:
+    int status = 0;
+    bool blocking = true;
+};
+
+// A tracee that runs between events instead of stopping on them. It stays attached only for
+// its exit stop, where its memory can still be read, and for signals, which are passed on.
+// Its stops are noticed through a signalfd for SIGCHLD that can be polled next to other fds.
+class RunningTracee {
+public:
+    RunningTracee() = default;
+    RunningTracee(const RunningTracee&) = delete;
+    RunningTracee& operator=(const RunningTracee&) = delete;
+    ~RunningTracee();
+
+    // Function to take over a tracee stopped under ptrace, it stays stopped
+    void attach(pid_t pid);
+
+    int fd() const { return signal_fd; }
+    bool exiting() const { return at_exit; }
+
+    void resume(int signal = 0);
+
+    // Function to handle the pending stops once fd() is readable: signals are passed on and the
+    // exit stop sets exiting(). Returns false with the wait status if the tracee is gone.
+    bool handle_stops(int& status);
+
+    // Function to stop the running tracee with SIGSTOP, passing other signals on. Returns false
+    // if it reached its exit stop or exited (with the wait status) instead.
+    bool interrupt(int& status);
+
+    // Function to let the tracee run on from its exit stop and reap it
+    void finish(int& status);
+
+    // Function to stop the tracee and detach from it
+    void detach();
+
+private:
+    pid_t pid = 0;
+    int signal_fd = -1;
+    sigset_t saved_mask;
+    bool at_exit = false;
+};
+
+// Function to block every signal in the calling thread, which must not be the tracer's. The
+// tracer reads SIGCHLD, SIGINT and SIGTERM from signalfds, which never see one that another
+// thread has taken, and the threads of the tool leave all signals to it.
+void block_tracer_signals();
+
+// Settings of the backends that have any
+struct BackendOptions {
+    uint64_t sample_interval_us = 1000;
+    // Library preloaded by the agent backend, next to the tool by default
+    std::string agent_library;
+};
+
+// Function to create a backend by name, throws invalid_argument for unknown names
+std::unique_ptr<Backend> make_backend(const std::string& name, const BackendOptions& options = {});
+
+// Function to read the current values of the watches of a process with a single system call
+std::vector<int64_t> read_values(pid_t pid, const std::vector<Watch>& watches);
+
+// Function to read the values like read_values, but return false if the process has exited
+bool try_read_values(pid_t pid, const std::vector<Watch>& watches, std::vector<int64_t>& values);
+
+// Function to wait for a tracee like waitpid, counting the ptrace stops it returns
+pid_t wait_tracee(pid_t pid, int* status, int options);
+
+// Ptrace stops waited for so far, of all tracees: every breakpoint, single step, watchpoint hit
+// and signal that stopped one for the tracer
+uint64_t tracee_stops();
+
+// Reader of a fixed set of watches with a single process_vm_readv. Overlapping and adjacent
+// ranges, and ranges on the same page less than a cache line apart, are merged into one iovec,
+// so hundreds of variables usually need only a handful.
+class ValueReader {
+public:
+    ValueReader() = default;
+    explicit ValueReader(const std::vector<Watch>& watches);
+
+    // Function to read the value of every watch (values[i] for watches[i]), returns false if
+    // the process has exited
+    bool read(pid_t pid, std::vector<int64_t>& values);
+
+    size_t iovec_count() const { return remote.size(); }
+
+private:
+    std::vector<uint64_t> sizes;
+    std::vector<size_t> offsets;
+    std::vector<struct iovec> remote;
+    std::vector<unsigned char> buffer;
+};
+
+// Function to split a watch into naturally aligned (address, length) pieces of 1, 2, 4 or 8
+// bytes, the ranges a hardware watchpoint can cover
+std::vector<std::pair<uint64_t, uint64_t>> aligned_pieces(const Watch& watch);
+
+std::unique_ptr<Backend> make_step_backend();
+std::unique_ptr<Backend> make_perf_backend();
+std::unique_ptr<Backend> make_sample_backend(uint64_t interval_us);
+std::unique_ptr<Backend> make_agent_backend(const std::string& library, uint64_t interval_us);
+std::unique_ptr<Backend> make_hooks_backend();
+std::unique_ptr<Backend> make_uprobe_backend();
+#if defined(__x86_64__)
+std::unique_ptr<Backend> make_dr_backend();
+std::unique_ptr<Backend> make_uffd_backend();
+std::unique_ptr<Backend> make_sites_backend();
+#endif
+
+#endif // RV_BACKEND_HPP
@@ -0,0 +1,225 @@
+#if defined(__x86_64__)
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <signal.h>
+#include <sys/ptrace.h>
+#include <sys/wait.h>
+#include "breakpoints.hpp"
+
+using namespace std;
+
+static string hex_address(uint64_t address) {
+    char text[24];
+    snprintf(text, sizeof(text), "0x%lx", (unsigned long)address);
+    return text;
+}
+
+void Breakpoints::acquire(uint64_t pc) {
+    Entry& entry = entries[pc];
+    if (entry.users++ == 0) {
+        write(pc, entry, true);
+    }
+}
+
+void Breakpoints::release(uint64_t pc) {
+    Entry* entry = entries.find(pc);
+    if (entry != nullptr && entry->users > 0 && --entry->users == 0) {
+        write(pc, *entry, false);
+    }
+}
+
+bool Breakpoints::hit(user_regs_struct& regs) const {
+    if (entries.find(regs.rip - 1) == nullptr) {
+        return false;
+    }
+    regs.rip -= 1;
+    return true;
+}
+
+bool Breakpoints::step_over(const user_regs_struct& regs, int& status, int& pending_signal) {
+    // The handling of the hit may have released the breakpoint already
+    Entry& entry = entries[regs.rip];
+    bool planted = entry.users > 0;
+    pid_t tid = threads->current();
+    if (ptrace(PTRACE_SETREGS, tid, nullptr, &regs) != 0) {
+        throw runtime_error(string("PTRACE_SETREGS failed: ") + strerror(errno));
+    }
+    bool others_stopped = threads->size() > 1;
+    if (others_stopped) {
+        threads->stop_others();
+    }
+    if (planted) {
+        write(regs.rip, entry, false);
+    }
+    for (;;) {
+        if (ptrace(PTRACE_SINGLESTEP, tid, nullptr, nullptr) != 0) {
+            throw runtime_error(string("PTRACE_SINGLESTEP failed: ") + strerror(errno));
+        }
+        if (wait_tracee(tid, &status, __WALL) < 0) {
+            throw runtime_error(string("waitpid failed: ") + strerror(errno));
+        }
+        if (WIFEXITED(status) || WIFSIGNALED(status)) {
+            return false;
+        }
+        if (!WIFSTOPPED(status) || WSTOPSIG(status) == SIGTRAP) {
+            break;
+        }
+        // A signal arrived before the step, it is delivered with the next continue
+        pending_signal = WSTOPSIG(status);
+    }
+    if (planted) {
+        write(regs.rip, entry, true);
+    }
+    if (others_stopped) {
+        threads->resume_others();
+    }
+    return true;
+}
+
+void Breakpoints::remove_all() {
+    threads->for_each_queued([&](pid_t tid, int status) {
+        user_regs_struct regs;
+        if (WIFSTOPPED(status) && WSTOPSIG(status) == SIGTRAP &&
+            ptrace(PTRACE_GETREGS, tid, nullptr, &regs) == 0 && hit(regs)) {
+            ptrace(PTRACE_SETREGS, tid, nullptr, &regs);
+        }
+    });
+    entries.for_each([&](uint64_t pc, Entry& entry) {
+        if (entry.users > 0) {
+            entry.users = 0;
+            write(pc, entry, false);
+        }
+    });
+}
+
+// Function to write an int3 over the byte at pc, or the original byte back. Only that byte of
+// the word changes, neighbouring breakpoints stay as they are.
+void Breakpoints::write(uint64_t pc, Entry& entry, bool plant) {
+    pid_t tid = threads->current();
+    errno = 0;
+    long word = ptrace(PTRACE_PEEKTEXT, tid, (void*)pc, nullptr);
+    if (errno != 0) {
+        throw runtime_error("Could not read the breakpoint at " + hex_address(pc) + ": " + strerror(errno));
+    }
+    if (plant) {
+        entry.original = word & 0xff;
+        word = (word & ~0xffl) | 0xcc;
+    } else {
+        word = (word & ~0xffl) | entry.original;
+    }
+    if (ptrace(PTRACE_POKETEXT, tid, (void*)pc, (void*)word) != 0) {
+        throw runtime_error("Could not write the breakpoint at " + hex_address(pc) + ": " + strerror(errno));
+    }
+    planted_count += plant ? 1 : -1;
+}
+
+void FunctionEvents::attach(Threads& threads, const vector<Watch>& watches, Breakpoints& breakpoints) {
+    this->threads = &threads;
+    this->breakpoints = &breakpoints;
+    watch_function.assign(watches.size(), -1);
+    watch_is_call.assign(watches.size(), false);
+    for (size_t i = 0; i < watches.size(); ++i) {
+        const Watch& watch = watches[i];
+        if (watch.kind == Watch::Value) {
+            continue;
+        }
+        uint32_t& index = function_at[watch.address];
+        if (index == 0) {
+            entries.push_back(watch.address);
+            functions.emplace_back();
+            index = functions.size();
+        }
+        Function& function = functions[index - 1];
+        (watch.kind == Watch::Call ? function.call_variable : function.return_variable) = watch.variable;
+        watch_function[i] = index - 1;
+        watch_is_call[i] = watch.kind == Watch::Call;
+    }
+}
+
+void FunctionEvents::arm(const vector<bool>& armed) {
+    for (size_t i = 0; i < armed.size(); ++i) {
+        if (watch_function[i] >= 0) {
+            Function& function = functions[watch_function[i]];
+            (watch_is_call[i] ? function.call_armed : function.return_armed) = armed[i];
+        }
+    }
+    for (size_t f = 0; f < functions.size(); ++f) {
+        Function& function = functions[f];
+        // Frames are tracked whatever the arming, a ret(f) armed later needs the earlier calls
+        bool wanted = function.call_armed || function.return_variable >= 0;
+        if (wanted != function.planted) {
+            if (wanted) {
+                breakpoints->acquire(entries[f]);
+            } else {
+                breakpoints->release(entries[f]);
+            }
+            function.planted = wanted;
+        }
+    }
+}
+
+bool FunctionEvents::handle(const user_regs_struct& regs, vector<Change>& changes) {
+    bool handled = false;
+    const uint32_t* index = function_at.find(regs.rip);
+    if (index != nullptr && functions[*index - 1].planted) {
+        handled = true;
+        Function& function = functions[*index - 1];
+        if (function.call_armed) {
+            ++call_count;
+            raise(function.call_variable, changes);
+        }
+        if (function.return_variable >= 0) {
+            // At the entry the return address is on top of the stack
+            errno = 0;
+            uint64_t return_address = ptrace(PTRACE_PEEKDATA, threads->current(), (void*)regs.rsp, nullptr);
+            if (errno == 0) {
+                vector<Frame>& frames = frames_at[return_address];
+                if (frames.empty()) {
+                    breakpoints->acquire(return_address);
+                }
+                frames.push_back({regs.rsp + 8, *index - 1, threads->current()});
+            }
+        }
+    }
+
+    vector<Frame>* frames = frames_at.find(regs.rip);
+    if (frames != nullptr && !frames->empty()) {
+        handled = true;
+        // Frames left below the stack pointer were unwound without returning (longjmp)
+        size_t kept = 0;
+        for (const Frame& frame : *frames) {
+            if (frame.thread != threads->current()) {
+                (*frames)[kept++] = frame;
+            } else if (frame.stack_pointer == regs.rsp) {
+                const Function& function = functions[frame.function];
+                if (function.return_armed) {
+                    ++return_count;
+                    raise(function.return_variable, changes);
+                }
+            } else if (frame.stack_pointer > regs.rsp) {
+                (*frames)[kept++] = frame;
+            }
+        }
+        frames->resize(kept);
+        if (frames->empty()) {
+            breakpoints->release(regs.rip);
+        }
+    }
+    return handled;
+}
+
+void FunctionEvents::lower(vector<Change>& changes) {
+    for (uint32_t variable : raised) {
+        changes.push_back({variable, 0});
+    }
+    raised.clear();
+}
+
+void FunctionEvents::raise(int variable, vector<Change>& changes) {
+    changes.push_back({(uint32_t)variable, 1, threads->current()});
+    raised.push_back(variable);
+}
+
+#endif // __x86_64__
@@ -0,0 +1,187 @@
+#ifndef RV_BREAKPOINTS_HPP
+#define RV_BREAKPOINTS_HPP
+
+#if defined(__x86_64__)
+
+#include <cstdint>
+#include <vector>
+#include <sys/types.h>
+#include <sys/user.h>
+#include "backend.hpp"
+#include "threads.hpp"
+
+// Flat open-addressed hash map keyed by code address, with linear probing in parallel key and
+// value arrays, so a lookup touches one or two cache lines however many entries there are.
+// Address 0 marks an empty slot. Entries are never erased; users mark values unused instead.
+template <typename T>
+class PcMap {
+public:
+    PcMap() : keys(16, 0), values(16) {}
+
+    T* find(uint64_t pc) {
+        size_t i = slot(pc);
+        return keys[i] == pc ? &values[i] : nullptr;
+    }
+
+    const T* find(uint64_t pc) const { return const_cast<PcMap*>(this)->find(pc); }
+
+    // Function to get the value of pc, inserting a default one if it has none
+    T& operator[](uint64_t pc) {
+        size_t i = slot(pc);
+        if (keys[i] == pc) {
+            return values[i];
+        }
+        if (2 * (count + 1) > keys.size()) {
+            grow();
+            i = slot(pc);
+        }
+        keys[i] = pc;
+        ++count;
+        return values[i];
+    }
+
+    size_t size() const { return count; }
+
+    // Function to call visit(pc, value) for every entry
+    template <typename Visit>
+    void for_each(Visit visit) {
+        for (size_t i = 0; i < keys.size(); ++i) {
+            if (keys[i] != 0) {
+                visit(keys[i], values[i]);
+            }
+        }
+    }
+
+private:
+    // Function to find the slot of pc, or the empty slot where it would go
+    size_t slot(uint64_t pc) const {
+        size_t mask = keys.size() - 1;
+        size_t i = (pc * 0x9e3779b97f4a7c15ull) >> 32 & mask;
+        while (keys[i] != pc && keys[i] != 0) {
+            i = (i + 1) & mask;
+        }
+        return i;
+    }
+
+    void grow() {
+        std::vector<uint64_t> old_keys = std::move(keys);
+        std::vector<T> old_values = std::move(values);
+        keys.assign(old_keys.size() * 2, 0);
+        values = std::vector<T>(old_keys.size() * 2);
+        for (size_t i = 0; i < old_keys.size(); ++i) {
+            if (old_keys[i] != 0) {
+                size_t j = slot(old_keys[i]);
+                keys[j] = old_keys[i];
+                values[j] = std::move(old_values[i]);
+            }
+        }
+    }
+
+    std::vector<uint64_t> keys;
+    std::vector<T> values;
+    size_t count = 0;
+};
+
+// int3 breakpoints in a tracee stopped under ptrace. A breakpoint may serve several users (a
+// store site that is also a function entry), it stays planted until the last one releases it.
+// Memory is accessed through the current thread of threads, which must be stopped.
+class Breakpoints {
+public:
+    void attach(Threads& threads) { this->threads = &threads; }
+
+    // Function to plant an int3 at pc, or count one more user of it
+    void acquire(uint64_t pc);
+
+    // Function to drop a user of pc, the original byte is written back with the last one
+    void release(uint64_t pc);
+
+    // Function to check whether a SIGTRAP stop is at one of the breakpoints, then regs.rip is
+    // moved back to it (in regs only). A stop that waited in the queue of threads may be at one
+    // that was released meanwhile; it is reported too, with no user left.
+    bool hit(user_regs_struct& regs) const;
+
+    // Function to execute the instruction under the breakpoint at regs.rip, where the current
+    // thread is stopped, and plant the breakpoint again if it still has users. The other threads
+    // are stopped meanwhile, so none passes it unseen. A signal arriving meanwhile is left in
+    // pending_signal. Returns false with the wait status if the thread exited.
+    bool step_over(const user_regs_struct& regs, int& status, int& pending_signal);
+
+    // Function to restore every original byte, with every thread stopped. Threads whose stops at
+    // breakpoints are still queued are moved back onto the restored instruction.
+    void remove_all();
+
+    size_t planted() const { return planted_count; }
+
+private:
+    struct Entry {
+        uint32_t users = 0;
+        uint8_t original = 0;
+    };
+
+    void write(uint64_t pc, Entry& entry, bool plant);
+
+    Threads* threads = nullptr;
+    PcMap<Entry> entries;
+    size_t planted_count = 0;
+};
+
+// The call(f) and ret(f) events of the watches of kind Call and Return. An int3 at the entry of
+// each watched function reports its calls; for its returns the return address is read off the
+// stack at entry and gets a breakpoint of its own, which fires for the frame whose stack pointer
+// it left behind (recursion, other callers and other threads returning there are told apart by
+// it). Events are tagged with the thread that stopped.
+class FunctionEvents {
+public:
+    void attach(Threads& threads, const std::vector<Watch>& watches, Breakpoints& breakpoints);
+
+    // Function to plant the breakpoints of the armed events and remove the others. The entries of
+    // functions with a ret(f) watch stay planted, so that a frame entered while it is disarmed
+    // still raises ret(f) once it is armed again.
+    void arm(const std::vector<bool>& armed);
+
+    // Function to handle a stop at a breakpoint (regs.rip at it): the events that occur there are
+    // appended to changes with value 1. Returns false if pc is no event breakpoint.
+    bool handle(const user_regs_struct& regs, std::vector<Change>& changes);
+
+    // Function to append the reset to 0 of the events of the last position, so they hold at
+    // exactly one position. Called before collecting the changes of the next one.
+    void lower(std::vector<Change>& changes);
+
+    uint64_t calls() const { return call_count; }
+    uint64_t returns() const { return return_count; }
+
+private:
+    struct Function {
+        int call_variable = -1;
+        int return_variable = -1;
+        bool call_armed = false;
+        bool return_armed = false;
+        bool planted = false;
+    };
+
+    // A call whose return is awaited
+    struct Frame {
+        uint64_t stack_pointer;  // after the return
+        uint32_t function;
+        pid_t thread;
+    };
+
+    void raise(int variable, std::vector<Change>& changes);
+
+    Threads* threads = nullptr;
+    Breakpoints* breakpoints = nullptr;
+    std::vector<uint64_t> entries;
+    std::vector<Function> functions;
+    // Function index and kind of each watch, -1 for values
+    std::vector<int> watch_function;
+    std::vector<bool> watch_is_call;
+    PcMap<uint32_t> function_at;  // index + 1
+    PcMap<std::vector<Frame>> frames_at;
+    std::vector<uint32_t> raised;
+    uint64_t call_count = 0;
+    uint64_t return_count = 0;
+};
+
+#endif // __x86_64__
+
+#endif // RV_BREAKPOINTS_HPP
@@ -0,0 +1,240 @@
+#if defined(__x86_64__)
+
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <ostream>
+#include <stdexcept>
+#include <signal.h>
+#include <sys/ptrace.h>
+#include <sys/user.h>
+#include <sys/wait.h>
+#include "breakpoints.hpp"
+
+using namespace std;
+
+// Hardware watchpoint backend: programs the x86-64 debug registers DR0-DR3 as write
+// watchpoints through PTRACE_POKEUSER. The tracee runs at full speed and only traps after a
+// store to a watched variable. A watch is split into naturally aligned ranges of 1, 2, 4 or
+// 8 bytes, one debug register each, so only four such ranges can be armed at a time. When a
+// monitor state needs more, the watches that do not fit are compared at the stops of the others
+// instead, a coarser trace, and print_stats() says how often. The call(f) and ret(f) events are
+// int3 breakpoints, which take no debug register. Debug registers are per thread: every thread
+// of the tracee is followed and gets the same ones.
+class DrBackend : public Backend {
+public:
+    const char* name() const override { return "dr"; }
+
+    bool supports(Watch::Kind kind) const override {
+        return kind == Watch::Value || kind == Watch::Call || kind == Watch::Return;
+    }
+
+    void attach(pid_t pid, const vector<Watch>& watches) override {
+        this->pid = pid;
+        this->watches = watches;
+        threads.attach(pid, [this](pid_t tid) { load_debug_registers(tid); });
+        breakpoints.attach(threads);
+        events.attach(threads, watches, breakpoints);
+        arm(vector<bool>(watches.size(), true));
+    }
+
+    bool can_arm_all(const vector<Watch>& watches) const override {
+        size_t ranges = 0;
+        for (const Watch& watch : watches) {
+            if (watch.kind == Watch::Value) {
+                ranges += aligned_pieces(watch).size();
+            }
+        }
+        return ranges <= debug_registers;
+    }
+
+    void arm(const vector<bool>& armed) override {
+        this->armed = armed;
+        values = read_values(pid, watches);
+        events.arm(armed);
+        // Programmed before the tracee resumes, the last choice may need fewer registers
+        dirty = true;
+    }
+
+    bool next(vector<Change>& changes) override {
+        if (dirty) {
+            program();
+        }
+        for (;;) {
+            if (!running) {
+                threads.resume(pending_signal);
+                pending_signal = 0;
+                running = true;
+            }
+            if (!threads.wait(status, blocking)) {
+                return false;
+            }
+            if (status == 0) {
+                return true;
+            }
+            running = false;
+            // The events of the last position end at the next stop
+            events.lower(changes);
+            size_t lowered = changes.size();
+            if (WSTOPSIG(status) != SIGTRAP || !(watchpoint_hit() || breakpoint_hit(changes))) {
+                // Not ours, the tracee gets it
+                pending_signal = WSTOPSIG(status);
+                continue;
+            }
+            if (WIFEXITED(status) || WIFSIGNALED(status)) {
+                return false;
+            }
+
+            // A store may leave the value unchanged, which is no new position
+            vector<int64_t> current = read_values(pid, watches);
+            for (size_t i = 0; i < watches.size(); ++i) {
+                if (armed[i] && watches[i].kind == Watch::Value && current[i] != values[i]) {
+                    changes.push_back({watches[i].variable, current[i], threads.current()});
+                }
+            }
+            values = move(current);
+            if (changes.size() > lowered) {
+                return true;
+            }
+        }
+    }
+
+    void detach() override {
+        threads.stop_all();
+        breakpoints.remove_all();
+        threads.for_each([&](pid_t tid) { poke_debug_register(tid, 7, 0); });
+        threads.detach(pending_signal);
+        pending_signal = 0;
+    }
+
+    void print_stats(ostream& out) const override {
+        if (threads.followed() > 1) {
+            out << "dr: " << threads.followed() << " threads" << endl;
+        }
+        if (overflows > 0) {
+            out << "dr: " << overflows << " times more watches armed than debug registers, "
+                << "the rest were compared at other stops" << endl;
+        }
+    }
+
+private:
+    static constexpr int debug_registers = 4;
+
+    void poke_debug_register(pid_t tid, int index, uint64_t value) {
+        size_t offset = offsetof(struct user, u_debugreg) + index * sizeof(long);
+        if (ptrace(PTRACE_POKEUSER, tid, (void*)offset, (void*)value) != 0) {
+            throw runtime_error("Could not set debug register DR" + to_string(index) + ": " + strerror(errno));
+        }
+    }
+
+    uint64_t peek_debug_register(int index) {
+        size_t offset = offsetof(struct user, u_debugreg) + index * sizeof(long);
+        errno = 0;
+        long value = ptrace(PTRACE_PEEKUSER, threads.current(), (void*)offset, nullptr);
+        if (errno != 0) {
+            throw runtime_error("Could not read debug register DR" + to_string(index) + ": " + strerror(errno));
+        }
+        return value;
+    }
+
+    // Function to check DR6 of the current thread for a triggered watchpoint and clear it
+    bool watchpoint_hit() {
+        uint64_t dr6 = peek_debug_register(6);
+        if ((dr6 & 0xf) == 0) {
+            return false;
+        }
+        poke_debug_register(threads.current(), 6, 0);
+        return true;
+    }
+
+    // Function to handle a stop at one of the int3 breakpoints: its events are appended to
+    // changes and the instruction under it is stepped, which may store to a watched variable
+    // too, and may end the tracee (status tells)
+    bool breakpoint_hit(vector<Change>& changes) {
+        user_regs_struct regs;
+        if (ptrace(PTRACE_GETREGS, threads.current(), nullptr, &regs) != 0) {
+            throw runtime_error(string("PTRACE_GETREGS failed: ") + strerror(errno));
+        }
+        if (!breakpoints.hit(regs)) {
+            return false;
+        }
+        events.handle(regs, changes);
+        if (breakpoints.step_over(regs, status, pending_signal)) {
+            watchpoint_hit();
+        }
+        return true;
+    }
+
+    // Function to program the debug registers of every thread with the armed watches
+    void program() {
+        vector<pair<uint64_t, uint64_t>> ranges;
+        bool overflow = false;
+        for (size_t i = 0; i < watches.size(); ++i) {
+            if (armed[i] && watches[i].kind == Watch::Value) {
+                vector<pair<uint64_t, uint64_t>> pieces = aligned_pieces(watches[i]);
+                // A watch that does not fit whole stays armed for the comparison in next(), its
+                // writes then show at the next stop of another watch or breakpoint
+                if (ranges.size() + pieces.size() > debug_registers) {
+                    overflow = true;
+                    continue;
+                }
+                ranges.insert(ranges.end(), pieces.begin(), pieces.end());
+            }
+        }
+        overflows += overflow;
+
+        dr7 = 0;
+        for (size_t slot = 0; slot < ranges.size(); ++slot) {
+            auto [address, length] = ranges[slot];
+            // LEN encodes 1, 2, 8 and 4 bytes as 0 to 3, RW 01 breaks on data writes
+            uint64_t len = length == 1 ? 0 : length == 2 ? 1 : length == 8 ? 2 : 3;
+            addresses[slot] = address;
+            dr7 |= (1ull << (slot * 2)) | (0x1ull << (16 + slot * 4)) | (len << (18 + slot * 4));
+        }
+        // Registers of running threads cannot be written, they are stopped for it
+        bool others_stopped = threads.size() > 1;
+        if (others_stopped) {
+            threads.stop_others();
+        }
+        threads.for_each([&](pid_t tid) { load_debug_registers(tid); });
+        if (others_stopped) {
+            threads.resume_others();
+        }
+        dirty = false;
+    }
+
+    // Function to write the programmed debug registers into a stopped thread
+    void load_debug_registers(pid_t tid) {
+        poke_debug_register(tid, 7, 0);
+        for (int slot = 0; slot < debug_registers; ++slot) {
+            if ((dr7 >> (slot * 2)) & 1) {
+                poke_debug_register(tid, slot, addresses[slot]);
+            }
+        }
+        if (dr7 != 0) {
+            poke_debug_register(tid, 7, dr7);
+        }
+    }
+
+    pid_t pid = 0;
+    vector<Watch> watches;
+    vector<int64_t> values;
+    vector<bool> armed;
+    bool dirty = false;
+    // Times that program() found more armed pieces than registers
+    size_t overflows = 0;
+    uint64_t addresses[debug_registers] = {};
+    uint64_t dr7 = 0;
+    int pending_signal = 0;
+    // The threads run on from a next() that found no stop
+    bool running = false;
+    Threads threads;
+    Breakpoints breakpoints;
+    FunctionEvents events;
+};
+
+unique_ptr<Backend> make_dr_backend() {
+    return make_unique<DrBackend>();
+}
+
+#endif // __x86_64__
@@ -0,0 +1,201 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <ostream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/ptrace.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "backend.hpp"
+#include "rv_hooks.h"
+
+using namespace std;
+
+// Records of each thread ring, a power of two
+static const uint32_t ring_capacity = 1 << 14;
+
+// How long the consumer sleeps on empty rings, in milliseconds
+static const int idle_wait_ms = 1;
+
+// Source instrumentation backend for targets built with rv.h: at the exec stop the watch table
+// is written to /dev/shm/rv-<pid> and the target is released from ptrace. Its RV_STORE hooks
+// then push every store to a watched variable into the ring of the storing thread, and the
+// monitor pops them, ordered by time across threads. Every store is one position, as with the
+// ptrace backends, but nothing traps. Stores that do not go through a hook are not seen.
+class HooksBackend : public Backend {
+public:
+    const char* name() const override { return "hooks"; }
+
+    ~HooksBackend() override {
+        if (shared != nullptr) {
+            munmap(shared, size);
+        }
+        if (pidfd >= 0) {
+            close(pidfd);
+        }
+        if (!path.empty()) {
+            unlink(path.c_str());
+        }
+    }
+
+    void attach(pid_t pid, const vector<Watch>& watches) override {
+        if (watches.size() > RV_HOOKS_MAX_WATCHES) {
+            throw runtime_error("The hooks backend watches at most " + to_string(RV_HOOKS_MAX_WATCHES) + " variables");
+        }
+        this->pid = pid;
+        create_shared(watches);
+        values = read_values(pid, watches);
+        for (const Watch& watch : watches) {
+            variables.push_back(watch.variable);
+        }
+        armed.assign(watches.size(), true);
+
+        pidfd = syscall(SYS_pidfd_open, pid, 0);
+        if (pidfd < 0) {
+            throw runtime_error(string("pidfd_open failed: ") + strerror(errno));
+        }
+        if (ptrace(PTRACE_DETACH, pid, nullptr, nullptr) != 0) {
+            throw runtime_error(string("PTRACE_DETACH failed: ") + strerror(errno));
+        }
+    }
+
+    void arm(const vector<bool>& armed) override {
+        for (size_t i = 0; i < armed.size(); ++i) {
+            __atomic_store_n(&shared->watches[i].armed, armed[i] ? 1u : 0u, __ATOMIC_RELAXED);
+            // A disarmed variable is resynced by the caller, its old value is stale
+            if (armed[i] && !this->armed[i]) {
+                try_read_value(i);
+            }
+        }
+        this->armed = armed;
+    }
+
+    bool next(vector<Change>& changes) override {
+        for (;;) {
+            while (position < pending.size()) {
+                const rv_record& record = pending[position++];
+                if (record.id < variables.size() && armed[record.id] && record.value != values[record.id]) {
+                    values[record.id] = record.value;
+                    changes.push_back({variables[record.id], record.value});
+                    return true;
+                }
+            }
+            if (collect()) {
+                continue;
+            }
+            if (exited) {
+                if (wait_tracee(pid, &status, 0) < 0) {
+                    throw runtime_error(string("waitpid failed: ") + strerror(errno));
+                }
+                return false;
+            }
+            // The hooks push synchronously, so after the exit one more collect sees every store
+            pollfd fd = {pidfd, POLLIN, 0};
+            if (poll(&fd, 1, blocking ? idle_wait_ms : 0) > 0) {
+                exited = true;
+            } else if (!blocking) {
+                return true;
+            }
+        }
+    }
+
+    void detach() override {
+        __atomic_store_n(&shared->stop, 1u, __ATOMIC_RELAXED);
+    }
+
+    vector<int> wait_fds() const override {
+        return {pidfd};
+    }
+
+    int poll_interval_ms() const override {
+        return idle_wait_ms;
+    }
+
+    void print_stats(ostream& out) const override {
+        uint32_t threads = min(__atomic_load_n(&shared->thread_count, __ATOMIC_RELAXED), (uint32_t)RV_HOOKS_MAX_THREADS);
+        out << "hooks: " << records << " records from " << threads << " threads";
+        if (shared->overflow != 0) {
+            out << ", " << shared->overflow << " stores of threads without a ring";
+        }
+        out << endl;
+    }
+
+private:
+    void create_shared(const vector<Watch>& watches) {
+        path = "/dev/shm/rv-" + to_string(pid);
+        size = rv_hooks_bytes(ring_capacity);
+        int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+        if (fd < 0 || ftruncate(fd, size) != 0) {
+            int error = errno;
+            if (fd >= 0) {
+                close(fd);
+            }
+            throw runtime_error("Could not create " + path + ": " + strerror(error));
+        }
+        void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (p == MAP_FAILED) {
+            throw runtime_error("Could not map " + path + ": " + strerror(errno));
+        }
+        shared = static_cast<rv_hooks_shared*>(p);
+        shared->ring_capacity = ring_capacity;
+        for (uint32_t i = 0; i < RV_HOOKS_MAX_THREADS; ++i) {
+            rv_ring_init(rv_hooks_ring(shared, i), ring_capacity);
+        }
+        for (size_t i = 0; i < watches.size(); ++i) {
+            shared->watches[i] = {watches[i].address, watches[i].size, 1, 0};
+        }
+        shared->watch_count = watches.size();
+        __atomic_store_n(&shared->magic, RV_HOOKS_MAGIC, __ATOMIC_RELEASE);
+    }
+
+    // Function to move the records of every claimed ring into pending, oldest first
+    bool collect() {
+        pending.clear();
+        position = 0;
+        uint32_t threads = min(__atomic_load_n(&shared->thread_count, __ATOMIC_ACQUIRE), (uint32_t)RV_HOOKS_MAX_THREADS);
+        rv_record record;
+        for (uint32_t i = 0; i < threads; ++i) {
+            rv_ring* ring = rv_hooks_ring(shared, i);
+            while (rv_ring_pop(ring, &record)) {
+                pending.push_back(record);
+            }
+        }
+        records += pending.size();
+        // Each ring is in order already, the merge only interleaves the threads
+        if (threads > 1) {
+            stable_sort(pending.begin(), pending.end(),
+                        [](const rv_record& a, const rv_record& b) { return a.time_ns < b.time_ns; });
+        }
+        return !pending.empty();
+    }
+
+    void try_read_value(size_t i) {
+        Watch watch = {variables[i], "", shared->watches[i].address, shared->watches[i].size};
+        vector<int64_t> current;
+        if (try_read_values(pid, {watch}, current)) {
+            values[i] = current[0];
+        }
+    }
+
+    pid_t pid = 0;
+    int pidfd = -1;
+    string path;
+    size_t size = 0;
+    rv_hooks_shared* shared = nullptr;
+    vector<uint32_t> variables;
+    vector<int64_t> values;
+    vector<bool> armed;
+    vector<rv_record> pending;
+    size_t position = 0;
+    bool exited = false;
+    uint64_t records = 0;
+};
+
+unique_ptr<Backend> make_hooks_backend() {
+    return make_unique<HooksBackend>();
+}
@@ -0,0 +1,56 @@
+#if defined(__x86_64__)
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <signal.h>
+#include <sys/ptrace.h>
+#include <sys/user.h>
+#include <sys/wait.h>
+#include "backend.hpp"
+#include "inject.hpp"
+
+using namespace std;
+
+long inject_syscall(pid_t pid, long number, long arg1, long arg2, long arg3, long arg4, long arg5, long arg6) {
+    user_regs_struct saved;
+    if (ptrace(PTRACE_GETREGS, pid, nullptr, &saved) != 0) {
+        throw runtime_error(string("PTRACE_GETREGS failed: ") + strerror(errno));
+    }
+    errno = 0;
+    long code = ptrace(PTRACE_PEEKTEXT, pid, (void*)saved.rip, nullptr);
+    if (errno != 0) {
+        throw runtime_error(string("Could not read tracee code: ") + strerror(errno));
+    }
+
+    // syscall is 0f 05
+    long patched = (code & ~0xffffl) | 0x050f;
+    user_regs_struct regs = saved;
+    regs.rax = number;
+    regs.orig_rax = -1;
+    regs.rdi = arg1;
+    regs.rsi = arg2;
+    regs.rdx = arg3;
+    regs.r10 = arg4;
+    regs.r8 = arg5;
+    regs.r9 = arg6;
+    if (ptrace(PTRACE_POKETEXT, pid, (void*)saved.rip, (void*)patched) != 0 ||
+        ptrace(PTRACE_SETREGS, pid, nullptr, &regs) != 0) {
+        throw runtime_error(string("Could not prepare injected system call: ") + strerror(errno));
+    }
+
+    int status;
+    if (ptrace(PTRACE_SINGLESTEP, pid, nullptr, nullptr) != 0 || wait_tracee(pid, &status, 0) < 0 ||
+        !WIFSTOPPED(status) || WSTOPSIG(status) != SIGTRAP) {
+        throw runtime_error("Injected system call did not complete");
+    }
+    if (ptrace(PTRACE_GETREGS, pid, nullptr, &regs) != 0 ||
+        ptrace(PTRACE_POKETEXT, pid, (void*)saved.rip, (void*)code) != 0 ||
+        ptrace(PTRACE_SETREGS, pid, nullptr, &saved) != 0) {
+        throw runtime_error(string("Could not restore tracee after system call: ") + strerror(errno));
+    }
+    return regs.rax;
+}
+
+#endif // __x86_64__
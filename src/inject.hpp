@@ -0,0 +1,16 @@
+#ifndef RV_INJECT_HPP
+#define RV_INJECT_HPP
+
+#include <sys/types.h>
+
+#if defined(__x86_64__)
+
+// Function to make a stopped tracee run one system call and return its result (a negative
+// errno on failure). A syscall instruction is written over the one at the instruction pointer
+// and single-stepped; the code and registers are restored afterwards.
+long inject_syscall(pid_t pid, long number, long arg1 = 0, long arg2 = 0, long arg3 = 0,
+                    long arg4 = 0, long arg5 = 0, long arg6 = 0);
+
+#endif // __x86_64__
+
+#endif // RV_INJECT_HPP
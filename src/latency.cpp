@@ -0,0 +1,232 @@
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <signal.h>
+#include "backend.hpp"
+#include "latency.hpp"
+#include "pipeline.hpp"
+
+using namespace std;
+
+bool latency_enabled = false;
+
+// Clock and monotonic clock when latencies started to be recorded, which give the ticks per
+// nanosecond when they are printed
+static uint64_t enabled_ticks;
+static chrono::steady_clock::time_point enabled_time;
+
+typedef array<LatencyHistogram, stage_count> StageHistograms;
+
+// The histograms of every thread that recorded a latency, kept after it ends
+static mutex& registry_lock() {
+    static mutex lock;
+    return lock;
+}
+
+static vector<unique_ptr<StageHistograms>>& registry() {
+    static vector<unique_ptr<StageHistograms>> histograms;
+    return histograms;
+}
+
+static thread dumper;
+static atomic<bool> dumper_stopping{false};
+static string dump_json_path;
+
+const char* stage_name(Stage stage) {
+    switch (stage) {
+    case Stage::Capture:
+        return "capture";
+    case Stage::Decode:
+        return "decode";
+    case Stage::Queue:
+        return "queue";
+    case Stage::Evaluate:
+        return "evaluate";
+    case Stage::Step:
+        return "step";
+    }
+    return "unknown";
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other) {
+    for (size_t i = 0; i < bucket_count; ++i) {
+        buckets[i].store(bucket(i) + other.bucket(i), memory_order_relaxed);
+    }
+    total.store(sum() + other.sum(), memory_order_relaxed);
+    largest.store(std::max(max(), other.max()), memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::count() const {
+    uint64_t count = 0;
+    for (size_t i = 0; i < bucket_count; ++i) {
+        count += bucket(i);
+    }
+    return count;
+}
+
+uint64_t LatencyHistogram::percentile(double quantile) const {
+    uint64_t rank = std::max<uint64_t>(1, (uint64_t)ceil(quantile * count()));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < bucket_count; ++i) {
+        seen += bucket(i);
+        if (seen >= rank) {
+            return std::min(highest(i), max());
+        }
+    }
+    return max();
+}
+
+uint64_t LatencyHistogram::lowest(size_t index) {
+    if (index < (1u << sub_bits)) {
+        return index;
+    }
+    unsigned shift = index / (1u << (sub_bits - 1)) - 1;
+    return (uint64_t)(index % (1u << (sub_bits - 1)) + (1u << (sub_bits - 1))) << shift;
+}
+
+uint64_t LatencyHistogram::highest(size_t index) {
+    if (index < (1u << sub_bits)) {
+        return index;
+    }
+    unsigned shift = index / (1u << (sub_bits - 1)) - 1;
+    return lowest(index) + ((1ull << shift) - 1);
+}
+
+void enable_latency() {
+    latency_enabled = true;
+    enabled_ticks = latency_clock();
+    enabled_time = chrono::steady_clock::now();
+}
+
+// Function to get the clock ticks per nanosecond. The time stamp counter runs at a constant rate
+// on the processors this runs on, measured against the monotonic clock over the whole run.
+static double ticks_per_ns() {
+#if defined(__x86_64__)
+    uint64_t ticks = latency_clock() - enabled_ticks;
+    int64_t ns = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - enabled_time).count();
+    return ns > 0 ? ticks / (double)ns : 1;
+#else
+    return 1;
+#endif
+}
+
+void record_latency(Stage stage, uint64_t start) {
+    if (start == 0) {
+        return;
+    }
+    uint64_t ticks = latency_clock() - start;
+    thread_local StageHistograms* histograms = nullptr;
+    if (!histograms) {
+        lock_guard<mutex> guard(registry_lock());
+        registry().push_back(make_unique<StageHistograms>());
+        histograms = registry().back().get();
+    }
+    (*histograms)[(size_t)stage].add(ticks);
+}
+
+// Function to merge the histograms of all threads
+static unique_ptr<StageHistograms> merged() {
+    auto all = make_unique<StageHistograms>();
+    lock_guard<mutex> guard(registry_lock());
+    for (const unique_ptr<StageHistograms>& histograms : registry()) {
+        for (size_t stage = 0; stage < stage_count; ++stage) {
+            (*all)[stage].merge((*histograms)[stage]);
+        }
+    }
+    return all;
+}
+
+void print_latency(ostream& out) {
+    unique_ptr<StageHistograms> all = merged();
+    double rate = ticks_per_ns();
+    auto to_ns = [rate](double ticks) { return (uint64_t)llround(ticks / rate); };
+    out << "latency (ns)      count       mean        p50        p99       p999        max" << endl;
+    for (size_t stage = 0; stage < stage_count; ++stage) {
+        const LatencyHistogram& histogram = (*all)[stage];
+        uint64_t count = histogram.count();
+        if (count == 0) {
+            continue;
+        }
+        out << "  " << left << setw(9) << stage_name((Stage)stage) << right << setw(12) << count << setw(11)
+            << to_ns((double)histogram.sum() / count) << setw(11) << to_ns(histogram.percentile(0.5)) << setw(11)
+            << to_ns(histogram.percentile(0.99)) << setw(11) << to_ns(histogram.percentile(0.999)) << setw(11)
+            << to_ns(histogram.max()) << endl;
+    }
+}
+
+void write_latency_json(ostream& out) {
+    unique_ptr<StageHistograms> all = merged();
+    double rate = ticks_per_ns();
+    auto to_ns = [rate](double ticks) { return (uint64_t)llround(ticks / rate); };
+    out << "{\"ticks_per_ns\": " << rate << ", \"stages\": {";
+    const char* separator = "";
+    for (size_t stage = 0; stage < stage_count; ++stage) {
+        const LatencyHistogram& histogram = (*all)[stage];
+        uint64_t count = histogram.count();
+        out << separator << "\n  \"" << stage_name((Stage)stage) << "\": {\"count\": " << count
+            << ", \"total_ns\": " << to_ns(histogram.sum())
+            << ", \"mean_ns\": " << (count ? to_ns((double)histogram.sum() / count) : 0)
+            << ", \"p50_ns\": " << to_ns(histogram.percentile(0.5))
+            << ", \"p99_ns\": " << to_ns(histogram.percentile(0.99))
+            << ", \"p999_ns\": " << to_ns(histogram.percentile(0.999)) << ", \"max_ns\": " << to_ns(histogram.max())
+            << ", \"buckets\": [";
+        // Each bucket as its lowest and highest value and its count
+        const char* comma = "";
+        for (size_t i = 0; i < LatencyHistogram::bucket_count; ++i) {
+            if (histogram.bucket(i) != 0) {
+                out << comma << "[" << to_ns(LatencyHistogram::lowest(i)) << ", "
+                    << to_ns(LatencyHistogram::highest(i)) << ", " << histogram.bucket(i) << "]";
+                comma = ", ";
+            }
+        }
+        out << "]}";
+        separator = ",";
+    }
+    out << "\n}}" << endl;
+}
+
+// Function to print the histograms and write them to the JSON file, if any
+static void dump_latency() {
+    {
+        lock_guard<mutex> guard(output_lock());
+        print_latency(cout);
+    }
+    if (!dump_json_path.empty()) {
+        ofstream json(dump_json_path, ios::trunc);
+        write_latency_json(json);
+        if (!json) {
+            cerr << "Error: Could not write " << dump_json_path << endl;
+        }
+    }
+}
+
+void dump_latency_on_signal(const string& json_path) {
+    dump_json_path = json_path;
+    sigset_t usr1;
+    sigemptyset(&usr1);
+    sigaddset(&usr1, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &usr1, nullptr);
+    dumper = thread([usr1] {
+        // SIGUSR1 is taken by sigwait, blocked as it must be
+        block_tracer_signals();
+        int signal;
+        while (sigwait(&usr1, &signal) == 0 && !dumper_stopping.load()) {
+            dump_latency();
+        }
+    });
+}
+
+void stop_latency_dump() {
+    if (dumper.joinable()) {
+        dumper_stopping.store(true);
+        pthread_kill(dumper.native_handle(), SIGUSR1);
+        dumper.join();
+    }
+    dump_latency();
+}
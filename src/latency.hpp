@@ -0,0 +1,123 @@
+#ifndef RV_LATENCY_HPP
+#define RV_LATENCY_HPP
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#else
+#include <ctime>
+#endif
+
+// Stages an event goes through, from the backend reporting it to the monitor stepping on it
+enum class Stage : uint32_t {
+    // The backend's next(), up to the changes of a position; it includes the time the process
+    // runs until it makes them
+    Capture,
+    // The changes applied to the known values, recorded, and the unarmed watches read back
+    Decode,
+    // A change waiting in the queue of a pipeline worker
+    Queue,
+    // A change applied to a monitor, with the predicates over its variable evaluated again
+    Evaluate,
+    // A step of a monitor's automaton
+    Step,
+};
+
+constexpr size_t stage_count = 5;
+
+const char* stage_name(Stage stage);
+
+// Histogram of latencies in clock ticks, in the manner of HdrHistogram: values below 64 have a
+// bucket each, and every power of two above is cut in 32 buckets, so a value is known within
+// about 3% at any magnitude with a fixed 15 KB of buckets. It has a single writer; readers see
+// counts as they are, possibly mid-update.
+class LatencyHistogram {
+public:
+    static constexpr unsigned sub_bits = 6;
+    static constexpr size_t bucket_count = (64 - sub_bits + 2) << (sub_bits - 1);
+
+    // Function to add a value
+    void add(uint64_t ticks) {
+        size_t index = bucket_of(ticks);
+        buckets[index].store(buckets[index].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        total.store(total.load(std::memory_order_relaxed) + ticks, std::memory_order_relaxed);
+        if (ticks > largest.load(std::memory_order_relaxed)) {
+            largest.store(ticks, std::memory_order_relaxed);
+        }
+    }
+
+    // Function to add the values of another histogram
+    void merge(const LatencyHistogram& other);
+
+    uint64_t count() const;
+    uint64_t sum() const { return total.load(std::memory_order_relaxed); }
+    uint64_t max() const { return largest.load(std::memory_order_relaxed); }
+    uint64_t bucket(size_t index) const { return buckets[index].load(std::memory_order_relaxed); }
+
+    // Function to get the value below which a fraction quantile of the values lie, as the
+    // highest value of its bucket
+    uint64_t percentile(double quantile) const;
+
+    // Function to get the index of the bucket of a value, and the lowest and highest values of
+    // a bucket
+    static size_t bucket_of(uint64_t value) {
+        if (value < (1ull << sub_bits)) {
+            return value;
+        }
+        unsigned shift = 63 - __builtin_clzll(value) - (sub_bits - 1);
+        return ((size_t)shift << (sub_bits - 1)) + (value >> shift);
+    }
+    static uint64_t lowest(size_t index);
+    static uint64_t highest(size_t index);
+
+private:
+    std::array<std::atomic<uint64_t>, bucket_count> buckets{};
+    std::atomic<uint64_t> total{0};
+    std::atomic<uint64_t> largest{0};
+};
+
+// Set once, before monitoring starts, by enable_latency()
+extern bool latency_enabled;
+
+// Function to start recording latencies, after calibrating the clock against the wall clock
+void enable_latency();
+
+// Function to read the clock, 0 unless latencies are recorded. It is the time stamp counter on
+// x86-64, and the monotonic clock in nanoseconds elsewhere.
+inline uint64_t latency_clock() {
+    if (!latency_enabled) {
+        return 0;
+    }
+#if defined(__x86_64__)
+    return __rdtsc();
+#else
+    timespec clock;
+    clock_gettime(CLOCK_MONOTONIC, &clock);
+    return (uint64_t)clock.tv_sec * 1000000000 + clock.tv_nsec;
+#endif
+}
+
+// Function to add the time since start, a value of latency_clock(), to the histogram of stage
+// of the calling thread; nothing if start is 0
+void record_latency(Stage stage, uint64_t start);
+
+// Function to print the histograms of all threads merged, with counts, means and percentiles
+// in nanoseconds
+void print_latency(std::ostream& out);
+
+// Function to write the same as JSON, with the buckets that are not empty
+void write_latency_json(std::ostream& out);
+
+// Function to start a thread that prints the histograms, and writes them as JSON to json_path
+// unless it is empty, each time the process gets SIGUSR1. It blocks SIGUSR1 in the calling
+// thread, so threads started after it leave the signal to it.
+void dump_latency_on_signal(const std::string& json_path);
+
+// Function to stop that thread, if started, and dump the histograms a last time
+void stop_latency_dump();
+
+#endif // RV_LATENCY_HPP
@@ -0,0 +1,435 @@
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <map>
+#include <stdexcept>
+#include <utility>
+#include "ltl.hpp"
+
+using namespace std;
+
+static size_t combine(size_t seed, size_t value) {
+    return seed ^ (value + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2));
+}
+
+size_t Formula::NodeHash::operator()(const Node& n) const {
+    return combine(combine((size_t)n.kind, n.left), n.right);
+}
+
+size_t Formula::PredicateHash::operator()(const Predicate& p) const {
+    size_t h = combine(p.lhs.kind, (size_t)p.lhs.value);
+    h = combine(h, (size_t)p.op);
+    return combine(combine(h, p.rhs.kind), (size_t)p.rhs.value);
+}
+
+uint32_t Formula::make(NodeKind kind, uint32_t left, uint32_t right) {
+    auto is = [&](uint32_t id, NodeKind k) { return id != none && nodes[id].kind == k; };
+    auto constant = [&](bool value) { return make(value ? NodeKind::True : NodeKind::False); };
+
+    switch (kind) {
+    case NodeKind::Not:
+        if (is(left, NodeKind::True) || is(left, NodeKind::False)) {
+            return constant(is(left, NodeKind::False));
+        }
+        if (is(left, NodeKind::Not)) {
+            return nodes[left].left;
+        }
+        break;
+    case NodeKind::And:
+    case NodeKind::Or: {
+        bool absorbing = kind == NodeKind::Or;
+        NodeKind absorbing_kind = absorbing ? NodeKind::True : NodeKind::False;
+        NodeKind neutral_kind = absorbing ? NodeKind::False : NodeKind::True;
+        if (is(left, absorbing_kind) || is(right, absorbing_kind)) {
+            return constant(absorbing);
+        }
+        if (is(left, neutral_kind) || left == right) {
+            return right;
+        }
+        if (is(right, neutral_kind)) {
+            return left;
+        }
+        if (left > right) {
+            swap(left, right);
+        }
+        break;
+    }
+    case NodeKind::Implies:
+        if (is(left, NodeKind::True)) {
+            return right;
+        }
+        if (is(left, NodeKind::False) || is(right, NodeKind::True) || left == right) {
+            return constant(true);
+        }
+        break;
+    case NodeKind::Equiv:
+        if (left == right) {
+            return constant(true);
+        }
+        if (left > right) {
+            swap(left, right);
+        }
+        break;
+    case NodeKind::Next:
+    case NodeKind::Always:
+    case NodeKind::Eventually:
+        if (is(left, NodeKind::True) || is(left, NodeKind::False) ||
+            (kind != NodeKind::Next && is(left, kind))) {
+            return left;
+        }
+        break;
+    case NodeKind::Until:
+        // x U true = true, x U false = false, false U x = x
+        if (is(right, NodeKind::True) || is(right, NodeKind::False) || is(left, NodeKind::False)) {
+            return right;
+        }
+        break;
+    case NodeKind::Release:
+        // x V true = true, x V false = false, true V x = x
+        if (is(right, NodeKind::True) || is(right, NodeKind::False) || is(left, NodeKind::True)) {
+            return right;
+        }
+        break;
+    default:
+        break;
+    }
+
+    Node n = {kind, left, right};
+    auto it = node_ids.find(n);
+    if (it != node_ids.end()) {
+        return it->second;
+    }
+    uint32_t id = nodes.size();
+    nodes.push_back(n);
+    node_ids.emplace(n, id);
+    return id;
+}
+
+uint32_t Formula::make_predicate(Term lhs, RelOp op, Term rhs) {
+    if (lhs.kind == Term::Constant && rhs.kind == Term::Constant) {
+        bool value = false;
+        switch (op) {
+        case RelOp::Eq: value = lhs.value == rhs.value; break;
+        case RelOp::Ne: value = lhs.value != rhs.value; break;
+        case RelOp::Lt: value = lhs.value < rhs.value; break;
+        case RelOp::Le: value = lhs.value <= rhs.value; break;
+        case RelOp::Gt: value = lhs.value > rhs.value; break;
+        case RelOp::Ge: value = lhs.value >= rhs.value; break;
+        }
+        return make(value ? NodeKind::True : NodeKind::False);
+    }
+
+    // Keep constants on the right, so `1 == a` and `a == 1` are the same predicate
+    if (lhs.kind == Term::Constant) {
+        swap(lhs, rhs);
+        switch (op) {
+        case RelOp::Lt: op = RelOp::Gt; break;
+        case RelOp::Le: op = RelOp::Ge; break;
+        case RelOp::Gt: op = RelOp::Lt; break;
+        case RelOp::Ge: op = RelOp::Le; break;
+        default: break;
+        }
+    }
+
+    Predicate p = {lhs, op, rhs};
+    auto it = predicate_ids.find(p);
+    uint32_t id;
+    if (it != predicate_ids.end()) {
+        id = it->second;
+    } else {
+        id = predicate_list.size();
+        predicate_list.push_back(p);
+        predicate_ids.emplace(p, id);
+    }
+    return make(NodeKind::Predicate, id);
+}
+
+uint32_t Formula::variable(const string& symbol, VariableKind kind) {
+    static const char* const prefixes[] = {"", "call(", "ret(", "calls(", "returns("};
+    string name = kind == VariableKind::Value ? symbol : prefixes[(int)kind] + symbol + ")";
+    auto it = variable_ids.find(name);
+    if (it != variable_ids.end()) {
+        return it->second;
+    }
+    uint32_t id = variable_names.size();
+    variable_names.push_back(name);
+    kinds.push_back(kind);
+    variable_symbols.push_back(symbol);
+    variable_ids.emplace(name, id);
+    return id;
+}
+
+static const char* op_text(RelOp op) {
+    switch (op) {
+    case RelOp::Eq: return "==";
+    case RelOp::Ne: return "!=";
+    case RelOp::Lt: return "<";
+    case RelOp::Le: return "<=";
+    case RelOp::Gt: return ">";
+    case RelOp::Ge: return ">=";
+    }
+    return "?";
+}
+
+string Formula::to_string(uint32_t id) const {
+    const Node& n = nodes[id];
+    auto term = [&](const Term& t) {
+        return t.kind == Term::Variable ? variable_names[t.value] : std::to_string(t.value);
+    };
+    auto unary = [&](const char* op) { return op + string("(") + to_string(n.left) + ")"; };
+    auto binary = [&](const char* op) { return "(" + to_string(n.left) + " " + op + " " + to_string(n.right) + ")"; };
+
+    switch (n.kind) {
+    case NodeKind::True: return "true";
+    case NodeKind::False: return "false";
+    case NodeKind::Predicate: {
+        const Predicate& p = predicate_list[n.left];
+        return term(p.lhs) + " " + op_text(p.op) + " " + term(p.rhs);
+    }
+    case NodeKind::Not: return unary("!");
+    case NodeKind::And: return binary("&&");
+    case NodeKind::Or: return binary("||");
+    case NodeKind::Implies: return binary("->");
+    case NodeKind::Equiv: return binary("<->");
+    case NodeKind::Next: return unary("X ");
+    case NodeKind::Always: return unary("[]");
+    case NodeKind::Eventually: return unary("<>");
+    case NodeKind::Until: return binary("U");
+    case NodeKind::Release: return binary("V");
+    }
+    return "?";
+}
+
+// Recursive descent parser, one function per precedence level
+class LtlParser {
+public:
+    explicit LtlParser(const string& text) : text(text) {}
+
+    Formula parse() {
+        next();
+        uint32_t root = parse_equiv();
+        if (token != Token::End) {
+            fail("unexpected '" + token_text + "'");
+        }
+        formula.set_root(root);
+        return move(formula);
+    }
+
+private:
+    enum class Token {
+        End, Ident, Number, LParen, RParen, Not, And, Or, Implies, Equiv,
+        Always, Eventually, Next, Until, Release, True, False, Rel,
+    };
+
+    [[noreturn]] void fail(const string& message) const {
+        throw invalid_argument("LTL parse error at column " + to_string(token_pos + 1) + ": " + message);
+    }
+
+    // Function to read the next token into token/token_text/token_pos
+    void next() {
+        while (pos < text.size() && isspace((unsigned char)text[pos])) {
+            ++pos;
+        }
+        token_pos = pos;
+        if (pos == text.size()) {
+            token = Token::End;
+            token_text = "end of formula";
+            return;
+        }
+
+        auto starts = [&](const char* s) { return text.compare(pos, char_traits<char>::length(s), s) == 0; };
+        auto symbol = [&](Token t, const char* s) {
+            token = t;
+            token_text = s;
+            pos += token_text.size();
+        };
+        auto relation = [&](RelOp op, const char* s) {
+            rel = op;
+            symbol(Token::Rel, s);
+        };
+
+        char c = text[pos];
+        if (isalpha((unsigned char)c) || c == '_') {
+            size_t end = pos;
+            while (end < text.size() && (isalnum((unsigned char)text[end]) || text[end] == '_')) {
+                ++end;
+            }
+            token_text = text.substr(pos, end - pos);
+            pos = end;
+            if (token_text == "true") token = Token::True;
+            else if (token_text == "false") token = Token::False;
+            else if (token_text == "U") token = Token::Until;
+            else if (token_text == "V") token = Token::Release;
+            else if (token_text == "X") token = Token::Next;
+            else token = Token::Ident;
+        } else if (isdigit((unsigned char)c) || (c == '-' && pos + 1 < text.size() && isdigit((unsigned char)text[pos + 1]))) {
+            size_t digits = c == '-' ? pos + 1 : pos;
+            bool is_hex = text.compare(digits, 2, "0x") == 0 || text.compare(digits, 2, "0X") == 0;
+            const char* start = text.c_str() + pos;
+            char* end;
+            errno = 0;
+            number = strtoll(start, &end, is_hex ? 16 : 10);
+            if (errno == ERANGE) {
+                fail("constant out of range");
+            }
+            token = Token::Number;
+            token_text.assign(start, end - start);
+            pos += end - start;
+        } else if (starts("<->")) symbol(Token::Equiv, "<->");
+        else if (starts("->")) symbol(Token::Implies, "->");
+        else if (starts("&&")) symbol(Token::And, "&&");
+        else if (starts("||")) symbol(Token::Or, "||");
+        else if (starts("[]")) symbol(Token::Always, "[]");
+        else if (starts("<>")) symbol(Token::Eventually, "<>");
+        else if (starts("==")) relation(RelOp::Eq, "==");
+        else if (starts("!=")) relation(RelOp::Ne, "!=");
+        else if (starts("<=")) relation(RelOp::Le, "<=");
+        else if (starts(">=")) relation(RelOp::Ge, ">=");
+        else if (c == '<') relation(RelOp::Lt, "<");
+        else if (c == '>') relation(RelOp::Gt, ">");
+        else if (c == '!') symbol(Token::Not, "!");
+        else if (c == '(') symbol(Token::LParen, "(");
+        else if (c == ')') symbol(Token::RParen, ")");
+        else {
+            fail(string("unexpected character '") + c + "'");
+        }
+    }
+
+    uint32_t parse_equiv() {
+        uint32_t left = parse_implies();
+        while (token == Token::Equiv) {
+            next();
+            left = formula.make(NodeKind::Equiv, left, parse_implies());
+        }
+        return left;
+    }
+
+    uint32_t parse_implies() {
+        uint32_t left = parse_or();
+        if (token == Token::Implies) {
+            next();
+            return formula.make(NodeKind::Implies, left, parse_implies());
+        }
+        return left;
+    }
+
+    uint32_t parse_or() {
+        uint32_t left = parse_and();
+        while (token == Token::Or) {
+            next();
+            left = formula.make(NodeKind::Or, left, parse_and());
+        }
+        return left;
+    }
+
+    uint32_t parse_and() {
+        uint32_t left = parse_until();
+        while (token == Token::And) {
+            next();
+            left = formula.make(NodeKind::And, left, parse_until());
+        }
+        return left;
+    }
+
+    uint32_t parse_until() {
+        uint32_t left = parse_unary();
+        if (token == Token::Until || token == Token::Release) {
+            NodeKind kind = token == Token::Until ? NodeKind::Until : NodeKind::Release;
+            next();
+            return formula.make(kind, left, parse_until());
+        }
+        return left;
+    }
+
+    uint32_t parse_unary() {
+        NodeKind kind;
+        switch (token) {
+        case Token::Not: kind = NodeKind::Not; break;
+        case Token::Always: kind = NodeKind::Always; break;
+        case Token::Eventually: kind = NodeKind::Eventually; break;
+        case Token::Next: kind = NodeKind::Next; break;
+        default: return parse_primary();
+        }
+        next();
+        return formula.make(kind, parse_unary());
+    }
+
+    uint32_t parse_primary() {
+        switch (token) {
+        case Token::True:
+            next();
+            return formula.make(NodeKind::True);
+        case Token::False:
+            next();
+            return formula.make(NodeKind::False);
+        case Token::LParen: {
+            next();
+            uint32_t inner = parse_equiv();
+            if (token != Token::RParen) {
+                fail("expected ')' but found '" + token_text + "'");
+            }
+            next();
+            return inner;
+        }
+        case Token::Ident:
+        case Token::Number: {
+            Term lhs = parse_term();
+            if (token != Token::Rel) {
+                if (lhs.kind == Term::Constant) {
+                    fail("expected a relational operator after a constant");
+                }
+                return formula.make_predicate(lhs, RelOp::Ne, {Term::Constant, 0});
+            }
+            RelOp op = rel;
+            next();
+            if (token != Token::Ident && token != Token::Number) {
+                fail("expected a variable or constant but found '" + token_text + "'");
+            }
+            return formula.make_predicate(lhs, op, parse_term());
+        }
+        default:
+            fail("expected a formula but found '" + token_text + "'");
+        }
+    }
+
+    Term parse_term() {
+        if (token == Token::Number) {
+            Term t = {Term::Constant, number};
+            next();
+            return t;
+        }
+        string name = token_text;
+        next();
+        static const map<string, VariableKind> functions = {
+            {"call", VariableKind::Call}, {"ret", VariableKind::Return},
+            {"calls", VariableKind::CallCount}, {"returns", VariableKind::ReturnCount}};
+        auto function_kind = functions.find(name);
+        if (function_kind != functions.end() && token == Token::LParen) {
+            next();
+            if (token != Token::Ident) {
+                fail("expected a function name but found '" + token_text + "'");
+            }
+            string function = token_text;
+            next();
+            if (token != Token::RParen) {
+                fail("expected ')' but found '" + token_text + "'");
+            }
+            next();
+            return {Term::Variable, (int64_t)formula.variable(function, function_kind->second)};
+        }
+        return {Term::Variable, (int64_t)formula.variable(name)};
+    }
+
+    const string& text;
+    size_t pos = 0;
+    Token token = Token::End;
+    string token_text;
+    size_t token_pos = 0;
+    int64_t number = 0;
+    RelOp rel = RelOp::Eq;
+    Formula formula;
+};
+
+Formula parse_ltl(const string& text) {
+    return LtlParser(text).parse();
+}
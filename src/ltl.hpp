@@ -0,0 +1,129 @@
+#ifndef RV_LTL_HPP
+#define RV_LTL_HPP
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Kinds of formula nodes. Predicate nodes are leaves, Not/Next/Always/Eventually have one child
+// and the remaining operators two.
+enum class NodeKind : uint8_t {
+    True,
+    False,
+    Predicate,
+    Not,
+    And,
+    Or,
+    Implies,
+    Equiv,
+    Next,
+    Always,
+    Eventually,
+    Until,
+    Release,
+};
+
+// Relational operators of predicates
+enum class RelOp : uint8_t { Eq, Ne, Lt, Le, Gt, Ge };
+
+// Kinds of program variables: a value in memory, an event of a function, which is 1 at the
+// positions where the function is entered (call(f)) or returns (ret(f)) and 0 elsewhere, or the
+// number of times it was entered (calls(f)) or returned (returns(f)) so far
+enum class VariableKind : uint8_t { Value, Call, Return, CallCount, ReturnCount };
+
+// A term of a predicate: a program variable (value is its variable id) or an integer constant
+struct Term {
+    enum Kind : uint8_t { Variable, Constant } kind;
+    int64_t value;
+
+    bool operator==(const Term& other) const { return kind == other.kind && value == other.value; }
+};
+
+// An atomic proposition comparing two terms. A bare variable `b` stands for `b != 0`.
+struct Predicate {
+    Term lhs;
+    RelOp op;
+    Term rhs;
+
+    bool operator==(const Predicate& other) const {
+        return lhs == other.lhs && op == other.op && rhs == other.rhs;
+    }
+};
+
+// A node of the formula DAG. For Predicate nodes left is the predicate id; unused children are
+// Formula::none.
+struct Node {
+    NodeKind kind;
+    uint32_t left;
+    uint32_t right;
+
+    bool operator==(const Node& other) const {
+        return kind == other.kind && left == other.left && right == other.right;
+    }
+};
+
+// An LTL formula over predicates, stored as a hash-consed DAG: structurally identical
+// subformulas are built once, so every distinct subformula has exactly one dense node id.
+// Variables and predicates are interned the same way and have dense ids of their own.
+class Formula {
+public:
+    static constexpr uint32_t none = UINT32_MAX;
+
+    // Function to get the node id of an operator applied to its children, creating it if new.
+    // Constant operands are folded and the operands of && and || are ordered, so that
+    // `a && b` and `b && a` share a node.
+    uint32_t make(NodeKind kind, uint32_t left = none, uint32_t right = none);
+
+    // Function to get the node id of the predicate `lhs op rhs`, creating it if new
+    uint32_t make_predicate(Term lhs, RelOp op, Term rhs);
+
+    // Function to get the id of a program variable, creating it if new. Function variables are
+    // named call(symbol), ret(symbol), calls(symbol) and returns(symbol).
+    uint32_t variable(const std::string& symbol, VariableKind kind = VariableKind::Value);
+
+    uint32_t root() const { return root_id; }
+    void set_root(uint32_t id) { root_id = id; }
+
+    const Node& node(uint32_t id) const { return nodes[id]; }
+    size_t size() const { return nodes.size(); }
+
+    const std::vector<std::string>& variables() const { return variable_names; }
+    const std::vector<VariableKind>& variable_kinds() const { return kinds; }
+    // Symbol of each variable: the variable itself, or the function of an event
+    const std::vector<std::string>& symbols() const { return variable_symbols; }
+    const std::vector<Predicate>& predicates() const { return predicate_list; }
+
+    // Function to print a subformula with explicit parentheses
+    std::string to_string(uint32_t id) const;
+    std::string to_string() const { return to_string(root_id); }
+
+private:
+    struct NodeHash {
+        size_t operator()(const Node& n) const;
+    };
+    struct PredicateHash {
+        size_t operator()(const Predicate& p) const;
+    };
+
+    std::vector<Node> nodes;
+    std::unordered_map<Node, uint32_t, NodeHash> node_ids;
+    std::vector<Predicate> predicate_list;
+    std::unordered_map<Predicate, uint32_t, PredicateHash> predicate_ids;
+    std::vector<std::string> variable_names;
+    std::vector<VariableKind> kinds;
+    std::vector<std::string> variable_symbols;
+    std::unordered_map<std::string, uint32_t> variable_ids;
+    uint32_t root_id = none;
+};
+
+// Function to parse an LTL formula. Operators, loosest binding first:
+//   <->, -> (right associative), ||, &&, U and V (right associative),
+//   unary !, [] (always), <> (eventually) and X (next).
+// Atoms are true, false, `term relop term` with relop one of == != < <= > >=, and a bare
+// variable. Terms are C identifiers, the events call(f) and ret(f) of a function f, its counts
+// calls(f) and returns(f), or integer constants.
+// Throws invalid_argument with the column of the first error.
+Formula parse_ltl(const std::string& text);
+
+#endif // RV_LTL_HPP
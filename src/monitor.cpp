@@ -0,0 +1,624 @@
+#include <algorithm>
+#include <map>
+#include <set>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include "monitor.hpp"
+
+using namespace std;
+
+// Largest transition table compile() builds before giving up
+static const size_t max_table_entries = (size_t)1 << 26;
+
+const char* verdict_name(Verdict verdict) {
+    switch (verdict) {
+    case Verdict::True: return "true";
+    case Verdict::False: return "false";
+    default: return "inconclusive";
+    }
+}
+
+// Function to rewrite a subformula (or its negation) into negation normal form, where ! only
+// applies to predicates and the only temporal operators are X, U and V
+static uint32_t to_nnf(Formula& f, uint32_t id, bool negate, unordered_map<uint64_t, uint32_t>& memo) {
+    uint64_t key = (uint64_t)id << 1 | negate;
+    if (auto it = memo.find(key); it != memo.end()) {
+        return it->second;
+    }
+
+    Node n = f.node(id);
+    auto sub = [&](uint32_t child, bool neg) { return to_nnf(f, child, neg, memo); };
+    uint32_t result;
+    switch (n.kind) {
+    case NodeKind::True:
+    case NodeKind::False:
+        result = f.make((n.kind == NodeKind::True) != negate ? NodeKind::True : NodeKind::False);
+        break;
+    case NodeKind::Predicate:
+        result = negate ? f.make(NodeKind::Not, id) : id;
+        break;
+    case NodeKind::Not:
+        result = sub(n.left, !negate);
+        break;
+    case NodeKind::And:
+    case NodeKind::Or: {
+        bool conjunction = (n.kind == NodeKind::And) != negate;
+        result = f.make(conjunction ? NodeKind::And : NodeKind::Or, sub(n.left, negate), sub(n.right, negate));
+        break;
+    }
+    case NodeKind::Implies:
+        // a -> b is !a || b, its negation a && !b
+        result = f.make(negate ? NodeKind::And : NodeKind::Or, sub(n.left, !negate), sub(n.right, negate));
+        break;
+    case NodeKind::Equiv: {
+        uint32_t both = f.make(NodeKind::And, sub(n.left, false), sub(n.right, negate));
+        uint32_t neither = f.make(NodeKind::And, sub(n.left, true), sub(n.right, !negate));
+        result = f.make(NodeKind::Or, both, neither);
+        break;
+    }
+    case NodeKind::Next:
+        result = f.make(NodeKind::Next, sub(n.left, negate));
+        break;
+    case NodeKind::Always:
+    case NodeKind::Eventually: {
+        // [] a is false V a and <> a is true U a
+        bool always = (n.kind == NodeKind::Always) != negate;
+        result = always ? f.make(NodeKind::Release, f.make(NodeKind::False), sub(n.left, negate))
+                        : f.make(NodeKind::Until, f.make(NodeKind::True), sub(n.left, negate));
+        break;
+    }
+    case NodeKind::Until:
+    case NodeKind::Release: {
+        bool until = (n.kind == NodeKind::Until) != negate;
+        result = f.make(until ? NodeKind::Until : NodeKind::Release, sub(n.left, negate), sub(n.right, negate));
+        break;
+    }
+    default:
+        throw logic_error("unknown formula node");
+    }
+    memo.emplace(key, result);
+    return result;
+}
+
+// A generalized Büchi automaton with its labels on the states: a run entering a state reads a
+// letter with all pos bits set and all neg bits clear. A state is live if an accepting run
+// starts from it. The last state is the initial pseudo-state, which reads nothing.
+struct Gba {
+    struct State {
+        uint32_t pos = 0;
+        uint32_t neg = 0;
+        vector<uint32_t> successors;
+    };
+    vector<State> states;
+    vector<bool> live;
+
+    uint32_t start() const { return states.size() - 1; }
+};
+
+// Node of the tableau construction of Gerth, Peled, Vardi and Wolper
+struct TableauNode {
+    vector<uint32_t> incoming;
+    vector<uint32_t> fresh;
+    set<uint32_t> old;
+    set<uint32_t> next;
+};
+
+// Function to mark the states of a GBA from which an accepting run exists: those reaching a
+// nontrivial strongly connected component that meets every acceptance set
+static void compute_live(Gba& gba, const vector<vector<bool>>& acceptance) {
+    size_t n = gba.states.size();
+    vector<uint32_t> index(n, UINT32_MAX), low(n), component(n, UINT32_MAX);
+    vector<bool> on_stack(n);
+    vector<uint32_t> stack;
+    vector<bool> component_live;
+    uint32_t counter = 0;
+
+    // Iterative Tarjan; components are completed sinks first, so successors are decided first
+    vector<pair<uint32_t, size_t>> calls;
+    for (uint32_t root = 0; root < n; ++root) {
+        if (index[root] != UINT32_MAX) {
+            continue;
+        }
+        calls.push_back({root, 0});
+        while (!calls.empty()) {
+            auto& [v, edge] = calls.back();
+            if (edge == 0) {
+                index[v] = low[v] = counter++;
+                stack.push_back(v);
+                on_stack[v] = true;
+            }
+            const auto& successors = gba.states[v].successors;
+            if (edge < successors.size()) {
+                uint32_t w = successors[edge++];
+                if (index[w] == UINT32_MAX) {
+                    calls.push_back({w, 0});
+                } else if (on_stack[w]) {
+                    low[v] = min(low[v], index[w]);
+                }
+                continue;
+            }
+
+            uint32_t finished = v;
+            calls.pop_back();
+            if (!calls.empty()) {
+                low[calls.back().first] = min(low[calls.back().first], low[finished]);
+            }
+            if (low[finished] != index[finished]) {
+                continue;
+            }
+
+            uint32_t id = component_live.size();
+            vector<uint32_t> members;
+            uint32_t w;
+            do {
+                w = stack.back();
+                stack.pop_back();
+                on_stack[w] = false;
+                component[w] = id;
+                members.push_back(w);
+            } while (w != finished);
+
+            bool cyclic = members.size() > 1;
+            bool live = false;
+            for (uint32_t m : members) {
+                for (uint32_t s : gba.states[m].successors) {
+                    cyclic |= s == m;
+                    live |= component[s] != id && component_live[component[s]];
+                }
+            }
+            if (cyclic && !live) {
+                live = all_of(acceptance.begin(), acceptance.end(), [&](const vector<bool>& set) {
+                    return any_of(members.begin(), members.end(), [&](uint32_t m) { return set[m]; });
+                });
+            }
+            component_live.push_back(live);
+        }
+    }
+
+    gba.live.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+        gba.live[i] = component_live[component[i]];
+    }
+}
+
+// Function to build the GBA of an NNF formula with the GPVW tableau
+static Gba build_gba(Formula& f, uint32_t root) {
+    const uint32_t init = UINT32_MAX;
+    vector<TableauNode> done;
+    map<pair<set<uint32_t>, set<uint32_t>>, uint32_t> done_ids;
+    vector<TableauNode> work;
+    work.push_back({{init}, {root}, {}, {}});
+
+    while (!work.empty()) {
+        TableauNode node = move(work.back());
+        work.pop_back();
+
+        if (node.fresh.empty()) {
+            auto key = make_pair(node.old, node.next);
+            if (auto it = done_ids.find(key); it != done_ids.end()) {
+                auto& incoming = done[it->second].incoming;
+                incoming.insert(incoming.end(), node.incoming.begin(), node.incoming.end());
+                continue;
+            }
+            uint32_t id = done.size();
+            done_ids.emplace(move(key), id);
+            work.push_back({{id}, vector<uint32_t>(node.next.begin(), node.next.end()), {}, {}});
+            done.push_back(move(node));
+            continue;
+        }
+
+        uint32_t eta = node.fresh.back();
+        node.fresh.pop_back();
+        if (node.old.count(eta)) {
+            work.push_back(move(node));
+            continue;
+        }
+        auto add = [](TableauNode& n, uint32_t id) {
+            if (!n.old.count(id)) {
+                n.fresh.push_back(id);
+            }
+        };
+
+        const Node& n = f.node(eta);
+        switch (n.kind) {
+        case NodeKind::False:
+            break;
+        case NodeKind::True:
+            node.old.insert(eta);
+            work.push_back(move(node));
+            break;
+        case NodeKind::Predicate:
+        case NodeKind::Not: {
+            uint32_t complement = n.kind == NodeKind::Not ? n.left : f.make(NodeKind::Not, eta);
+            if (!node.old.count(complement)) {
+                node.old.insert(eta);
+                work.push_back(move(node));
+            }
+            break;
+        }
+        case NodeKind::And: {
+            uint32_t left = n.left, right = n.right;
+            node.old.insert(eta);
+            add(node, left);
+            add(node, right);
+            work.push_back(move(node));
+            break;
+        }
+        case NodeKind::Next:
+            node.old.insert(eta);
+            node.next.insert(n.left);
+            work.push_back(move(node));
+            break;
+        case NodeKind::Or:
+        case NodeKind::Until:
+        case NodeKind::Release: {
+            // Or: left | right. Until: left, X(eta) | right. Release: right, X(eta) | left, right.
+            NodeKind kind = n.kind;
+            uint32_t left = n.left, right = n.right;
+            node.old.insert(eta);
+            TableauNode other = node;
+            add(node, kind == NodeKind::Release ? right : left);
+            if (kind != NodeKind::Or) {
+                node.next.insert(eta);
+            }
+            add(other, right);
+            if (kind == NodeKind::Release) {
+                add(other, left);
+            }
+            work.push_back(move(node));
+            work.push_back(move(other));
+            break;
+        }
+        default:
+            throw logic_error("formula is not in negation normal form");
+        }
+    }
+
+    Gba gba;
+    gba.states.resize(done.size() + 1);
+    for (uint32_t id = 0; id < done.size(); ++id) {
+        for (uint32_t formula_id : done[id].old) {
+            const Node& n = f.node(formula_id);
+            if (n.kind == NodeKind::Predicate) {
+                gba.states[id].pos |= 1u << n.left;
+            } else if (n.kind == NodeKind::Not) {
+                gba.states[id].neg |= 1u << f.node(n.left).left;
+            }
+        }
+        for (uint32_t from : done[id].incoming) {
+            gba.states[from == init ? gba.start() : from].successors.push_back(id);
+        }
+    }
+    for (auto& state : gba.states) {
+        sort(state.successors.begin(), state.successors.end());
+        state.successors.erase(unique(state.successors.begin(), state.successors.end()), state.successors.end());
+    }
+
+    // One acceptance set per until: states that do not promise it or fulfil it
+    vector<vector<bool>> acceptance;
+    vector<bool> seen(f.size());
+    vector<uint32_t> pending = {root};
+    while (!pending.empty()) {
+        uint32_t id = pending.back();
+        pending.pop_back();
+        if (id == Formula::none || seen[id]) {
+            continue;
+        }
+        seen[id] = true;
+        const Node& n = f.node(id);
+        if (n.kind != NodeKind::Predicate) {
+            pending.push_back(n.left);
+            pending.push_back(n.right);
+        }
+        if (n.kind == NodeKind::Until) {
+            vector<bool> set(gba.states.size());
+            for (uint32_t s = 0; s < done.size(); ++s) {
+                set[s] = !done[s].old.count(id) || done[s].old.count(n.right);
+            }
+            acceptance.push_back(move(set));
+        }
+    }
+
+    compute_live(gba, acceptance);
+    return gba;
+}
+
+// Function to compute the live successors of a set of GBA states on a letter
+static vector<uint32_t> successors(const Gba& gba, const vector<uint32_t>& from, uint32_t mask) {
+    vector<uint32_t> result;
+    for (uint32_t s : from) {
+        for (uint32_t t : gba.states[s].successors) {
+            const Gba::State& state = gba.states[t];
+            if (gba.live[t] && (mask & state.pos) == state.pos && (mask & state.neg) == 0) {
+                result.push_back(t);
+            }
+        }
+    }
+    sort(result.begin(), result.end());
+    result.erase(unique(result.begin(), result.end()), result.end());
+    return result;
+}
+
+// Function to minimize a complete Moore machine with Hopcroft's partition refinement, starting
+// from the partition by output. Returns the block of each state.
+static vector<uint32_t> hopcroft(const vector<uint32_t>& table, const vector<Verdict>& outputs, uint32_t letters) {
+    size_t n = outputs.size();
+
+    // Predecessors of each state per letter, in CSR form indexed by (letter, target)
+    vector<uint32_t> offsets((size_t)letters * n + 1);
+    for (size_t s = 0; s < n; ++s) {
+        for (uint32_t a = 0; a < letters; ++a) {
+            ++offsets[(size_t)a * n + table[s * letters + a] + 1];
+        }
+    }
+    for (size_t i = 1; i < offsets.size(); ++i) {
+        offsets[i] += offsets[i - 1];
+    }
+    vector<uint32_t> sources(offsets.back());
+    vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t s = 0; s < n; ++s) {
+        for (uint32_t a = 0; a < letters; ++a) {
+            sources[fill[(size_t)a * n + table[s * letters + a]]++] = s;
+        }
+    }
+
+    vector<uint32_t> block_of(n);
+    vector<vector<uint32_t>> blocks;
+    for (Verdict v : {Verdict::Inconclusive, Verdict::True, Verdict::False}) {
+        vector<uint32_t> members;
+        for (size_t s = 0; s < n; ++s) {
+            if (outputs[s] == v) {
+                block_of[s] = blocks.size();
+                members.push_back(s);
+            }
+        }
+        if (!members.empty()) {
+            blocks.push_back(move(members));
+        }
+    }
+
+    vector<uint32_t> worklist;
+    vector<bool> in_worklist(blocks.size(), true);
+    for (uint32_t b = 0; b < blocks.size(); ++b) {
+        worklist.push_back(b);
+    }
+
+    // There are never more blocks than states; only the touched counts are set back to 0
+    vector<uint32_t> marked_count(n);
+    vector<bool> marked(n);
+    vector<uint32_t> touched;
+    while (!worklist.empty()) {
+        uint32_t splitter = worklist.back();
+        worklist.pop_back();
+        in_worklist[splitter] = false;
+        // Copied, as splitting may grow blocks
+        vector<uint32_t> targets = blocks[splitter];
+
+        for (uint32_t a = 0; a < letters; ++a) {
+            touched.clear();
+            for (uint32_t t : targets) {
+                size_t key = (size_t)a * n + t;
+                for (uint32_t i = offsets[key]; i < offsets[key + 1]; ++i) {
+                    uint32_t s = sources[i];
+                    if (!marked[s]) {
+                        marked[s] = true;
+                        if (marked_count[block_of[s]]++ == 0) {
+                            touched.push_back(block_of[s]);
+                        }
+                    }
+                }
+            }
+
+            for (uint32_t b : touched) {
+                if (marked_count[b] < blocks[b].size()) {
+                    vector<uint32_t> inside, outside;
+                    for (uint32_t s : blocks[b]) {
+                        (marked[s] ? inside : outside).push_back(s);
+                    }
+                    uint32_t created = blocks.size();
+                    for (uint32_t s : inside) {
+                        block_of[s] = created;
+                    }
+                    bool inside_smaller = inside.size() <= outside.size();
+                    blocks[b] = move(outside);
+                    blocks.push_back(move(inside));
+                    in_worklist.push_back(false);
+                    if (in_worklist[b]) {
+                        worklist.push_back(created);
+                        in_worklist[created] = true;
+                    } else {
+                        uint32_t smaller = inside_smaller ? created : b;
+                        worklist.push_back(smaller);
+                        in_worklist[smaller] = true;
+                    }
+                }
+                marked_count[b] = 0;
+            }
+            for (uint32_t t : targets) {
+                size_t key = (size_t)a * n + t;
+                for (uint32_t i = offsets[key]; i < offsets[key + 1]; ++i) {
+                    marked[sources[i]] = false;
+                }
+            }
+        }
+    }
+    return block_of;
+}
+
+MonitorAutomaton MonitorAutomaton::compile(const Formula& formula) {
+    uint32_t k = formula.predicates().size();
+    if (k > max_predicates) {
+        throw runtime_error("Formula has " + std::to_string(k) + " predicates, a monitor supports at most " +
+                            std::to_string(max_predicates));
+    }
+    uint32_t letters = 1u << k;
+
+    Formula f = formula;
+    unordered_map<uint64_t, uint32_t> memo;
+    Gba positive = build_gba(f, to_nnf(f, formula.root(), false, memo));
+    Gba negative = build_gba(f, to_nnf(f, formula.root(), true, memo));
+
+    // Subset construction over both automata; an empty side decides the verdict
+    using Subsets = pair<vector<uint32_t>, vector<uint32_t>>;
+    map<Subsets, uint32_t> ids;
+    vector<Subsets> subsets;
+    vector<uint32_t> table;
+    auto intern = [&](Subsets s) {
+        auto [it, inserted] = ids.emplace(s, subsets.size());
+        if (inserted) {
+            subsets.push_back(move(s));
+        }
+        return it->second;
+    };
+    // The start pseudo-state counts as live when it has any live successor
+    auto start = [](const Gba& gba) {
+        const auto& first = gba.states[gba.start()].successors;
+        bool live = any_of(first.begin(), first.end(), [&](uint32_t s) { return gba.live[s]; });
+        return live ? vector<uint32_t>{gba.start()} : vector<uint32_t>();
+    };
+    intern({start(positive), start(negative)});
+
+    for (uint32_t current = 0; current < subsets.size(); ++current) {
+        if ((size_t)subsets.size() * letters > max_table_entries) {
+            throw runtime_error("Monitor automaton too large");
+        }
+        for (uint32_t mask = 0; mask < letters; ++mask) {
+            Subsets next = {successors(positive, subsets[current].first, mask),
+                            successors(negative, subsets[current].second, mask)};
+            table.push_back(intern(move(next)));
+        }
+    }
+
+    vector<Verdict> outputs(subsets.size());
+    for (size_t s = 0; s < subsets.size(); ++s) {
+        outputs[s] = subsets[s].first.empty() ? Verdict::False
+                   : subsets[s].second.empty() ? Verdict::True
+                   : Verdict::Inconclusive;
+    }
+
+    vector<uint32_t> block_of = hopcroft(table, outputs, letters);
+    uint32_t block_count = *max_element(block_of.begin(), block_of.end()) + 1;
+
+    MonitorAutomaton automaton;
+    automaton.predicates = k;
+    automaton.initial_state = block_of[0];
+    automaton.table.resize((size_t)block_count * letters);
+    automaton.verdicts.resize(block_count);
+    for (size_t s = 0; s < subsets.size(); ++s) {
+        uint32_t b = block_of[s];
+        automaton.verdicts[b] = outputs[s];
+        for (uint32_t mask = 0; mask < letters; ++mask) {
+            automaton.table[(size_t)b * letters + mask] = block_of[table[s * letters + mask]];
+        }
+    }
+
+    automaton.dependents.resize(block_count);
+    for (uint32_t b = 0; b < block_count; ++b) {
+        const uint32_t* row = automaton.table.data() + (size_t)b * letters;
+        for (uint32_t p = 0; p < k; ++p) {
+            uint32_t bit = 1u << p;
+            for (uint32_t mask = 0; mask < letters; ++mask) {
+                if (!(mask & bit) && row[mask] != row[mask | bit]) {
+                    automaton.dependents[b] |= bit;
+                    break;
+                }
+            }
+        }
+    }
+    return automaton;
+}
+
+Monitor::Monitor(const Formula& formula, const MonitorAutomaton& automaton)
+    : automaton(automaton), predicates(formula.predicates()),
+      predicates_of_variable(formula.variables().size()), variables_of_predicate(predicates.size()),
+      values(formula.variables().size()), current(automaton.initial()) {
+    for (uint32_t p = 0; p < predicates.size(); ++p) {
+        for (const Term& term : {predicates[p].lhs, predicates[p].rhs}) {
+            if (term.kind == Term::Variable) {
+                variables_of_predicate[p] |= 1ull << term.value;
+                auto& list = predicates_of_variable[term.value];
+                if (list.empty() || list.back() != p) {
+                    list.push_back(p);
+                }
+            }
+        }
+        if (evaluate(predicates[p])) {
+            current_mask |= 1u << p;
+        }
+    }
+}
+
+bool Monitor::evaluate(const Predicate& predicate) const {
+    auto value = [&](const Term& t) { return t.kind == Term::Variable ? values[t.value] : t.value; };
+    int64_t lhs = value(predicate.lhs), rhs = value(predicate.rhs);
+    switch (predicate.op) {
+    case RelOp::Eq: return lhs == rhs;
+    case RelOp::Ne: return lhs != rhs;
+    case RelOp::Lt: return lhs < rhs;
+    case RelOp::Le: return lhs <= rhs;
+    case RelOp::Gt: return lhs > rhs;
+    default: return lhs >= rhs;
+    }
+}
+
+uint64_t Monitor::watched_variables() const {
+    uint64_t key = ((uint64_t)current << 32) | current_mask;
+    auto cached = watched_cache.find(key);
+    if (cached != watched_cache.end()) {
+        return cached->second;
+    }
+    uint64_t variables = 0;
+    if (automaton.step(current, current_mask) != current) {
+        // Even a position changing nothing the state depends on moves it
+        for (uint64_t of_predicate : variables_of_predicate) {
+            variables |= of_predicate;
+        }
+        return watched_cache[key] = variables;
+    }
+    // Variables are left unobserved one by one while every combination of the predicates over
+    // them still loops. Predicates the state does not depend on never move it.
+    uint32_t dependent = automaton.dependent(current);
+    uint32_t free = 0;
+    for (uint32_t v = 0; v < predicates_of_variable.size(); ++v) {
+        uint32_t bits = 0;
+        for (uint32_t p : predicates_of_variable[v]) {
+            bits |= 1u << p;
+        }
+        bits &= dependent;
+        if (bits == 0) {
+            continue;
+        }
+        uint32_t candidate = free | bits;
+        bool loops = true;
+        for (uint32_t sub = candidate;; sub = (sub - 1) & candidate) {
+            if (automaton.step(current, (current_mask & ~candidate) | sub) != current) {
+                loops = false;
+                break;
+            }
+            if (sub == 0) {
+                break;
+            }
+        }
+        if (loops) {
+            free = candidate;
+        } else {
+            variables |= 1ull << v;
+        }
+    }
+    return watched_cache[key] = variables;
+}
+
+void Monitor::set(uint32_t variable, int64_t value) {
+    values[variable] = value;
+    for (uint32_t p : predicates_of_variable[variable]) {
+        uint32_t bit = 1u << p;
+        current_mask = evaluate(predicates[p]) ? current_mask | bit : current_mask & ~bit;
+    }
+}
+
+Verdict Monitor::step() {
+    current = automaton.step(current, current_mask);
+    ++step_count;
+    return automaton.verdict(current);
+}
@@ -0,0 +1,94 @@
+#ifndef RV_MONITOR_HPP
+#define RV_MONITOR_HPP
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "ltl.hpp"
+
+// Three-valued LTL3 verdict: every extension of the trace seen so far satisfies the formula
+// (True), none does (False), or it can still go either way (Inconclusive)
+enum class Verdict : uint8_t { Inconclusive, True, False };
+
+const char* verdict_name(Verdict verdict);
+
+// Deterministic LTL3 monitor of a formula, minimized with Hopcroft's algorithm. Its letters are
+// bitmasks of the predicates that hold (bit i for predicate i of the formula), so a step is a
+// single lookup in a table with one row per state and one column per mask.
+class MonitorAutomaton {
+public:
+    // Most predicates a formula may have, the table has 2^n columns per state
+    static constexpr uint32_t max_predicates = 16;
+
+    // Function to compile a formula. The automaton is built from generalized Büchi automata of
+    // the formula and of its negation (Bauer, Leucker, Schallhart). Predicates are treated as
+    // independent, so a verdict may be Inconclusive where correlated predicates (a == 1 and
+    // a == 2) would already decide it, but never wrong. Throws runtime_error if the formula has
+    // more than max_predicates predicates or the automaton grows too large.
+    static MonitorAutomaton compile(const Formula& formula);
+
+    uint32_t initial() const { return initial_state; }
+    uint32_t step(uint32_t state, uint32_t mask) const { return table[((size_t)state << predicates) | mask]; }
+    Verdict verdict(uint32_t state) const { return verdicts[state]; }
+    // True and False states are sinks, no continuation changes their verdict
+    bool is_final(uint32_t state) const { return verdicts[state] != Verdict::Inconclusive; }
+    // Mask of the predicates some transition out of a state depends on
+    uint32_t dependent(uint32_t state) const { return dependents[state]; }
+
+    size_t state_count() const { return verdicts.size(); }
+    uint32_t predicate_count() const { return predicates; }
+
+private:
+    uint32_t predicates = 0;
+    uint32_t initial_state = 0;
+    std::vector<uint32_t> table;
+    std::vector<Verdict> verdicts;
+    std::vector<uint32_t> dependents;
+};
+
+// Runtime state of a monitor: the current valuation of the formula's variables, the mask of
+// predicates holding under it, and the automaton state.
+class Monitor {
+public:
+    Monitor(const Formula& formula, const MonitorAutomaton& automaton);
+
+    // Function to update a variable. Predicates over it are re-evaluated, but no step is taken,
+    // so several updates can form a single position of the trace.
+    void set(uint32_t variable, int64_t value);
+
+    // Function to take one step over the current valuation, returns the new verdict
+    Verdict step();
+
+    Verdict verdict() const { return automaton.verdict(current); }
+    bool is_final() const { return automaton.is_final(current); }
+
+    // Function to get the mask of the variables whose changes must be observed (bit i for
+    // variable i). The unobserved variables are chosen so that no position changing only them,
+    // in any combination, can move the monitor from its current state and mask: the current
+    // mask must loop, and so must every mask that differs from it only in their predicates.
+    // Their values must be brought up to date with set() before the next step.
+    uint64_t watched_variables() const;
+
+    // No change of any variable can move the monitor any more, so its verdict is final
+    bool settled() const { return watched_variables() == 0; }
+    uint32_t state() const { return current; }
+    uint32_t mask() const { return current_mask; }
+    uint64_t steps() const { return step_count; }
+
+private:
+    bool evaluate(const Predicate& predicate) const;
+
+    const MonitorAutomaton& automaton;
+    std::vector<Predicate> predicates;
+    std::vector<std::vector<uint32_t>> predicates_of_variable;
+    std::vector<uint64_t> variables_of_predicate;
+    std::vector<int64_t> values;
+    uint32_t current_mask = 0;
+    uint32_t current;
+    uint64_t step_count = 0;
+    // watched_variables() of the (state, mask) pairs seen so far
+    mutable std::unordered_map<uint64_t, uint64_t> watched_cache;
+};
+
+#endif // RV_MONITOR_HPP
@@ -0,0 +1,390 @@
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "offline_check.hpp"
+
+using namespace std;
+
+static const uint64_t never = UINT64_MAX;
+
+// Most bytes of text and blocks of a trace per chunk, which bound the events decoded at once
+static const size_t chunk_bytes = 8 << 20;
+static const size_t chunk_blocks = 256;
+
+TextLog::TextLog(const string& path, vector<string> names, size_t chunks)
+    : path(path), names(move(names)), zeros(this->names.size()) {
+    for (uint32_t v = 0; v < this->names.size(); ++v) {
+        ids[this->names[v]] = v;
+    }
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw runtime_error("Could not open event log " + path + ": " + strerror(errno));
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        throw runtime_error("Could not read event log " + path + ": " + strerror(errno));
+    }
+    length = st.st_size;
+    if (length != 0) {
+        void* p = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) {
+            close(fd);
+            throw runtime_error("Could not map event log " + path + ": " + strerror(errno));
+        }
+        base = static_cast<const char*>(p);
+        madvise(p, length, MADV_SEQUENTIAL);
+    }
+    close(fd);
+
+    // Equal pieces, each moved on to the start of a line
+    chunks = max({chunks, length / chunk_bytes, (size_t)1});
+    starts.push_back(0);
+    for (size_t i = 1; i < chunks; ++i) {
+        size_t at = max(length / chunks * i, starts.back());
+        const char* newline = static_cast<const char*>(memchr(base + at, '\n', length - at));
+        at = newline ? newline - base + 1 : length;
+        if (at != starts.back() && at != length) {
+            starts.push_back(at);
+        }
+    }
+    starts.push_back(length);
+}
+
+TextLog::~TextLog() {
+    if (base != nullptr) {
+        munmap((void*)base, length);
+    }
+}
+
+static string_view trim(string_view text) {
+    while (!text.empty() && isspace((unsigned char)text.front())) {
+        text.remove_prefix(1);
+    }
+    while (!text.empty() && isspace((unsigned char)text.back())) {
+        text.remove_suffix(1);
+    }
+    return text;
+}
+
+// Start of the lines of rv_watch for a store to a watched address, which carry no value
+static const string_view plugin_change = "[PLUGIN] Variable at ";
+
+static bool parse_value(string_view text, int64_t& value) {
+    bool negative = !text.empty() && text.front() == '-';
+    if (negative) {
+        text.remove_prefix(1);
+    }
+    int radix = 10;
+    if (text.size() > 2 && text[0] == '0' && (text[1] == 'x' || text[1] == 'X')) {
+        text.remove_prefix(2);
+        radix = 16;
+    }
+    uint64_t magnitude;
+    auto [end, error] = from_chars(text.data(), text.data() + text.size(), magnitude, radix);
+    if (error != errc() || end != text.data() + text.size() || text.empty()) {
+        return false;
+    }
+    value = negative ? -(int64_t)magnitude : (int64_t)magnitude;
+    return true;
+}
+
+void TextLog::decode(size_t chunk, vector<LogEvent>& events) const {
+    events.clear();
+    const char* end = base + starts[chunk + 1];
+    for (const char* line = base + starts[chunk]; line < end;) {
+        const char* newline = static_cast<const char*>(memchr(line, '\n', end - line));
+        const char* line_end = newline ? newline : end;
+        string_view text(line, line_end - line);
+        if (text.compare(0, plugin_change.size(), plugin_change) == 0) {
+            throw runtime_error(path + ":" + to_string(count(base, line, '\n') + 1) +
+                                ": the QEMU plugin logs changes without their values, which cannot be checked");
+        }
+        if (text.find('=') != string_view::npos) {
+            size_t first = events.size();
+            while (!text.empty()) {
+                size_t comma = text.find(',');
+                string_view item = text.substr(0, comma);
+                text = comma == string_view::npos ? string_view() : text.substr(comma + 1);
+                size_t equals = item.find('=');
+                int64_t value;
+                if (equals == string_view::npos || !parse_value(trim(item.substr(equals + 1)), value)) {
+                    throw runtime_error(path + ":" + to_string(count(base, line, '\n') + 1) +
+                                        ": expected name=value, got '" + string(trim(item)) + "'");
+                }
+                auto found = ids.find(trim(item.substr(0, equals)));
+                if (found != ids.end()) {
+                    events.push_back({found->second, value, false});
+                }
+            }
+            // A line of other variables is still a position
+            if (events.size() == first) {
+                events.push_back({LogEvent::none, 0, false});
+            }
+            events.back().end = true;
+        }
+        line = line_end + 1;
+    }
+}
+
+TraceLog::TraceLog(const TraceReader& reader, size_t chunks) : reader(reader) {
+    for (const TraceVariable& variable : reader.header().variables) {
+        values.push_back(variable.initial);
+    }
+    offsets = reader.block_offsets(cut);
+    size_t per_chunk = min(max<size_t>(1, (offsets.size() + chunks - 1) / max<size_t>(chunks, 1)), chunk_blocks);
+    for (size_t block = 0; block < offsets.size(); block += per_chunk) {
+        starts.push_back(block);
+    }
+    starts.push_back(offsets.size());
+    if (starts.size() == 1) {
+        // No events, one empty chunk
+        starts.push_back(0);
+    }
+}
+
+void TraceLog::decode(size_t chunk, vector<LogEvent>& events) const {
+    events.clear();
+    vector<TraceEvent> block;
+    for (size_t i = starts[chunk]; i < starts[chunk + 1]; ++i) {
+        size_t offset = offsets[i];
+        reader.decode_block(offset, block);
+        for (const TraceEvent& event : block) {
+            events.push_back({event.variable, event.value, event.end});
+        }
+    }
+}
+
+// Function to run work(i) for i below count on threads threads, rethrowing the first exception
+static void parallel_for(size_t count, size_t threads, const function<void(size_t)>& work) {
+    atomic<size_t> next{0};
+    exception_ptr failure;
+    mutex lock;
+    auto run = [&] {
+        for (size_t i; (i = next.fetch_add(1)) < count;) {
+            try {
+                work(i);
+            } catch (...) {
+                lock_guard<mutex> guard(lock);
+                if (!failure) {
+                    failure = current_exception();
+                }
+                next.store(count);
+            }
+        }
+    };
+    vector<thread> pool;
+    for (size_t t = 1; t < min(threads, count); ++t) {
+        pool.emplace_back(run);
+    }
+    run();
+    for (thread& worker : pool) {
+        worker.join();
+    }
+    if (failure) {
+        rethrow_exception(failure);
+    }
+}
+
+// What a chunk does to the variables: the values it leaves those it sets at
+struct ChunkValues {
+    uint64_t set = 0;
+    vector<int64_t> last;
+    uint64_t positions = 0;
+    uint64_t events = 0;
+    // Events after its last position end, continued by the next chunk
+    bool open = false;
+};
+
+// A chunk as a function of the automaton state it starts in: the state it ends in and the
+// position at which that run reached a final state, never if it did not
+struct ChunkFunction {
+    vector<uint32_t> end;
+    vector<uint64_t> decided;
+};
+
+// Function to compose two functions, first then second
+static ChunkFunction compose(const ChunkFunction& first, const ChunkFunction& second) {
+    ChunkFunction both{first.end, first.decided};
+    for (size_t state = 0; state < both.end.size(); ++state) {
+        if (first.decided[state] == never) {
+            both.end[state] = second.end[first.end[state]];
+            both.decided[state] = second.decided[first.end[state]];
+        }
+    }
+    return both;
+}
+
+// Function to compute the function of a chunk of events for one property, with the values the
+// chunk starts from; position is the number of positions before it
+static ChunkFunction chunk_function(const Property& property, const vector<LogEvent>& events,
+                                    const vector<int64_t>& start, uint64_t position, bool last_chunk) {
+    const MonitorAutomaton& automaton = property.automaton;
+    size_t states = automaton.state_count();
+    vector<uint32_t> local_of(start.size(), LogEvent::none);
+    Monitor monitor(property.formula, automaton);
+    for (uint32_t v = 0; v < property.watch_of.size(); ++v) {
+        local_of[property.watch_of[v]] = v;
+        monitor.set(v, start[property.watch_of[v]]);
+    }
+
+    // Runs from every state at once. A run that meets another at a state follows it from then
+    // on (merged), and one that reaches a final state stops; mostly a single run is left soon.
+    ChunkFunction function{vector<uint32_t>(states), vector<uint64_t>(states, never)};
+    vector<uint32_t> state(states), merged(states), live, owner(states, UINT32_MAX);
+    for (uint32_t s = 0; s < states; ++s) {
+        state[s] = s;
+        merged[s] = s;
+        if (!automaton.is_final(s)) {
+            live.push_back(s);
+        }
+    }
+    auto step = [&] {
+        ++position;
+        size_t kept = 0;
+        for (uint32_t run : live) {
+            uint32_t next = automaton.step(state[run], monitor.mask());
+            state[run] = next;
+            if (automaton.is_final(next)) {
+                function.decided[run] = position;
+            } else if (owner[next] != UINT32_MAX) {
+                merged[run] = owner[next];
+            } else {
+                owner[next] = run;
+                live[kept++] = run;
+            }
+        }
+        live.resize(kept);
+        for (uint32_t run : live) {
+            owner[state[run]] = UINT32_MAX;
+        }
+    };
+    bool open = false;
+    for (const LogEvent& event : events) {
+        if (live.empty()) {
+            break;
+        }
+        if (event.variable != LogEvent::none && local_of[event.variable] != LogEvent::none) {
+            monitor.set(local_of[event.variable], event.value);
+        }
+        open = !event.end;
+        if (event.end) {
+            step();
+        }
+    }
+    // A position the end of the log cut in two
+    if (open && last_chunk && !live.empty()) {
+        step();
+    }
+
+    // A merged run ends where the one it joined does, and was decided with it
+    for (uint32_t s = 0; s < states; ++s) {
+        uint32_t run = s;
+        while (merged[run] != run) {
+            run = merged[run];
+        }
+        function.end[s] = state[run];
+        function.decided[s] = function.decided[run];
+    }
+    return function;
+}
+
+CheckReport check_log(const EventLog& log, const vector<Property>& properties, size_t threads) {
+    size_t chunks = log.chunks();
+    size_t variables = log.initial().size();
+
+    // The values each chunk leaves, and so the values and position each one starts from
+    vector<ChunkValues> summaries(chunks);
+    parallel_for(chunks, threads, [&](size_t chunk) {
+        vector<LogEvent> events;
+        log.decode(chunk, events);
+        ChunkValues& summary = summaries[chunk];
+        summary.last.assign(variables, 0);
+        for (const LogEvent& event : events) {
+            if (event.variable != LogEvent::none) {
+                summary.set |= 1ull << event.variable;
+                summary.last[event.variable] = event.value;
+            }
+            summary.positions += event.end;
+        }
+        summary.events = events.size();
+        summary.open = !events.empty() && !events.back().end;
+    });
+    CheckReport report;
+    vector<vector<int64_t>> starts(chunks);
+    vector<uint64_t> positions(chunks);
+    vector<int64_t> values = log.initial();
+    report.positions = log.initial_position() ? 1 : 0;
+    for (size_t chunk = 0; chunk < chunks; ++chunk) {
+        starts[chunk] = values;
+        positions[chunk] = report.positions;
+        for (size_t v = 0; v < variables; ++v) {
+            if ((summaries[chunk].set >> v) & 1) {
+                values[v] = summaries[chunk].last[v];
+            }
+        }
+        report.positions += summaries[chunk].positions;
+        report.events += summaries[chunk].events;
+    }
+    if (chunks != 0 && summaries.back().open) {
+        ++report.positions;
+    }
+
+    // The function of every chunk for every property
+    vector<vector<ChunkFunction>> functions(properties.size(), vector<ChunkFunction>(chunks));
+    parallel_for(chunks, threads, [&](size_t chunk) {
+        vector<LogEvent> events;
+        log.decode(chunk, events);
+        for (size_t p = 0; p < properties.size(); ++p) {
+            functions[p][chunk] = chunk_function(properties[p], events, starts[chunk], positions[chunk],
+                                                 chunk + 1 == chunks);
+        }
+    });
+
+    for (size_t p = 0; p < properties.size(); ++p) {
+        const Property& property = properties[p];
+        const MonitorAutomaton& automaton = property.automaton;
+        vector<ChunkFunction>& level = functions[p];
+        // Pairs of neighbours are composed in parallel, halving the functions every round
+        for (size_t stride = 1; stride < level.size(); stride *= 2) {
+            parallel_for((level.size() + 2 * stride - 1) / (2 * stride), threads, [&](size_t pair) {
+                size_t left = pair * 2 * stride, right = left + stride;
+                if (right < level.size()) {
+                    level[left] = compose(level[left], level[right]);
+                }
+            });
+        }
+
+        uint32_t state = automaton.initial();
+        CheckResult result;
+        if (log.initial_position()) {
+            Monitor monitor(property.formula, automaton);
+            for (uint32_t v = 0; v < property.watch_of.size(); ++v) {
+                monitor.set(v, log.initial()[property.watch_of[v]]);
+            }
+            state = automaton.step(state, monitor.mask());
+            if (automaton.is_final(state)) {
+                result.decided_at = 1;
+            }
+        }
+        if (!level.empty() && result.decided_at == 0) {
+            result.decided_at = level.front().decided[state] == never ? 0 : level.front().decided[state];
+            state = level.front().end[state];
+        }
+        result.verdict = automaton.verdict(state);
+        report.results.push_back(result);
+    }
+    return report;
+}
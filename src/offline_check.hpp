@@ -0,0 +1,111 @@
+#ifndef RV_OFFLINE_CHECK_HPP
+#define RV_OFFLINE_CHECK_HPP
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "pipeline.hpp"
+#include "trace_file.hpp"
+
+// A change in an event log. Positions end with an event that has end set; one whose variable is
+// none changes nothing.
+struct LogEvent {
+    static constexpr uint32_t none = UINT32_MAX;
+    uint32_t variable;
+    int64_t value;
+    bool end;
+};
+
+// An event log cut in chunks that decode independently of each other. Its variables are those
+// the watch_of of the checked properties index.
+class EventLog {
+public:
+    virtual ~EventLog() = default;
+
+    // Values of the variables before the first event
+    virtual const std::vector<int64_t>& initial() const = 0;
+    // Whether the initial values are a position of their own, the first one
+    virtual bool initial_position() const = 0;
+
+    virtual size_t chunks() const = 0;
+    // Function to decode the events of a chunk
+    virtual void decode(size_t chunk, std::vector<LogEvent>& events) const = 0;
+};
+
+// Text event log, one position per line given as `name=value` assignments separated by commas.
+// Values are decimal or 0x hexadecimal, variables start at 0, and lines without any `=`, such
+// as comments or the status lines of rv_watch, are skipped. The change lines of rv_watch are an
+// error, as the changes they report have no values.
+class TextLog : public EventLog {
+public:
+    // Function to map the log and cut it at line starts into about chunks pieces, more for a long
+    // log. Variables not in names are ignored. Throws runtime_error if it cannot be read.
+    TextLog(const std::string& path, std::vector<std::string> names, size_t chunks);
+    TextLog(const TextLog&) = delete;
+    TextLog& operator=(const TextLog&) = delete;
+    ~TextLog();
+
+    const std::vector<int64_t>& initial() const override { return zeros; }
+    bool initial_position() const override { return false; }
+    size_t chunks() const override { return starts.size() - 1; }
+    // Throws runtime_error with the line of a malformed assignment or of a change of rv_watch
+    void decode(size_t chunk, std::vector<LogEvent>& events) const override;
+
+private:
+    std::string path;
+    const char* base = nullptr;
+    size_t length = 0;
+    std::vector<std::string> names;
+    std::unordered_map<std::string_view, uint32_t> ids;
+    std::vector<int64_t> zeros;
+    std::vector<size_t> starts;
+};
+
+// Recorded trace file, in chunks of whole blocks
+class TraceLog : public EventLog {
+public:
+    // Function to cut the blocks of the trace into about chunks pieces, more for a long trace
+    TraceLog(const TraceReader& reader, size_t chunks);
+
+    const std::vector<int64_t>& initial() const override { return values; }
+    bool initial_position() const override { return true; }
+    size_t chunks() const override { return starts.size() - 1; }
+    void decode(size_t chunk, std::vector<LogEvent>& events) const override;
+
+    // The file ends within a block, whose events are not checked
+    bool truncated() const { return cut; }
+
+private:
+    const TraceReader& reader;
+    std::vector<int64_t> values;
+    std::vector<size_t> offsets;
+    // Index of the first block of each chunk, and the end of the last
+    std::vector<size_t> starts;
+    bool cut = false;
+};
+
+// Verdict of a property over a whole log
+struct CheckResult {
+    Verdict verdict = Verdict::Inconclusive;
+    // Position at which the verdict became final, 0 if it never did
+    uint64_t decided_at = 0;
+};
+
+struct CheckReport {
+    std::vector<CheckResult> results;
+    uint64_t positions = 0;
+    uint64_t events = 0;
+};
+
+// Function to check properties over a log on threads threads. The monitor is deterministic, so
+// a chunk is a function from the state it starts in to the state it ends in, and to the first
+// position where that run reached a final verdict. The chunks are read twice in parallel: first
+// for the values they leave their variables at, which give every chunk its starting values,
+// then to compute their functions, running all automaton states at once until they merge.
+// The functions are composed by a parallel reduction, and the composition applied to the
+// initial state gives the verdict and where it was decided.
+CheckReport check_log(const EventLog& log, const std::vector<Property>& properties, size_t threads);
+
+#endif // RV_OFFLINE_CHECK_HPP
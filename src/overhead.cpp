@@ -0,0 +1,246 @@
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <dirent.h>
+#include <signal.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "backend.hpp"
+#include "overhead.hpp"
+
+using namespace std;
+
+static double seconds(const timeval& time) {
+    return time.tv_sec + time.tv_usec / 1e6;
+}
+
+static double monotonic_seconds() {
+    timespec clock;
+    clock_gettime(CLOCK_MONOTONIC, &clock);
+    return clock.tv_sec + clock.tv_nsec / 1e9;
+}
+
+static Usage from_rusage(const rusage& usage) {
+    Usage result;
+    result.user = seconds(usage.ru_utime);
+    result.system = seconds(usage.ru_stime);
+    result.voluntary_switches = usage.ru_nvcsw;
+    result.involuntary_switches = usage.ru_nivcsw;
+    result.minor_faults = usage.ru_minflt;
+    result.major_faults = usage.ru_majflt;
+    return result;
+}
+
+// Function to add or take away (sign -1) one usage from another
+static void add(Usage& total, const Usage& usage, int sign = 1) {
+    total.wall += sign * usage.wall;
+    total.user += sign * usage.user;
+    total.system += sign * usage.system;
+    total.voluntary_switches += sign * usage.voluntary_switches;
+    total.involuntary_switches += sign * usage.involuntary_switches;
+    total.minor_faults += sign * usage.minor_faults;
+    total.major_faults += sign * usage.major_faults;
+}
+
+Usage reaped_children_usage() {
+    rusage usage;
+    getrusage(RUSAGE_CHILDREN, &usage);
+    return from_rusage(usage);
+}
+
+Usage own_usage() {
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return from_rusage(usage);
+}
+
+bool process_usage(pid_t pid, Usage& usage) {
+    usage = Usage();
+    string proc = "/proc/" + to_string(pid);
+    ifstream stat_file(proc + "/stat");
+    string stat;
+    if (!getline(stat_file, stat)) {
+        return false;
+    }
+    // The fields after the command, which may hold spaces, start with the state (field 3)
+    size_t end = stat.rfind(')');
+    if (end == string::npos) {
+        return false;
+    }
+    stringstream fields(stat.substr(end + 2));
+    string state;
+    uint64_t value, utime = 0, stime = 0;
+    fields >> state;
+    if (state == "Z" || state == "X") {
+        return false;
+    }
+    for (int field = 4; field <= 15 && fields >> value; ++field) {
+        if (field == 10) {
+            usage.minor_faults = value;
+        } else if (field == 12) {
+            usage.major_faults = value;
+        } else if (field == 14) {
+            utime = value;
+        } else if (field == 15) {
+            stime = value;
+        }
+    }
+    double ticks = sysconf(_SC_CLK_TCK);
+    usage.user = utime / ticks;
+    usage.system = stime / ticks;
+
+    // Only the threads still running are counted, as /proc keeps no record of the others
+    DIR* tasks = opendir((proc + "/task").c_str());
+    if (!tasks) {
+        return false;
+    }
+    while (dirent* entry = readdir(tasks)) {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+        ifstream status(proc + "/task/" + entry->d_name + "/status");
+        string line;
+        while (getline(status, line)) {
+            if (line.compare(0, 24, "voluntary_ctxt_switches:") == 0) {
+                usage.voluntary_switches += stoull(line.substr(24));
+            } else if (line.compare(0, 27, "nonvoluntary_ctxt_switches:") == 0) {
+                usage.involuntary_switches += stoull(line.substr(27));
+            }
+        }
+    }
+    closedir(tasks);
+    return true;
+}
+
+Usage run_unmonitored(const string& elf_file, size_t count) {
+    Usage total;
+    double started = monotonic_seconds();
+    vector<pid_t> pids;
+    for (size_t i = 0; i < count; ++i) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            // The tracer blocks signals its children must not start with
+            sigset_t none;
+            sigemptyset(&none);
+            sigprocmask(SIG_SETMASK, &none, nullptr);
+            prctl(PR_SET_PDEATHSIG, SIGTERM);
+            const char* argv_exec[] = {elf_file.c_str(), nullptr};
+            const char* envp_exec[] = {nullptr};
+            execve(elf_file.c_str(), (char* const*)argv_exec, (char* const*)envp_exec);
+            _exit(127);
+        }
+        if (pid < 0) {
+            throw runtime_error(string("Fork failed: ") + strerror(errno));
+        }
+        pids.push_back(pid);
+    }
+    for (pid_t pid : pids) {
+        int status;
+        rusage usage;
+        if (wait4(pid, &status, 0, &usage) < 0) {
+            throw runtime_error(string("wait4 failed: ") + strerror(errno));
+        }
+        if (WIFEXITED(status) && WEXITSTATUS(status) == 127) {
+            throw runtime_error("Could not run " + elf_file + " unmonitored");
+        }
+        add(total, from_rusage(usage));
+    }
+    total.wall = monotonic_seconds() - started;
+    return total;
+}
+
+OverheadMeter::OverheadMeter(vector<pid_t> pids, bool children) : pids(move(pids)), children(children) {}
+
+void OverheadMeter::start() {
+    if (children) {
+        processes_before = reaped_children_usage();
+    } else {
+        for (pid_t pid : pids) {
+            Usage usage;
+            if (process_usage(pid, usage)) {
+                add(processes_before, usage);
+            }
+        }
+    }
+    tracer_before = own_usage();
+    stops_before = tracee_stops();
+    started = monotonic_seconds();
+}
+
+void OverheadMeter::stop() {
+    double wall = monotonic_seconds() - started;
+    stops = tracee_stops() - stops_before;
+    tracer = own_usage();
+    add(tracer, tracer_before, -1);
+    tracer.wall = wall;
+    if (children) {
+        processes = reaped_children_usage();
+    } else {
+        for (pid_t pid : pids) {
+            Usage usage;
+            if (process_usage(pid, usage)) {
+                add(processes, usage);
+            } else {
+                ++exited;
+            }
+        }
+    }
+    add(processes, processes_before, -1);
+    processes.wall = wall;
+}
+
+// Function to print how many times more the monitored figure is than the unmonitored one
+static void print_ratio(ostream& out, double monitored, double unmonitored) {
+    if (unmonitored > 0) {
+        out << ", " << fixed << setprecision(1) << monitored / unmonitored << "x";
+    }
+}
+
+void OverheadMeter::print(ostream& out, const string& backend, const Usage* unmonitored) const {
+    ios::fmtflags flags = out.flags();
+    streamsize precision = out.precision();
+    size_t count = pids.size();
+    out << "Overhead of the " << backend << " backend on " << count << " "
+        << (children ? (count > 1 ? "children" : "child") : (count > 1 ? "processes" : "process")) << ":" << endl;
+    out << fixed << setprecision(3);
+    out << "  wall time         " << processes.wall << " s";
+    if (unmonitored) {
+        out << ", unmonitored " << unmonitored->wall << " s";
+        print_ratio(out, processes.wall, unmonitored->wall);
+    }
+    out << endl << setprecision(3);
+    if (exited != 0) {
+        out << "  target usage      not measured, " << exited << " exited under the tracer" << endl;
+    } else {
+        out << "  target CPU        " << processes.user + processes.system << " s (" << processes.user << " user, "
+            << processes.system << " system)";
+        if (unmonitored) {
+            out << ", unmonitored " << unmonitored->user + unmonitored->system << " s";
+            print_ratio(out, processes.user + processes.system, unmonitored->user + unmonitored->system);
+        }
+        out << endl;
+        out << "  context switches  " << processes.voluntary_switches << " voluntary, "
+            << processes.involuntary_switches << " involuntary";
+        if (unmonitored) {
+            out << ", unmonitored " << unmonitored->voluntary_switches << " and " << unmonitored->involuntary_switches;
+        }
+        out << endl;
+        out << "  page faults       " << processes.minor_faults << " minor, " << processes.major_faults << " major";
+        if (unmonitored) {
+            out << ", unmonitored " << unmonitored->minor_faults << " and " << unmonitored->major_faults;
+        }
+        out << endl;
+    }
+    out << "  ptrace stops      " << stops << endl;
+    out << setprecision(3) << "  tracer CPU        " << tracer.user + tracer.system << " s (" << tracer.user
+        << " user, " << tracer.system << " system)" << endl;
+    out.flags(flags);
+    out.precision(precision);
+}
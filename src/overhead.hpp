@@ -0,0 +1,66 @@
+#ifndef RV_OVERHEAD_HPP
+#define RV_OVERHEAD_HPP
+
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+// What processes used over a run: wall and CPU time in seconds, context switches and faults
+struct Usage {
+    double wall = 0;
+    double user = 0;
+    double system = 0;
+    uint64_t voluntary_switches = 0;
+    uint64_t involuntary_switches = 0;
+    uint64_t minor_faults = 0;
+    uint64_t major_faults = 0;
+};
+
+// Function to get the usage of the children reaped so far, summed, as wait4 reports it
+Usage reaped_children_usage();
+
+// Function to get the usage of the tracer itself, all its threads
+Usage own_usage();
+
+// Function to read the usage of a running process so far from /proc: CPU times and faults from
+// its stat, and context switches summed over its threads. Returns false if it is gone.
+bool process_usage(pid_t pid, Usage& usage);
+
+// Function to run count copies of the ELF file at once, untraced and with an empty environment
+// as monitored children are started, and return their usage summed with wait4, with the wall
+// time until the last one exited. Throws runtime_error if they cannot be started.
+Usage run_unmonitored(const std::string& elf_file, size_t count);
+
+// Meter of what monitoring costs the monitored processes. Children are measured by what the
+// tracer reaps, running processes by their /proc entries, as long as they still run at the end.
+class OverheadMeter {
+public:
+    OverheadMeter(std::vector<pid_t> pids, bool children);
+
+    // Function to start measuring, before the processes resume
+    void start();
+
+    // Function to stop measuring, once every session has ended
+    void stop();
+
+    // Function to print the usage of the processes under the backend and of the tracer, with
+    // the slowdown against unmonitored, the usage of an unmonitored run, unless it is null
+    void print(std::ostream& out, const std::string& backend, const Usage* unmonitored) const;
+
+private:
+    std::vector<pid_t> pids;
+    bool children;
+    Usage processes_before;
+    Usage processes;
+    Usage tracer_before;
+    Usage tracer;
+    uint64_t stops_before = 0;
+    uint64_t stops = 0;
+    double started = 0;
+    // Running processes that exited before the end, whose usage is lost
+    size_t exited = 0;
+};
+
+#endif // RV_OVERHEAD_HPP
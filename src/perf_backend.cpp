@@ -0,0 +1,218 @@
+#include <cerrno>
+#include <cstring>
+#include <ostream>
+#include <stdexcept>
+#include <unordered_set>
+#include <linux/hw_breakpoint.h>
+#include <poll.h>
+#include <unistd.h>
+#include "backend.hpp"
+#include "perf_ring.hpp"
+#include "threads.hpp"
+
+using namespace std;
+
+// Hardware breakpoint backend through perf_event_open: a PERF_TYPE_BREAKPOINT write event per
+// aligned piece of an armed watch and live thread of the tracee, inherited by the threads it
+// creates, sampling into mmap ring buffers, one per CPU. The tracee never stops on a write; the monitor wakes up on new samples, drains every ring in one batch and
+// reads the watched values with one process_vm_readv. Writes that happen while a batch is
+// processed are merged into the next position, so positions can be coarser than with the
+// ptrace backends. A change is tagged with the thread of the last sampled write to its
+// variable. The tracee runs as a RunningTracee, so the last values are read at its exit.
+class PerfBackend : public Backend {
+public:
+    const char* name() const override { return "perf"; }
+
+    void attach(pid_t pid, const vector<Watch>& watches) override {
+        this->pid = pid;
+        this->watches = watches;
+        cpus = PerfRing::online_cpus();
+        writers.assign(watches.size(), 0);
+        tracee.attach(pid);
+        arm(vector<bool>(watches.size(), true));
+        tracee.resume();
+    }
+
+    void arm(const vector<bool>& armed) override {
+        // Breakpoint slots are reserved when an event is created, so events only exist while armed.
+        // Writes since the last batch are drained for their threads, and the values as they are
+        // before the swap are the baseline of the watches armed anew.
+        drain();
+        vector<int64_t> before;
+        try_read_values(pid, watches, before);
+        events.clear();
+        watch_of_event.clear();
+        // An event is only inherited by the threads created after it is opened, so every thread
+        // that exists gets its own, those started meanwhile too. One started after its creator's
+        // event was opened may get both, which only counts its samples twice.
+        unordered_set<pid_t> opened;
+        for (bool found = true; found;) {
+            found = false;
+            for (pid_t tid : thread_ids(pid)) {
+                if (!opened.insert(tid).second) {
+                    continue;
+                }
+                found = true;
+                for (size_t i = 0; i < watches.size(); ++i) {
+                    if (armed[i]) {
+                        for (auto [address, length] : aligned_pieces(watches[i])) {
+                            open_event(tid, address, length, i);
+                        }
+                    }
+                }
+            }
+        }
+        // Watches that stay armed keep their baseline, so what they changed since the last batch
+        // or while no event was open is the position the next call of next() returns
+        vector<int64_t> current;
+        if (try_read_values(pid, watches, current)) {
+            for (size_t i = 0; i < watches.size(); ++i) {
+                bool was_armed = i < this->armed.size() && this->armed[i];
+                if (armed[i] && current[i] != (was_armed ? values[i] : before[i])) {
+                    pending.push_back({watches[i].variable, current[i], writers[i]});
+                }
+            }
+            values = move(current);
+        }
+        this->armed = armed;
+        writers.assign(watches.size(), 0);
+    }
+
+    bool next(vector<Change>& changes) override {
+        if (!pending.empty()) {
+            changes.insert(changes.end(), pending.begin(), pending.end());
+            pending.clear();
+            return true;
+        }
+        if (tracee.exiting()) {
+            tracee.finish(status);
+            return false;
+        }
+
+        vector<pollfd> fds;
+        for (const PerfRing& event : events) {
+            fds.push_back({event.fd(), POLLIN, 0});
+        }
+        fds.push_back({tracee.fd(), POLLIN, 0});
+
+        for (;;) {
+            if (blocking && poll(fds.data(), fds.size(), -1) < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw runtime_error(string("poll failed: ") + strerror(errno));
+            }
+            for (pollfd& fd : fds) {
+                if (fd.revents & POLLHUP) {
+                    // The event of a thread that exited, polled no more
+                    fd.fd = -1;
+                }
+            }
+            // Without blocking the rings are drained as they are, and stops looked for at once
+            if ((!blocking || (fds.back().revents & POLLIN)) && !tracee.handle_stops(status)) {
+                return false;
+            }
+            if (drain() == 0 && !tracee.exiting()) {
+                if (!blocking) {
+                    return true;
+                }
+                continue;
+            }
+
+            ++batches;
+            vector<int64_t> current;
+            if (try_read_values(pid, watches, current)) {
+                for (size_t i = 0; i < watches.size(); ++i) {
+                    if (armed[i] && current[i] != values[i]) {
+                        changes.push_back({watches[i].variable, current[i], writers[i]});
+                    }
+                }
+                values = move(current);
+            }
+            writers.assign(watches.size(), 0);
+            if (!changes.empty() || tracee.exiting()) {
+                // At the exit stop the last changes are reported first, the next call finishes
+                return !changes.empty() || next(changes);
+            }
+        }
+    }
+
+    void detach() override {
+        events.clear();
+        tracee.detach();
+    }
+
+    vector<int> wait_fds() const override {
+        vector<int> fds;
+        for (const PerfRing& event : events) {
+            fds.push_back(event.fd());
+        }
+        return fds;
+    }
+
+    void print_stats(ostream& out) const override {
+        out << "perf: " << samples << " samples in " << batches << " batches, " << lost << " lost" << endl;
+    }
+
+private:
+    // Function to open the event of a watched piece on thread tid, unless the thread has exited
+    void open_event(pid_t tid, uint64_t address, uint64_t length, size_t watch) {
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.type = PERF_TYPE_BREAKPOINT;
+        attr.size = sizeof(attr);
+        attr.bp_type = HW_BREAKPOINT_W;
+        attr.bp_addr = address;
+        attr.bp_len = length;
+        attr.sample_period = 1;
+        attr.sample_type = PERF_SAMPLE_IP | PERF_SAMPLE_TID;
+        attr.wakeup_events = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.inherit = 1;
+        for (int cpu : cpus) {
+            try {
+                events.emplace_back(attr, tid, cpu);
+            } catch (const runtime_error&) {
+                if (access(("/proc/" + to_string(pid) + "/task/" + to_string(tid)).c_str(), F_OK) != 0) {
+                    return;
+                }
+                throw;
+            }
+            watch_of_event.push_back(watch);
+        }
+    }
+
+    // Function to consume every record in the rings, returns the number of writes they report.
+    // The thread of the last sampled write of each watch is kept for its change.
+    size_t drain() {
+        size_t drained = 0;
+        for (size_t e = 0; e < events.size(); ++e) {
+            uint64_t lost_before = lost;
+            uint64_t count = events[e].drain(lost, &writers[watch_of_event[e]]);
+            samples += count - (lost - lost_before);
+            drained += count;
+        }
+        return drained;
+    }
+
+    pid_t pid = 0;
+    RunningTracee tracee;
+    vector<Watch> watches;
+    vector<int64_t> values;
+    vector<bool> armed;
+    vector<int> cpus;
+    vector<PerfRing> events;
+    vector<size_t> watch_of_event;
+    // Per watch, the thread of its last sampled write since the last position, 0 for none
+    vector<pid_t> writers;
+    // Changes found by arm(), the position next() returns first
+    vector<Change> pending;
+    uint64_t samples = 0;
+    uint64_t batches = 0;
+    uint64_t lost = 0;
+};
+
+unique_ptr<Backend> make_perf_backend() {
+    return make_unique<PerfBackend>();
+}
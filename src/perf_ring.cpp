@@ -0,0 +1,128 @@
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "perf_ring.hpp"
+
+using namespace std;
+
+static size_t page_size() {
+    static const size_t size = sysconf(_SC_PAGESIZE);
+    return size;
+}
+
+PerfRing::PerfRing(const perf_event_attr& attr, pid_t pid, int cpu, size_t pages) : ring_pages(pages) {
+    if (attr.sample_type & PERF_SAMPLE_TID) {
+        // Only the identifier and the ip come before them
+        tid_offset = sizeof(perf_event_header) + (attr.sample_type & PERF_SAMPLE_IDENTIFIER ? 8 : 0) +
+                     (attr.sample_type & PERF_SAMPLE_IP ? 8 : 0);
+    }
+    event_fd = syscall(SYS_perf_event_open, &attr, pid, cpu, -1, PERF_FLAG_FD_CLOEXEC);
+    if (event_fd < 0) {
+        throw runtime_error(string("perf_event_open failed: ") + strerror(errno) +
+                            (errno == ENOSPC && attr.type == PERF_TYPE_BREAKPOINT ? " (at most 4 breakpoints)" : ""));
+    }
+    ring = mmap(nullptr, (ring_pages + 1) * page_size(), PROT_READ | PROT_WRITE, MAP_SHARED, event_fd, 0);
+    if (ring == MAP_FAILED) {
+        int error = errno;
+        close(event_fd);
+        throw runtime_error(string("Could not map perf ring buffer: ") + strerror(error));
+    }
+}
+
+PerfRing::PerfRing(PerfRing&& other) noexcept
+    : event_fd(other.event_fd), ring(other.ring), ring_pages(other.ring_pages), tid_offset(other.tid_offset) {
+    other.event_fd = -1;
+    other.ring = nullptr;
+}
+
+PerfRing& PerfRing::operator=(PerfRing&& other) noexcept {
+    if (this != &other) {
+        close_event();
+        event_fd = other.event_fd;
+        ring = other.ring;
+        ring_pages = other.ring_pages;
+        tid_offset = other.tid_offset;
+        other.event_fd = -1;
+        other.ring = nullptr;
+    }
+    return *this;
+}
+
+PerfRing::~PerfRing() {
+    close_event();
+}
+
+void PerfRing::close_event() {
+    if (event_fd >= 0) {
+        munmap(ring, (ring_pages + 1) * page_size());
+        close(event_fd);
+        event_fd = -1;
+    }
+}
+
+vector<int> PerfRing::online_cpus() {
+    // A list of ranges like 0-3,6
+    ifstream in("/sys/devices/system/cpu/online");
+    string list;
+    vector<int> cpus;
+    if (in >> list) {
+        stringstream ss(list);
+        string range;
+        while (getline(ss, range, ',')) {
+            size_t dash = range.find('-');
+            int first = stoi(range.substr(0, dash));
+            int last = dash == string::npos ? first : stoi(range.substr(dash + 1));
+            for (int cpu = first; cpu <= last; ++cpu) {
+                cpus.push_back(cpu);
+            }
+        }
+    }
+    if (cpus.empty()) {
+        for (long cpu = 0; cpu < sysconf(_SC_NPROCESSORS_ONLN); ++cpu) {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+uint64_t PerfRing::drain(uint64_t& lost, pid_t* thread) {
+    auto* control = static_cast<perf_event_mmap_page*>(ring);
+    const char* data = static_cast<const char*>(ring) + page_size();
+    uint64_t size = ring_pages * page_size();
+    uint64_t head = __atomic_load_n(&control->data_head, __ATOMIC_ACQUIRE);
+    uint64_t tail = control->data_tail;
+    uint64_t drained = 0;
+    while (tail < head) {
+        perf_event_header header;
+        for (size_t i = 0; i < sizeof(header); ++i) {
+            reinterpret_cast<char*>(&header)[i] = data[(tail + i) % size];
+        }
+        if (header.type == PERF_RECORD_SAMPLE) {
+            ++drained;
+            if (thread != nullptr && tid_offset >= 0) {
+                // The tid follows the pid
+                uint32_t tid;
+                for (size_t i = 0; i < sizeof(tid); ++i) {
+                    reinterpret_cast<char*>(&tid)[i] = data[(tail + tid_offset + 4 + i) % size];
+                }
+                *thread = tid;
+            }
+        } else if (header.type == PERF_RECORD_LOST) {
+            uint64_t count;
+            for (size_t i = 0; i < sizeof(count); ++i) {
+                reinterpret_cast<char*>(&count)[i] = data[(tail + sizeof(header) + 8 + i) % size];
+            }
+            lost += count;
+            drained += count;
+        }
+        tail += header.size;
+    }
+    __atomic_store_n(&control->data_tail, tail, __ATOMIC_RELEASE);
+    return drained;
+}
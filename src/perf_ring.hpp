@@ -0,0 +1,44 @@
+#ifndef RV_PERF_RING_HPP
+#define RV_PERF_RING_HPP
+
+#include <cstdint>
+#include <vector>
+#include <linux/perf_event.h>
+#include <sys/types.h>
+
+// A perf event of one process sampling into its own mmap ring buffer. The records are consumed
+// from user space, so reading samples takes no system call. The kernel maps inherited events,
+// which follow the threads the process creates, only when they are bound to one CPU, so such
+// events get one ring per online CPU.
+class PerfRing {
+public:
+    // Function to open the event attr on pid (on cpu, -1 for all) and map its ring of pages
+    // data pages (a power of two), throws runtime_error on failure
+    PerfRing(const perf_event_attr& attr, pid_t pid, int cpu = -1, size_t pages = 16);
+    PerfRing(PerfRing&& other) noexcept;
+    PerfRing& operator=(PerfRing&& other) noexcept;
+    PerfRing(const PerfRing&) = delete;
+    PerfRing& operator=(const PerfRing&) = delete;
+    ~PerfRing();
+
+    int fd() const { return event_fd; }
+
+    // Function to get the numbers of the online CPUs
+    static std::vector<int> online_cpus();
+
+    // Function to consume every record, returns the number of samples including the lost ones,
+    // which are also added to lost. With thread set and PERF_SAMPLE_TID sampled, it is given the
+    // thread of the last sample, if there was one.
+    uint64_t drain(uint64_t& lost, pid_t* thread = nullptr);
+
+private:
+    void close_event();
+
+    int event_fd = -1;
+    void* ring = nullptr;
+    size_t ring_pages = 0;
+    // Offset of the pid and tid in a sample record, -1 if they are not sampled
+    int tid_offset = -1;
+};
+
+#endif // RV_PERF_RING_HPP
@@ -0,0 +1,175 @@
+#include <chrono>
+#include <iostream>
+#include "backend.hpp"
+#include "latency.hpp"
+#include "pipeline.hpp"
+
+using namespace std;
+
+mutex& output_lock() {
+    static mutex lock;
+    return lock;
+}
+
+Shard::Shard(const Property& property, size_t watch_count, string prefix, string name, bool verbose)
+    : property(property), monitor(property.formula, property.automaton), local_of(watch_count, UINT32_MAX),
+      prefix(move(prefix)), name(move(name)), verbose(verbose) {
+    for (uint32_t v = 0; v < property.watch_of.size(); ++v) {
+        local_of[property.watch_of[v]] = v;
+        all_watches |= 1ull << property.watch_of[v];
+    }
+}
+
+void Shard::start(const vector<int64_t>& values) {
+    for (uint32_t v = 0; v < property.watch_of.size(); ++v) {
+        monitor.set(v, values[property.watch_of[v]]);
+    }
+    Verdict verdict = monitor.step();
+    {
+        lock_guard<mutex> guard(output_lock());
+        cout << prefix << "Verdict" << (name.empty() ? "" : " of " + name) << " at step 1: " << verdict_name(verdict)
+             << endl;
+    }
+    publish();
+}
+
+void Shard::set(uint32_t watch, int64_t value, bool quiet) {
+    uint32_t variable = local_of[watch];
+    if (variable == UINT32_MAX) {
+        return;
+    }
+    uint64_t start = latency_clock();
+    monitor.set(variable, value);
+    record_latency(Stage::Evaluate, start);
+    moved |= !quiet && ((armed >> variable) & 1);
+}
+
+void Shard::end() {
+    if (moved) {
+        Verdict before = verdict();
+        uint64_t start = latency_clock();
+        Verdict next = monitor.step();
+        record_latency(Stage::Step, start);
+        if (next != before || verbose) {
+            lock_guard<mutex> guard(output_lock());
+            cout << prefix << "Verdict" << (name.empty() ? "" : " of " + name) << " at step " << monitor.steps()
+                 << ": " << verdict_name(next) << endl;
+        }
+        moved = false;
+        publish();
+    }
+    ended.fetch_add(1, memory_order_release);
+}
+
+void Shard::publish() {
+    armed = monitor.watched_variables();
+    uint64_t mask = 0;
+    for (uint32_t v = 0; v < property.watch_of.size(); ++v) {
+        if ((armed >> v) & 1) {
+            mask |= 1ull << property.watch_of[v];
+        }
+    }
+    watched_watches.store(mask, memory_order_release);
+    current_verdict.store((uint8_t)monitor.verdict(), memory_order_release);
+}
+
+Pipeline::Pipeline(const PipelineOptions& options) : options(options) {
+    for (size_t i = 0; i < options.workers; ++i) {
+        workers.push_back(make_unique<Worker>(options.capacity));
+    }
+    for (unique_ptr<Worker>& worker : workers) {
+        Worker* state = worker.get();
+        worker->thread = thread([this, state] { work(*state); });
+    }
+}
+
+Pipeline::~Pipeline() {
+    stopping.store(true);
+    for (unique_ptr<Worker>& worker : workers) {
+        {
+            lock_guard<mutex> guard(worker->lock);
+            worker->wake.notify_one();
+        }
+        worker->thread.join();
+    }
+}
+
+void Pipeline::add(Shard& shard, pid_t pid, size_t property) {
+    // Mixed, as consecutive pids would otherwise line up with the workers
+    uint64_t key = ((uint64_t)pid << 32 | property) * 0x9e3779b97f4a7c15ull;
+    shard.worker = (key >> 32) % workers.size();
+}
+
+bool Pipeline::push(Shard& shard, uint32_t watch, int64_t value, bool quiet, bool end) {
+    Worker& worker = *workers[shard.worker];
+    Record record{&shard, watch, quiet, end, value, latency_clock()};
+    if (!worker.queue.try_push(record)) {
+        if (options.drop) {
+            dropped.fetch_add(1, memory_order_relaxed);
+            return false;
+        }
+        // Backpressure: the tracee stays stopped until the worker makes room
+        waits.fetch_add(1, memory_order_relaxed);
+        do {
+            this_thread::yield();
+        } while (!worker.queue.try_push(record));
+    }
+    records.fetch_add(1, memory_order_relaxed);
+    if (end) {
+        positions.fetch_add(1, memory_order_relaxed);
+    }
+    size_t depth = worker.queue.depth();
+    size_t deepest_seen = deepest.load(memory_order_relaxed);
+    while (depth > deepest_seen && !deepest.compare_exchange_weak(deepest_seen, depth, memory_order_relaxed)) {
+    }
+    if (worker.sleeping.load()) {
+        lock_guard<mutex> guard(worker.lock);
+        worker.wake.notify_one();
+    }
+    return true;
+}
+
+void Pipeline::work(Worker& worker) {
+    block_tracer_signals();
+
+    Record record;
+    unsigned idle = 0;
+    for (;;) {
+        if (worker.queue.try_pop(record)) {
+            idle = 0;
+            record_latency(Stage::Queue, record.time);
+            record.shard->set(record.watch, record.value, record.quiet);
+            if (record.end) {
+                record.shard->end();
+            }
+            continue;
+        }
+        // Everything was pushed before stopping was set, so an empty queue stays empty
+        if (stopping.load()) {
+            if (worker.queue.depth() == 0) {
+                return;
+            }
+            continue;
+        }
+        // Spin a little for the next record of a burst, then sleep until a producer wakes it
+        if (++idle < 64) {
+            continue;
+        }
+        if (idle < 128) {
+            this_thread::yield();
+            continue;
+        }
+        unique_lock<mutex> guard(worker.lock);
+        worker.sleeping.store(true);
+        worker.wake.wait_for(guard, chrono::milliseconds(1),
+                             [&] { return worker.queue.depth() != 0 || stopping.load(); });
+        worker.sleeping.store(false);
+    }
+}
+
+void Pipeline::print_stats(ostream& out) const {
+    out << "pipeline: " << workers.size() << " workers, " << positions.load() << " positions in " << records.load()
+        << " records, deepest queue " << deepest.load() << " of "
+        << (workers.empty() ? 0 : workers.front()->queue.capacity()) << ", " << waits.load()
+        << " backpressure waits, " << dropped.load() << " dropped" << endl;
+}
@@ -0,0 +1,147 @@
+#ifndef RV_PIPELINE_HPP
+#define RV_PIPELINE_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/types.h>
+#include "ltl.hpp"
+#include "monitor.hpp"
+#include "mpsc_queue.hpp"
+
+// A formula of the run compiled to its monitor. Its variables are some of the watches of the
+// run, which all its processes share.
+struct Property {
+    Formula formula;
+    MonitorAutomaton automaton;
+    // Index among the watches of each variable of the formula
+    std::vector<uint32_t> watch_of;
+};
+
+// The monitor of one property in one process. The acquisition thread feeds it the changes of
+// the property's watches, position by position; they are applied by a worker thread of a
+// Pipeline, or inline without one. The monitor steps at a position only if a variable it
+// watched before it changed, as if the backend had armed exactly its own watches, so the extra
+// changes other properties need, or that arming all watches while it lags brings, do not
+// alter its trace.
+class Shard {
+public:
+    // Verdict lines start with prefix, name tells properties apart (empty for the only one)
+    Shard(const Property& property, size_t watch_count, std::string prefix, std::string name, bool verbose);
+
+    // Function to take the initial values (values[w] for watch w) as the first position
+    void start(const std::vector<int64_t>& values);
+
+    // Function to set watch to value, a watch of another property is ignored. Unless quiet, the
+    // change of a watched variable makes the position a step.
+    void set(uint32_t watch, int64_t value, bool quiet = false);
+
+    // Function to end a position
+    void end();
+
+    // Mask of the watches that can move the monitor, published to the acquisition thread,
+    // and of all watches of the property
+    uint64_t watched() const { return watched_watches.load(std::memory_order_acquire); }
+    uint64_t watches() const { return all_watches; }
+
+    // Positions ended, and sent by the acquisition thread; equal once the worker caught up
+    uint64_t done() const { return ended.load(std::memory_order_acquire); }
+    uint64_t sent = 0;
+    // A dropped position left its changes half applied, the next one carries every watch
+    bool resync = false;
+    // Worker of the pipeline that owns it
+    size_t worker = 0;
+
+    Verdict verdict() const { return (Verdict)current_verdict.load(std::memory_order_acquire); }
+    uint64_t steps() const { return monitor.steps(); }
+    const std::string& label() const { return name; }
+
+private:
+    void publish();
+
+    const Property& property;
+    Monitor monitor;
+    std::vector<uint32_t> local_of;
+    uint64_t all_watches = 0;
+    uint64_t armed = 0;
+    bool moved = false;
+    std::string prefix;
+    std::string name;
+    bool verbose;
+    std::atomic<uint64_t> watched_watches{0};
+    std::atomic<uint64_t> ended{0};
+    std::atomic<uint8_t> current_verdict{0};
+};
+
+// Settings of the pipeline from the command line
+struct PipelineOptions {
+    size_t workers = 0;
+    // Records per worker queue
+    size_t capacity = 4096;
+    // Whether a full queue drops the position instead of making the acquisition wait
+    bool drop = false;
+};
+
+// Worker threads that step the monitors of all shards, each shard on the worker its (process,
+// property) hashes to, so the positions of a shard stay in order while independent monitors
+// advance in parallel. Changes reach a worker through its lock-free MPSC queue, one record each.
+class Pipeline {
+public:
+    explicit Pipeline(const PipelineOptions& options);
+    Pipeline(const Pipeline&) = delete;
+    Pipeline& operator=(const Pipeline&) = delete;
+    // Function to let the workers finish their queues and join them
+    ~Pipeline();
+
+    // Function to assign a shard to the worker of (pid, property)
+    void add(Shard& shard, pid_t pid, size_t property);
+
+    // Function to queue a change of shard, see Shard::set, the last of its position if end is set.
+    // Returns false if the queue was full and the position is dropped.
+    bool push(Shard& shard, uint32_t watch, int64_t value, bool quiet, bool end);
+
+    // Function to print the counters of the queues
+    void print_stats(std::ostream& out) const;
+
+private:
+    struct Record {
+        Shard* shard;
+        uint32_t watch;
+        bool quiet;
+        bool end;
+        int64_t value;
+        // latency_clock() when it was pushed
+        uint64_t time;
+    };
+
+    struct Worker {
+        explicit Worker(size_t capacity) : queue(capacity) {}
+        MpscQueue<Record> queue;
+        std::atomic<bool> sleeping{false};
+        std::mutex lock;
+        std::condition_variable wake;
+        std::thread thread;
+    };
+
+    void work(Worker& worker);
+
+    PipelineOptions options;
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::atomic<bool> stopping{false};
+    std::atomic<uint64_t> positions{0};
+    std::atomic<uint64_t> records{0};
+    std::atomic<uint64_t> waits{0};
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<size_t> deepest{0};
+};
+
+// Function to get the lock that keeps the lines of the tracer and of the workers whole
+std::mutex& output_lock();
+
+#endif // RV_PIPELINE_HPP
@@ -0,0 +1,140 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <ostream>
+#include <stdexcept>
+#include <poll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include "backend.hpp"
+
+using namespace std;
+
+// Sampling backend: reads the armed watches on every tick of a timerfd with one
+// process_vm_readv over coalesced iovecs and reports the ones that changed. The tracee is
+// never trapped, and changes between two ticks merge into one position (a value that changes
+// and changes back is missed), which suits properties over slowly changing state.
+class SampleBackend : public Backend {
+public:
+    explicit SampleBackend(uint64_t interval_us) : interval_us(interval_us) {}
+
+    ~SampleBackend() override {
+        if (timer_fd >= 0) {
+            close(timer_fd);
+        }
+    }
+
+    const char* name() const override { return "sample"; }
+
+    void attach(pid_t pid, const vector<Watch>& watches) override {
+        this->pid = pid;
+        this->watches = watches;
+        timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+        if (timer_fd < 0) {
+            throw runtime_error(string("timerfd_create failed: ") + strerror(errno));
+        }
+        itimerspec period;
+        period.it_interval.tv_sec = interval_us / 1000000;
+        period.it_interval.tv_nsec = interval_us % 1000000 * 1000;
+        period.it_value = period.it_interval;
+        if (timerfd_settime(timer_fd, 0, &period, nullptr) != 0) {
+            throw runtime_error(string("timerfd_settime failed: ") + strerror(errno));
+        }
+        tracee.attach(pid);
+        arm(vector<bool>(watches.size(), true));
+        tracee.resume();
+    }
+
+    void arm(const vector<bool>& armed) override {
+        armed_watches.clear();
+        for (size_t i = 0; i < watches.size(); ++i) {
+            if (armed[i]) {
+                armed_watches.push_back(watches[i]);
+            }
+        }
+        reader = ValueReader(armed_watches);
+        reader.read(pid, values);
+        most_armed = max(most_armed, armed_watches.size());
+        most_iovecs = max(most_iovecs, reader.iovec_count());
+    }
+
+    bool next(vector<Change>& changes) override {
+        if (tracee.exiting()) {
+            tracee.finish(status);
+            return false;
+        }
+
+        pollfd fds[2] = {{timer_fd, POLLIN, 0}, {tracee.fd(), POLLIN, 0}};
+        for (;;) {
+            if (poll(fds, 2, blocking ? -1 : 0) < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw runtime_error(string("poll failed: ") + strerror(errno));
+            }
+            if ((!blocking || (fds[1].revents & POLLIN)) && !tracee.handle_stops(status)) {
+                return false;
+            }
+            uint64_t ticks;
+            if (read(timer_fd, &ticks, sizeof(ticks)) == sizeof(ticks)) {
+                missed += ticks - 1;
+            } else if (!tracee.exiting()) {
+                if (!blocking) {
+                    return true;
+                }
+                continue;
+            }
+
+            // At the exit stop a last sample is taken, the next call finishes
+            ++samples;
+            if (reader.read(pid, current)) {
+                for (size_t i = 0; i < armed_watches.size(); ++i) {
+                    if (current[i] != values[i]) {
+                        changes.push_back({armed_watches[i].variable, current[i]});
+                    }
+                }
+                values.swap(current);
+            }
+            if (!changes.empty()) {
+                return true;
+            }
+            if (tracee.exiting()) {
+                return next(changes);
+            }
+        }
+    }
+
+    void detach() override {
+        tracee.detach();
+    }
+
+    vector<int> wait_fds() const override {
+        return {timer_fd};
+    }
+
+    void print_stats(ostream& out) const override {
+        out << "sample: " << samples << " samples every " << interval_us << " us, " << missed
+            << " ticks missed, up to " << most_iovecs << " iovecs for up to " << most_armed << " of "
+            << watches.size() << " watches" << endl;
+    }
+
+private:
+    pid_t pid = 0;
+    uint64_t interval_us;
+    int timer_fd = -1;
+    RunningTracee tracee;
+    vector<Watch> watches;
+    vector<Watch> armed_watches;
+    ValueReader reader;
+    vector<int64_t> values;
+    vector<int64_t> current;
+    uint64_t samples = 0;
+    uint64_t missed = 0;
+    // Largest read over the run, the armed watches change as the monitor moves
+    size_t most_armed = 0;
+    size_t most_iovecs = 0;
+};
+
+unique_ptr<Backend> make_sample_backend(uint64_t interval_us) {
+    return make_unique<SampleBackend>(interval_us);
+}
@@ -0,0 +1,276 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <sys/wait.h>
+#include "latency.hpp"
+#include "session.hpp"
+
+using namespace std;
+
+Session::Session(pid_t pid, bool child, unique_ptr<Backend> backend, vector<Watch> watches,
+                 const vector<Property>& properties, const SessionOptions& options, string prefix, Pipeline* pipeline)
+    : process(pid), child(child), capture(move(backend)), watches(move(watches)), options(options),
+      prefix(move(prefix)), pipeline(pipeline) {
+    for (size_t i = 0; i < properties.size(); ++i) {
+        string name = properties.size() > 1 ? "property " + to_string(i + 1) : "";
+        monitors.push_back(make_unique<Shard>(properties[i], this->watches.size(), this->prefix, name, options.verbose));
+    }
+}
+
+void Session::set_blocking(bool blocking) {
+    this->blocking = blocking;
+    capture->set_blocking(blocking);
+}
+
+void Session::record(unique_ptr<TraceWriter> writer) {
+    recorder = move(writer);
+}
+
+void Session::start() {
+    // The initial values are the first position of the trace, every change one more.
+    // They are read first, as some backends let the process run from attach on.
+    vector<int64_t> initial = read_values(process, watches);
+    if ((recorder || pipeline) && !capture->can_arm_all(watches)) {
+        throw runtime_error(string("The ") + capture->name() + " backend cannot arm all the watches at once, " +
+                            "which --record and --workers need; use another backend or fewer variables");
+    }
+    capture->attach(process, watches);
+    attached = true;
+    known.assign(watches.size(), 0);
+    for (const Watch& watch : watches) {
+        // No function has been called yet
+        known[watch.variable] = watch.kind == Watch::Value ? initial[watch.variable] : 0;
+    }
+    if (recorder) {
+        recorder->begin(known);
+    }
+    for (size_t i = 0; i < monitors.size(); ++i) {
+        monitors[i]->start(known);
+        if (pipeline) {
+            pipeline->add(*monitors[i], process, i);
+        }
+    }
+
+    // Only the variables that can move a monitor out of its current state stay armed;
+    // the others are read back before each step
+    all_watches = watches.size() == 64 ? UINT64_MAX : (1ull << watches.size()) - 1;
+    armed_watches = all_watches;
+}
+
+void Session::rearm() {
+    uint64_t wanted = 0;
+    for (const unique_ptr<Shard>& shard : monitors) {
+        // The mask of a lagging shard is of a state it may already have left
+        wanted |= shard->done() == shard->sent ? shard->watched() : shard->watches();
+    }
+    if (recorder) {
+        wanted = all_watches;
+    }
+    if (wanted == armed_watches) {
+        return;
+    }
+    vector<bool> armed(watches.size());
+    for (const Watch& watch : watches) {
+        armed[watch.variable] = (wanted >> watch.variable) & 1;
+    }
+    capture->arm(armed);
+    armed_watches = wanted;
+    ++arm_count;
+    if (options.verbose) {
+        lock_guard<mutex> guard(output_lock());
+        cout << prefix << "  armed:";
+        for (const Watch& watch : watches) {
+            if (armed[watch.variable]) {
+                cout << " " << watch.name;
+            }
+        }
+        cout << endl;
+    }
+}
+
+bool Session::settled() const {
+    return all_of(monitors.begin(), monitors.end(), [](const unique_ptr<Shard>& shard) {
+        return shard->done() == shard->sent && shard->watched() == 0;
+    });
+}
+
+void Session::deliver() {
+    for (unique_ptr<Shard>& shard : monitors) {
+        if (!pipeline) {
+            for (size_t i = 0; i < changes.size(); ++i) {
+                shard->set(changes[i].variable, changes[i].value, i >= reported);
+            }
+            shard->end();
+            ++shard->sent;
+            continue;
+        }
+        // A decided shard needs nothing more
+        if (shard->done() == shard->sent && shard->watched() == 0) {
+            continue;
+        }
+        // Only its own watches go to a shard's queue, a position without any is not sent
+        const Change* last = nullptr;
+        for (const Change& change : changes) {
+            if ((shard->watches() >> change.variable) & 1) {
+                last = &change;
+            }
+        }
+        if (!last) {
+            continue;
+        }
+        bool sent = true;
+        if (shard->resync) {
+            // The values of the dropped positions, as they are now
+            for (const Watch& watch : watches) {
+                if ((shard->watches() >> watch.variable) & 1) {
+                    sent = sent && pipeline->push(*shard, watch.variable, known[watch.variable], true, false);
+                }
+            }
+        }
+        for (const Change* change = changes.data(); sent && change <= last; ++change) {
+            if ((shard->watches() >> change->variable) & 1) {
+                sent = pipeline->push(*shard, change->variable, change->value, change >= changes.data() + reported,
+                                      change == last);
+            }
+        }
+        // What was queued of a dropped position is stepped with the next one
+        shard->resync = !sent;
+        if (sent) {
+            ++shard->sent;
+        }
+    }
+}
+
+bool Session::advance() {
+    if (done) {
+        return false;
+    }
+    while (!detached) {
+        // Once no change can move the monitors the rest of the run needs no tracing
+        if (options.detach_on_verdict && settled()) {
+            detach();
+            uint64_t steps = 0;
+            for (const unique_ptr<Shard>& shard : monitors) {
+                steps = max(steps, shard->steps());
+            }
+            lock_guard<mutex> guard(output_lock());
+            cout << prefix << "Verdict can no longer change, detached from the " << (child ? "child" : "process")
+                 << " at step " << steps << endl;
+            break;
+        }
+        rearm();
+        uint64_t capture_start = latency_clock();
+        if (!capture->next(changes)) {
+            exit_status = capture->exit_status();
+            done = true;
+            if (recorder) {
+                recorder->close();
+            }
+            return false;
+        }
+        if (changes.empty()) {
+            // Nothing ready yet
+            return true;
+        }
+        record_latency(Stage::Capture, capture_start);
+        uint64_t decode_start = latency_clock();
+        uint64_t time = recorder ? recorder->now() : 0;
+        for (const Change& change : changes) {
+            if (recorder) {
+                recorder->add({time, change.variable, change.thread, known[change.variable], change.value,
+                               &change == &changes.back()});
+            }
+            known[change.variable] = change.value;
+            if (options.verbose) {
+                lock_guard<mutex> guard(output_lock());
+                cout << prefix << "  " << watches[change.variable].name << " = " << change.value;
+                if (change.thread != 0) {
+                    cout << " (thread " << change.thread << ")";
+                }
+                cout << endl;
+            }
+        }
+        // The values read back were not seen written, they are set without making a step
+        reported = changes.size();
+        if (armed_watches != all_watches && try_read_values(process, watches, values)) {
+            for (const Watch& watch : watches) {
+                if (!((armed_watches >> watch.variable) & 1) && watch.kind == Watch::Value &&
+                    values[watch.variable] != known[watch.variable]) {
+                    changes.push_back({watch.variable, values[watch.variable]});
+                    known[watch.variable] = values[watch.variable];
+                }
+            }
+        }
+        record_latency(Stage::Decode, decode_start);
+        deliver();
+        changes.clear();
+    }
+
+    // A detached child is still reaped for its exit status, any other process runs on
+    if (child) {
+        pid_t reaped = waitpid(process, &exit_status, blocking ? 0 : WNOHANG);
+        if (reaped < 0) {
+            throw runtime_error(string("waitpid failed: ") + strerror(errno));
+        }
+        if (reaped == 0) {
+            return true;
+        }
+    }
+    done = true;
+    return false;
+}
+
+void Session::detach() {
+    if (!attached || detached || done) {
+        return;
+    }
+    detached = true;
+    capture->detach();
+    if (recorder) {
+        recorder->close();
+    }
+}
+
+void Session::drain() const {
+    for (const unique_ptr<Shard>& shard : monitors) {
+        while (shard->done() != shard->sent) {
+            this_thread::yield();
+        }
+    }
+}
+
+void Session::report(ostream& out) const {
+    drain();
+    lock_guard<mutex> guard(output_lock());
+    if (detached && (!child || !done)) {
+        out << prefix << (child ? "Child " : "Process ") << process << " left running" << endl;
+    } else if (WIFSIGNALED(exit_status)) {
+        out << prefix << (child ? "Child" : "Process") << " killed by signal " << WTERMSIG(exit_status) << endl;
+    } else {
+        out << prefix << (child ? "Child" : "Process") << " exited with status " << WEXITSTATUS(exit_status) << endl;
+    }
+    for (const unique_ptr<Shard>& shard : monitors) {
+        out << prefix << "Final verdict" << (shard->label().empty() ? "" : " of " + shard->label()) << ": "
+            << verdict_name(shard->verdict()) << " after " << shard->steps() << " steps" << endl;
+    }
+    if (prefix.empty()) {
+        capture->print_stats(out);
+        if (recorder) {
+            recorder->print_stats(out);
+        }
+        return;
+    }
+    stringstream stats;
+    capture->print_stats(stats);
+    if (recorder) {
+        recorder->print_stats(stats);
+    }
+    string line;
+    while (getline(stats, line)) {
+        out << prefix << line << endl;
+    }
+}
@@ -0,0 +1,105 @@
+#ifndef RV_SESSION_HPP
+#define RV_SESSION_HPP
+
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+#include "backend.hpp"
+#include "ltl.hpp"
+#include "monitor.hpp"
+#include "pipeline.hpp"
+#include "trace_file.hpp"
+
+// Settings of the sessions from the command line
+struct SessionOptions {
+    bool verbose = false;
+    bool detach_on_verdict = false;
+};
+
+// The monitoring of one process: the backend capturing its writes, its watches at the addresses
+// of its own mappings and a shard per property over them. The properties are shared by all
+// sessions of a run and must outlive them, as must the pipeline that steps the shards if any.
+class Session {
+public:
+    // Session of process pid, stopped under ptrace and a child of the tool if child is set.
+    // Every line it prints starts with prefix. Without a pipeline the shards step on the calling
+    // thread.
+    Session(pid_t pid, bool child, std::unique_ptr<Backend> backend, std::vector<Watch> watches,
+            const std::vector<Property>& properties, const SessionOptions& options, std::string prefix = "",
+            Pipeline* pipeline = nullptr);
+
+    pid_t pid() const { return process; }
+    Backend& backend() { return *capture; }
+    const std::vector<std::unique_ptr<Shard>>& shards() const { return monitors; }
+    bool ended() const { return done; }
+
+    // Number of times the watches were rearmed, after which the backend may wait on other
+    // descriptors
+    uint64_t arms() const { return arm_count; }
+
+    // Function to let advance() return when the backend has nothing ready, see Backend::set_blocking
+    void set_blocking(bool blocking);
+
+    // Function to write every change to a trace file, before start(). All watches then stay
+    // armed, so that the trace holds every change of every variable.
+    void record(std::unique_ptr<TraceWriter> writer);
+
+    // Function to read the initial values, attach the backend and take the first step
+    void start();
+
+    // Function to step the monitor over the positions the backend has, or with blocking over the
+    // whole trace. Returns false once the trace has ended, by the exit of the process or by the
+    // detach of --detach-on-verdict.
+    bool advance();
+
+    // Function to remove the instrumentation of a started session and detach from the process,
+    // which runs on untraced; the trace ends at the positions stepped so far
+    void detach();
+
+    // Function to wait for the shards to step over every position sent to them
+    void drain() const;
+
+    // Function to print how the trace ended, the final verdicts and the counters of the backend,
+    // once the shards are drained
+    void report(std::ostream& out) const;
+
+private:
+    // Function to arm the watches that can move a shard, all of its watches while it lags behind
+    void rearm();
+
+    // Function to hand the changes of a position to the shards
+    void deliver();
+
+    // Function to tell whether no change can move any shard any more
+    bool settled() const;
+
+    pid_t process;
+    bool child;
+    std::unique_ptr<Backend> capture;
+    std::vector<Watch> watches;
+    std::vector<std::unique_ptr<Shard>> monitors;
+    SessionOptions options;
+    std::string prefix;
+    Pipeline* pipeline;
+    std::unique_ptr<TraceWriter> recorder;
+    bool blocking = true;
+
+    uint64_t all_watches = 0;
+    uint64_t armed_watches = 0;
+    uint64_t arm_count = 0;
+    std::vector<Change> changes;
+    // Changes of the position the backend reported, the rest were read back
+    size_t reported = 0;
+    std::vector<int64_t> values;
+    // Last value of every watch the shards were sent
+    std::vector<int64_t> known;
+    bool attached = false;
+    bool detached = false;
+    bool done = false;
+    int exit_status = 0;
+};
+
+#endif // RV_SESSION_HPP
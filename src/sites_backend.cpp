@@ -0,0 +1,205 @@
+#if defined(__x86_64__)
+
+#include <cerrno>
+#include <cstring>
+#include <map>
+#include <ostream>
+#include <stdexcept>
+#include <signal.h>
+#include <sys/ptrace.h>
+#include <sys/user.h>
+#include <sys/wait.h>
+#include "breakpoints.hpp"
+#include "store_sites.hpp"
+#include "symbols.hpp"
+
+using namespace std;
+
+// Software breakpoint backend: the executable of the tracee is disassembled once at attach, and
+// an int3 is planted on every instruction that provably stores to a watched variable. The tracee
+// runs at full speed and traps only on those stores, for any number of variables. After a trap
+// the original instruction is single-stepped and the breakpoint planted again. Stores whose
+// address the analysis could not resolve are counted in the stats, as they are missed here;
+// if there are any the program needs a backend that watches addresses instead. The call(f) and
+// ret(f) events are breakpoints of the same table. Breakpoints are in memory every thread
+// shares, so every thread of the tracee is followed.
+class SitesBackend : public Backend {
+public:
+    const char* name() const override { return "sites"; }
+
+    bool supports(Watch::Kind kind) const override {
+        return kind == Watch::Value || kind == Watch::Call || kind == Watch::Return;
+    }
+
+    void attach(pid_t pid, const vector<Watch>& watches) override {
+        this->pid = pid;
+        this->watches = watches;
+        threads.attach(pid);
+        breakpoints.attach(threads);
+        events.attach(threads, watches, breakpoints);
+        find_sites();
+        planted.assign(sites.size(), false);
+        arm(vector<bool>(watches.size(), true));
+    }
+
+    void arm(const vector<bool>& armed) override {
+        this->armed = armed;
+        values = read_values(pid, watches);
+        uint64_t mask = 0;
+        for (size_t i = 0; i < armed.size(); ++i) {
+            if (armed[i]) {
+                mask |= 1ull << i;
+            }
+        }
+        for (size_t i = 0; i < sites.size(); ++i) {
+            bool wanted = (sites[i].watches & mask) != 0;
+            if (wanted != planted[i]) {
+                if (wanted) {
+                    breakpoints.acquire(sites[i].address + bias);
+                } else {
+                    breakpoints.release(sites[i].address + bias);
+                }
+                planted[i] = wanted;
+            }
+        }
+        events.arm(armed);
+    }
+
+    bool next(vector<Change>& changes) override {
+        for (;;) {
+            if (!running) {
+                threads.resume(pending_signal);
+                pending_signal = 0;
+                running = true;
+            }
+            if (!threads.wait(status, blocking)) {
+                return false;
+            }
+            if (status == 0) {
+                return true;
+            }
+            running = false;
+            // The events of the last position end at the next stop
+            events.lower(changes);
+            size_t lowered = changes.size();
+            if (WSTOPSIG(status) != SIGTRAP) {
+                pending_signal = WSTOPSIG(status);
+                continue;
+            }
+            user_regs_struct regs;
+            if (ptrace(PTRACE_GETREGS, threads.current(), nullptr, &regs) != 0) {
+                throw runtime_error(string("PTRACE_GETREGS failed: ") + strerror(errno));
+            }
+            if (!breakpoints.hit(regs)) {
+                // Not ours, the tracee gets it
+                pending_signal = SIGTRAP;
+                continue;
+            }
+            // The events at a breakpoint and the store under it form one position
+            events.handle(regs, changes);
+            const size_t* site = site_at.find(regs.rip);
+            if (site != nullptr && planted[*site]) {
+                ++hits;
+            }
+            if (!breakpoints.step_over(regs, status, pending_signal)) {
+                return false;
+            }
+
+            // A store may leave the value unchanged, which is no new position
+            vector<int64_t> current = read_values(pid, watches);
+            for (size_t i = 0; i < watches.size(); ++i) {
+                if (armed[i] && watches[i].kind == Watch::Value && current[i] != values[i]) {
+                    changes.push_back({watches[i].variable, current[i], threads.current()});
+                }
+            }
+            values = move(current);
+            if (changes.size() > lowered) {
+                return true;
+            }
+        }
+    }
+
+    void detach() override {
+        threads.stop_all();
+        breakpoints.remove_all();
+        threads.detach(pending_signal);
+        pending_signal = 0;
+    }
+
+    void print_stats(ostream& out) const override {
+        out << "sites: " << sites.size() << " store sites, " << hits << " hits, " << unresolved.size()
+            << " unresolved stores";
+        if (!unresolved.empty()) {
+            map<string, size_t> per_function;
+            for (const UnresolvedStore& store : unresolved) {
+                ++per_function[store.function.empty() ? "(no function)" : store.function];
+            }
+            out << " in " << per_function.size() << " functions (";
+            size_t shown = 0;
+            for (const auto& entry : per_function) {
+                if (shown == 3) {
+                    out << ", ...";
+                    break;
+                }
+                out << (shown++ ? ", " : "") << entry.first;
+            }
+            out << "); their writes are missed, use another backend for them";
+        }
+        out << endl;
+        if (events.calls() != 0 || events.returns() != 0) {
+            out << "sites: " << events.calls() << " calls and " << events.returns() << " returns" << endl;
+        }
+        if (threads.followed() > 1) {
+            out << "sites: " << threads.followed() << " threads" << endl;
+        }
+    }
+
+private:
+    // Function to analyze the executable of the tracee and map its sites to run-time addresses
+    void find_sites() {
+        string exe = "/proc/" + to_string(pid) + "/exe";
+        ELFIO::elfio reader;
+        if (!reader.load_mapped(exe)) {
+            throw runtime_error("Could not load ELF file: " + exe);
+        }
+
+        bias = load_bias(pid, reader);
+        vector<pair<uint64_t, uint64_t>> ranges;
+        for (const Watch& watch : watches) {
+            if (watch.kind == Watch::Value) {
+                ranges.push_back({watch.address - bias, watch.address - bias + watch.size});
+            } else {
+                ranges.push_back({0, 0});
+            }
+        }
+        StoreSiteReport report = find_store_sites(reader, ranges);
+        sites = move(report.sites);
+        unresolved = move(report.unresolved);
+        for (size_t i = 0; i < sites.size(); ++i) {
+            site_at[sites[i].address + bias] = i;
+        }
+    }
+
+    pid_t pid = 0;
+    vector<Watch> watches;
+    vector<int64_t> values;
+    vector<bool> armed;
+    uint64_t bias = 0;
+    vector<StoreSite> sites;
+    vector<UnresolvedStore> unresolved;
+    Threads threads;
+    Breakpoints breakpoints;
+    FunctionEvents events;
+    PcMap<size_t> site_at;
+    vector<bool> planted;
+    int pending_signal = 0;
+    // Left running by a next() that returned without a stop
+    bool running = false;
+    uint64_t hits = 0;
+};
+
+unique_ptr<Backend> make_sites_backend() {
+    return make_unique<SitesBackend>();
+}
+
+#endif // __x86_64__
@@ -0,0 +1,143 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <signal.h>
+#include <sys/ptrace.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "backend.hpp"
+#include "threads.hpp"
+
+using namespace std;
+
+// Reference backend: single-steps the tracee and compares the watched variables after every
+// instruction. Exact but slow, every instruction costs two context switches and a read.
+// With no watch armed it simply continues the tracee. Only one thread is stepped, so a tracee
+// that has or starts more is refused rather than missing their writes.
+class StepBackend : public Backend {
+public:
+    const char* name() const override { return "step"; }
+
+    void attach(pid_t pid, const vector<Watch>& watches) override {
+        this->pid = pid;
+        this->watches = watches;
+        if (thread_ids(pid).size() > 1) {
+            throw runtime_error(threads_error);
+        }
+        // A thread the tracee starts stops it with a clone event instead of running unseen
+        if (ptrace(PTRACE_SETOPTIONS, pid, nullptr, (void*)PTRACE_O_TRACECLONE) != 0) {
+            throw runtime_error(string("PTRACE_SETOPTIONS failed: ") + strerror(errno));
+        }
+        reader = ValueReader(watches);
+        values = read_values(pid, watches);
+        armed.assign(watches.size(), true);
+    }
+
+    void arm(const vector<bool>& armed) override {
+        this->armed = armed;
+        values = read_values(pid, watches);
+    }
+
+    bool next(vector<Change>& changes) override {
+        // With nothing armed no change is reported, so the tracee runs on to its exit
+        bool stepping = find(armed.begin(), armed.end(), true) != armed.end();
+        for (;;) {
+            if (!running) {
+                if (ptrace(stepping ? PTRACE_SINGLESTEP : PTRACE_CONT, pid, nullptr, (void*)(long)pending_signal) != 0) {
+                    throw runtime_error(string("Resuming the tracee failed: ") + strerror(errno));
+                }
+                pending_signal = 0;
+                running = true;
+            }
+            pid_t stopped = wait_tracee(pid, &status, blocking ? 0 : WNOHANG);
+            if (stopped < 0) {
+                throw runtime_error(string("waitpid failed: ") + strerror(errno));
+            }
+            if (stopped == 0) {
+                return true;
+            }
+            running = false;
+            if (WIFEXITED(status) || WIFSIGNALED(status)) {
+                return false;
+            }
+            if (WIFSTOPPED(status) && WSTOPSIG(status) != SIGTRAP) {
+                // A signal for the tracee, delivered with the next step
+                pending_signal = WSTOPSIG(status);
+                continue;
+            }
+            if (status >> 8 == (SIGTRAP | (PTRACE_EVENT_CLONE << 8))) {
+                throw runtime_error(threads_error);
+            }
+
+            if (!reader.read(pid, current)) {
+                throw runtime_error("Tracee vanished while stopped");
+            }
+            for (size_t i = 0; i < watches.size(); ++i) {
+                if (armed[i] && current[i] != values[i]) {
+                    changes.push_back({watches[i].variable, current[i]});
+                }
+            }
+            if (!changes.empty()) {
+                values.swap(current);
+                return true;
+            }
+        }
+    }
+
+    void detach() override {
+        if (running && !stop()) {
+            return;
+        }
+        if (ptrace(PTRACE_DETACH, pid, nullptr, (void*)(long)pending_signal) != 0) {
+            throw runtime_error(string("PTRACE_DETACH failed: ") + strerror(errno));
+        }
+        pending_signal = 0;
+    }
+
+private:
+    static constexpr const char* threads_error =
+        "The tracee runs several threads, the step backend follows one; use --backend dr or sites";
+
+    // Function to stop the tracee resumed by a next() that did not wait. Returns false if it
+    // exited instead.
+    bool stop() {
+        syscall(SYS_tgkill, pid, pid, SIGSTOP);
+        for (;;) {
+            if (wait_tracee(pid, &status, 0) < 0) {
+                throw runtime_error(string("waitpid failed: ") + strerror(errno));
+            }
+            if (WIFEXITED(status) || WIFSIGNALED(status)) {
+                running = false;
+                return false;
+            }
+            if (WSTOPSIG(status) == SIGSTOP) {
+                // Swallowed by the detach
+                running = false;
+                return true;
+            }
+            // A step that ended first, or a signal the tracee gets once detached
+            if (WSTOPSIG(status) != SIGTRAP) {
+                pending_signal = WSTOPSIG(status);
+            }
+            if (ptrace(PTRACE_CONT, pid, nullptr, nullptr) != 0) {
+                throw runtime_error(string("PTRACE_CONT failed: ") + strerror(errno));
+            }
+        }
+    }
+
+    pid_t pid = 0;
+    vector<Watch> watches;
+    ValueReader reader;
+    vector<int64_t> values;
+    vector<int64_t> current;
+    vector<bool> armed;
+    int pending_signal = 0;
+    // Resumed and not yet stopped again, when next() returned without waiting
+    bool running = false;
+};
+
+unique_ptr<Backend> make_step_backend() {
+    return make_unique<StepBackend>();
+}
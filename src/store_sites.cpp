@@ -0,0 +1,1944 @@
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <stdexcept>
+#include <tuple>
+#include <unordered_set>
+#include "store_sites.hpp"
+
+using namespace std;
+
+namespace {
+
+// How control leaves an instruction
+enum class Flow : uint8_t {
+    Next,      // falls through
+    Branch,    // conditional direct branch to target, or falls through
+    Jump,      // unconditional direct jump to target
+    Call,      // returns to the next instruction with the caller-saved registers clobbered
+    Indirect,  // jump to a computed address
+    Return,
+    Stop,      // traps or is undefined
+};
+
+// How an instruction computes a register it writes
+enum class Op : uint8_t {
+    Unknown,
+    Constant,       // value
+    PcRelative,     // the address value
+    Copy,           // register a
+    AddImmediate,   // register a + value
+    AddRegisters,   // register a + register b
+    AddPc,          // register a + value, where value is the PC read by the instruction
+    Top,            // ARM movt: register with its upper half set to value
+};
+
+struct RegisterWrite {
+    uint8_t reg;
+    Op op;
+    uint8_t a;
+    uint8_t b;
+    int64_t value;
+};
+
+// Kind of the address an instruction stores to
+enum class Target : uint8_t {
+    None,        // no store
+    Absolute,    // address
+    PcRelative,  // address
+    Register,    // base register + displacement (+ index register when indexed)
+    Segment,     // x86 fs/gs relative, thread-local storage
+    Unknown,
+};
+
+// What an instruction does, as far as the analysis needs it
+struct Instruction {
+    uint64_t address = 0;
+    uint32_t length = 0;        // 0 if nothing could be decoded
+    Flow flow = Flow::Next;
+    uint64_t target = 0;        // of direct branches, jumps and calls
+    bool conditional = false;   // its register writes may not happen
+    bool clobbers_all = false;  // writes registers the decoder does not model
+    uint8_t it_length = 0;      // Thumb IT: number of conditional instructions that follow
+    uint8_t write_count = 0;
+    RegisterWrite writes[4];
+    Target store = Target::None;
+    uint8_t base = 0;
+    bool indexed = false;
+    bool exact = true;          // false if the displacement is not known exactly
+    int64_t address_value = 0;  // displacement, or the address for Absolute and PcRelative
+    uint64_t store_size = 0;
+
+    void write(uint8_t reg, Op op, int64_t value = 0, uint8_t a = 0, uint8_t b = 0) {
+        if (write_count < 4) {
+            writes[write_count++] = {reg, op, a, b, value};
+        } else {
+            clobbers_all = true;
+        }
+    }
+
+    void unknown(uint8_t reg) { write(reg, Op::Unknown); }
+
+    void store_to(Target kind, uint64_t size, int64_t value = 0, uint8_t base_register = 0) {
+        store = kind;
+        store_size = size;
+        address_value = value;
+        base = base_register;
+    }
+};
+
+// Contents of the allocated sections, for literal pools
+class Memory {
+public:
+    explicit Memory(const ELFIO::elfio& reader) : little_endian(reader.get_encoding() == ELFIO::ELFDATA2LSB) {
+        for (const auto& section : reader.sections) {
+            if ((section->get_flags() & ELFIO::SHF_ALLOC) && section->get_type() != ELFIO::SHT_NOBITS &&
+                section->get_data() != nullptr) {
+                ranges.push_back({section->get_address(), section->get_size(), section->get_data()});
+            }
+        }
+    }
+
+    const uint8_t* bytes(uint64_t address, uint64_t& available) const {
+        for (const Range& range : ranges) {
+            if (address >= range.address && address < range.address + range.size) {
+                available = range.address + range.size - address;
+                return reinterpret_cast<const uint8_t*>(range.data) + (address - range.address);
+            }
+        }
+        available = 0;
+        return nullptr;
+    }
+
+    bool read32(uint64_t address, uint32_t& value) const {
+        uint64_t available;
+        const uint8_t* p = bytes(address, available);
+        if (p == nullptr || available < 4 || !little_endian) {
+            return false;
+        }
+        value = p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+        return true;
+    }
+
+private:
+    struct Range {
+        uint64_t address;
+        uint64_t size;
+        const char* data;
+    };
+    bool little_endian;
+    vector<Range> ranges;
+};
+
+int64_t sign_extend(uint64_t value, int bits) {
+    uint64_t m = 1ull << (bits - 1);
+    value &= (bits == 64) ? ~0ull : ((1ull << bits) - 1);
+    return (int64_t)((value ^ m) - m);
+}
+
+uint64_t read_le(const uint8_t* p, size_t size) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < size; ++i) {
+        value |= (uint64_t)p[i] << (8 * i);
+    }
+    return value;
+}
+
+// ---- x86-64 ----
+
+// Immediate operands of the opcode maps
+enum Immediate : uint8_t { I_NONE, I_B, I_W, I_Z, I_V, I_MOFFS, I_ENTER, I_GROUP3, I_REL32 };
+
+bool one_byte_invalid(uint8_t op) {
+    switch (op) {
+    case 0x06: case 0x07: case 0x0e: case 0x16: case 0x17: case 0x1e: case 0x1f: case 0x27: case 0x2f:
+    case 0x37: case 0x3f: case 0x60: case 0x61: case 0x82: case 0x9a: case 0xce: case 0xd4: case 0xd5:
+    case 0xd6: case 0xea:
+        return true;
+    }
+    return false;
+}
+
+bool one_byte_modrm(uint8_t op) {
+    if (op < 0x40) {
+        return (op & 7) < 4;
+    }
+    switch (op) {
+    case 0x63: case 0x69: case 0x6b: case 0x80: case 0x81: case 0x83: case 0xc0: case 0xc1: case 0xc6:
+    case 0xc7: case 0xf6: case 0xf7: case 0xfe: case 0xff:
+        return true;
+    }
+    return (op >= 0x84 && op <= 0x8f) || (op >= 0xd0 && op <= 0xd3) || (op >= 0xd8 && op <= 0xdf);
+}
+
+Immediate one_byte_immediate(uint8_t op) {
+    if (op < 0x40) {
+        return (op & 7) == 4 ? I_B : (op & 7) == 5 ? I_Z : I_NONE;
+    }
+    if ((op >= 0x70 && op <= 0x7f) || (op >= 0xb0 && op <= 0xb7) || (op >= 0xe0 && op <= 0xe7)) {
+        return I_B;
+    }
+    if (op >= 0xb8 && op <= 0xbf) {
+        return I_V;
+    }
+    if (op >= 0xa0 && op <= 0xa3) {
+        return I_MOFFS;
+    }
+    switch (op) {
+    case 0x68: case 0x69: case 0x81: case 0xa9: case 0xc7:
+        return I_Z;
+    case 0x6a: case 0x6b: case 0x80: case 0x83: case 0xa8: case 0xc0: case 0xc1: case 0xc6: case 0xcd: case 0xeb:
+        return I_B;
+    case 0xc2: case 0xca:
+        return I_W;
+    case 0xc8:
+        return I_ENTER;
+    case 0xe8: case 0xe9:
+        return I_REL32;
+    case 0xf6: case 0xf7:
+        return I_GROUP3;
+    }
+    return I_NONE;
+}
+
+bool two_byte_invalid(uint8_t op) {
+    return op == 0x04 || op == 0x0a || op == 0x0c || (op >= 0x24 && op <= 0x27) || op == 0x36 || op == 0x39 ||
+           (op >= 0x3b && op <= 0x3f) || op == 0x7a || op == 0x7b || op == 0xa6 || op == 0xa7;
+}
+
+bool two_byte_modrm(uint8_t op) {
+    if (op <= 0x03 || op == 0x0d || op == 0x0f || (op >= 0x10 && op <= 0x2f) || (op >= 0x90 && op <= 0x9f) ||
+        (op >= 0xb0 && op <= 0xc7) || op >= 0xd0) {
+        return true;
+    }
+    if (op >= 0x40 && op <= 0x7f) {
+        return op != 0x77;
+    }
+    return op >= 0xa3 && op <= 0xaf && op != 0xa8 && op != 0xa9 && op != 0xaa;
+}
+
+Immediate two_byte_immediate(uint8_t op) {
+    if (op >= 0x80 && op <= 0x8f) {
+        return I_REL32;
+    }
+    switch (op) {
+    case 0x0f: case 0x70: case 0x71: case 0x72: case 0x73: case 0xa4: case 0xac: case 0xba: case 0xc2:
+    case 0xc4: case 0xc5: case 0xc6:
+        return I_B;
+    }
+    return I_NONE;
+}
+
+// The fields of a decoded x86-64 instruction
+struct X86 {
+    int map = 0;  // 0 one-byte, 1 0F, 2 0F38, 3 0F3A, 5 and 6 EVEX only
+    uint8_t op = 0;
+    bool vex = false;
+    bool evex = false;
+    int pp = 0;  // 0 none, 1 66, 2 F3, 3 F2
+    int vector_bytes = 16;
+    bool w = false;
+    int r = 0, x = 0, b = 0;
+    bool rex = false;
+    bool opsize16 = false;
+    bool addr32 = false;
+    bool segment = false;
+    bool rep = false;
+    bool modrm = false;
+    uint8_t mod = 3, reg = 0, rm = 0;
+    int64_t imm = 0;
+    uint64_t imm64 = 0;
+
+    uint8_t reg_reg() const { return reg | (r << 3); }
+    uint8_t rm_reg() const { return rm | (b << 3); }
+    bool memory() const { return modrm && mod != 3; }
+    uint32_t operand_size() const { return w ? 8 : opsize16 ? 2 : 4; }
+};
+
+// Function to record what an x86-64 instruction writes
+void describe_x86(const X86& d, const Instruction& operand, Instruction& insn) {
+    const bool memory = d.memory();
+    const uint8_t reg = d.reg_reg();
+    const uint8_t rm = d.rm_reg();
+    const uint32_t osize = d.operand_size();
+    const uint64_t next = insn.address + insn.length;
+
+    // A store to the ModRM memory operand
+    auto store = [&](uint64_t size) {
+        insn.store = operand.store;
+        insn.base = operand.base;
+        insn.indexed = operand.indexed;
+        insn.exact = operand.exact;
+        insn.address_value = operand.address_value;
+        insn.store_size = size;
+    };
+    // An instruction writing its r/m operand
+    auto write_rm = [&](uint64_t size) {
+        if (memory) {
+            store(size);
+        } else {
+            insn.unknown(rm);
+        }
+    };
+    auto unknown_instruction = [&]() {
+        insn.clobbers_all = true;
+        if (memory) {
+            store(64);
+        }
+    };
+
+    if (d.map == 0) {
+        uint8_t op = d.op;
+        if (op < 0x40) {
+            int alu = op >> 3;
+            int form = op & 7;
+            uint32_t size = (form & 1) ? osize : 1;
+            if (alu == 7) {
+                return;  // cmp
+            }
+            if (form <= 1) {
+                if (memory) {
+                    store(size);
+                } else if (alu == 6 && form == 1 && reg == rm) {
+                    insn.write(rm, Op::Constant, 0);
+                } else if (alu == 0 && form == 1 && d.w) {
+                    insn.write(rm, Op::AddRegisters, 0, rm, reg);
+                } else {
+                    insn.unknown(rm);
+                }
+            } else if (form <= 3) {
+                if (!memory && alu == 6 && form == 3 && reg == rm) {
+                    insn.write(reg, Op::Constant, 0);
+                } else {
+                    insn.unknown(reg);
+                }
+            } else {
+                insn.unknown(0);
+            }
+            return;
+        }
+        if (op >= 0x50 && op <= 0x57) {
+            return;
+        }
+        if (op >= 0x58 && op <= 0x5f) {
+            insn.unknown((op & 7) | (d.b << 3));
+            return;
+        }
+        if (op >= 0x70 && op <= 0x7f) {
+            insn.flow = Flow::Branch;
+            insn.target = next + d.imm;
+            return;
+        }
+        if (op >= 0x91 && op <= 0x97) {
+            insn.unknown(0);
+            insn.unknown((op & 7) | (d.b << 3));
+            return;
+        }
+        if (op >= 0xb0 && op <= 0xb7) {
+            insn.unknown(d.rex ? (op & 7) | (d.b << 3) : (op & 3));
+            return;
+        }
+        if (op >= 0xb8 && op <= 0xbf) {
+            uint8_t target = (op & 7) | (d.b << 3);
+            if (d.opsize16 && !d.w) {
+                insn.unknown(target);
+            } else {
+                insn.write(target, Op::Constant, d.w ? (int64_t)d.imm64 : (int64_t)(uint32_t)d.imm);
+            }
+            return;
+        }
+        if (op >= 0xd8 && op <= 0xdf) {
+            if (!memory) {
+                if (op == 0xdf && d.reg == 4) {
+                    insn.unknown(0);  // fnstsw ax
+                }
+                return;
+            }
+            static const uint8_t x87_store_sizes[8][8] = {
+                {0, 0, 0, 0, 0, 0, 0, 0},   {0, 0, 4, 4, 0, 0, 28, 2}, {0, 0, 0, 0, 0, 0, 0, 0},
+                {0, 4, 4, 4, 0, 0, 0, 10},  {0, 0, 0, 0, 0, 0, 0, 0},  {0, 8, 8, 8, 0, 0, 108, 2},
+                {0, 0, 0, 0, 0, 0, 0, 0},   {0, 2, 2, 2, 0, 0, 10, 8},
+            };
+            uint8_t size = x87_store_sizes[op - 0xd8][d.reg];
+            if (size != 0) {
+                store(size);
+            }
+            return;
+        }
+        switch (op) {
+        case 0x63: case 0x69: case 0x6b: case 0x8a:
+            insn.unknown(reg);
+            return;
+        case 0x68: case 0x6a: case 0x84: case 0x85: case 0x8e: case 0x9b: case 0x9c: case 0x9d: case 0x9e:
+        case 0xa8: case 0xa9: case 0xf5: case 0xf8: case 0xf9: case 0xfa: case 0xfb: case 0xfc: case 0xfd:
+            return;
+        case 0x80: case 0x81: case 0x83: {
+            if (d.reg == 7) {
+                return;
+            }
+            if (memory) {
+                store(op == 0x80 ? 1 : osize);
+            } else if (op != 0x80 && d.w && (d.reg == 0 || d.reg == 5)) {
+                insn.write(rm, Op::AddImmediate, d.reg == 0 ? d.imm : -d.imm, rm);
+            } else {
+                insn.unknown(rm);
+            }
+            return;
+        }
+        case 0x86: case 0x87:
+            write_rm(op == 0x86 ? 1 : osize);
+            insn.unknown(reg);
+            return;
+        case 0x88: case 0x89:
+            if (memory) {
+                store(op == 0x88 ? 1 : osize);
+            } else if (op == 0x89 && d.w) {
+                insn.write(rm, Op::Copy, 0, reg);
+            } else {
+                insn.unknown(rm);
+            }
+            return;
+        case 0x8b:
+            if (!memory && d.w) {
+                insn.write(reg, Op::Copy, 0, rm);
+            } else {
+                insn.unknown(reg);
+            }
+            return;
+        case 0x8c:
+            write_rm(2);
+            return;
+        case 0x8d:
+            if (!memory || !d.w || d.addr32) {
+                insn.unknown(reg);
+            } else if (operand.store == Target::PcRelative) {
+                insn.write(reg, Op::PcRelative, operand.address_value);
+            } else if (operand.store == Target::Register && !operand.indexed) {
+                insn.write(reg, Op::AddImmediate, operand.address_value, operand.base);
+            } else if (operand.store == Target::Absolute) {
+                insn.write(reg, Op::Constant, operand.address_value);
+            } else {
+                insn.unknown(reg);
+            }
+            return;
+        case 0x8f:
+            if (d.reg == 0) {
+                write_rm(8);
+            } else {
+                unknown_instruction();
+            }
+            return;
+        case 0x90:
+            if (d.b) {
+                insn.unknown(0);
+                insn.unknown(8);
+            }
+            return;
+        case 0x98: case 0x9f: case 0xa0: case 0xa1: case 0xd7: case 0xe4: case 0xe5: case 0xe6: case 0xe7:
+        case 0xec: case 0xed: case 0xee: case 0xef:
+            insn.unknown(0);
+            return;
+        case 0x99:
+            insn.unknown(2);
+            return;
+        case 0xa2: case 0xa3:
+            insn.store_to(d.segment ? Target::Segment : Target::Absolute, op == 0xa2 ? 1 : osize, (int64_t)d.imm64);
+            return;
+        case 0xa4: case 0xa5: case 0xaa: case 0xab: {
+            // movs and stos write at rdi, a whole block with rep
+            uint32_t size = (op & 1) ? osize : 1;
+            insn.store_to(d.segment ? Target::Segment : Target::Register, size, 0, 7);
+            insn.exact = !d.rep;
+            insn.unknown(7);
+            if (op <= 0xa5) {
+                insn.unknown(6);
+            }
+            if (d.rep) {
+                insn.unknown(1);
+            }
+            return;
+        }
+        case 0xa6: case 0xa7: case 0xac: case 0xad: case 0xae: case 0xaf:
+            insn.unknown(0);
+            insn.unknown(1);
+            insn.unknown(6);
+            insn.unknown(7);
+            return;
+        case 0xc0: case 0xc1: case 0xd0: case 0xd1: case 0xd2: case 0xd3:
+            write_rm((op & 1) ? osize : 1);
+            return;
+        case 0xc2: case 0xc3: case 0xca: case 0xcb: case 0xcf:
+            insn.flow = Flow::Return;
+            return;
+        case 0xc6: case 0xc7:
+            if (d.reg != 0) {
+                unknown_instruction();
+            } else if (memory) {
+                store(op == 0xc6 ? 1 : osize);
+            } else if (op == 0xc7 && !(d.opsize16 && !d.w)) {
+                insn.write(rm, Op::Constant, d.w ? d.imm : (int64_t)(uint32_t)d.imm);
+            } else {
+                insn.unknown(rm);
+            }
+            return;
+        case 0xc8: case 0xc9:
+            insn.unknown(5);
+            return;
+        case 0xcc: case 0xf4:
+            insn.flow = Flow::Stop;
+            return;
+        case 0xe0: case 0xe1: case 0xe2: case 0xe3:
+            insn.flow = Flow::Branch;
+            insn.target = next + d.imm;
+            if (op != 0xe3) {
+                insn.unknown(1);
+            }
+            return;
+        case 0xe8:
+            insn.flow = Flow::Call;
+            insn.target = next + d.imm;
+            return;
+        case 0xe9: case 0xeb:
+            insn.flow = Flow::Jump;
+            insn.target = next + d.imm;
+            return;
+        case 0xf6: case 0xf7:
+            if (d.reg == 2 || d.reg == 3) {
+                write_rm(op == 0xf6 ? 1 : osize);
+            } else if (d.reg >= 4) {
+                insn.unknown(0);
+                insn.unknown(2);
+            }
+            return;
+        case 0xfe: case 0xff:
+            if (d.reg <= 1) {
+                write_rm(op == 0xfe ? 1 : osize);
+            } else if (op == 0xff && (d.reg == 2 || d.reg == 3)) {
+                insn.flow = Flow::Call;
+            } else if (op == 0xff && (d.reg == 4 || d.reg == 5)) {
+                insn.flow = Flow::Indirect;
+            } else if (op != 0xff || d.reg != 6) {
+                unknown_instruction();
+            }
+            return;
+        }
+        unknown_instruction();
+        return;
+    }
+
+    const uint8_t op = d.op;
+    const uint64_t vector_size = d.vector_bytes;
+
+    if (d.map == 1) {
+        if (op >= 0x80 && op <= 0x8f) {
+            insn.flow = Flow::Branch;
+            insn.target = next + d.imm;
+            return;
+        }
+        if (op >= 0x40 && op <= 0x4f && !d.vex) {
+            insn.unknown(reg);
+            return;
+        }
+        if (op >= 0x90 && op <= 0x9f && !d.vex) {
+            write_rm(1);
+            return;
+        }
+        if (op >= 0xc8 && op <= 0xcf && !d.vex) {
+            insn.unknown((op & 7) | (d.b << 3));
+            return;
+        }
+        switch (op) {
+        case 0x11:
+            if (memory) {
+                store(d.vex ? vector_size : d.pp == 2 ? 4 : d.pp == 3 ? 8 : 16);
+            }
+            return;
+        case 0x13: case 0x17: case 0xd6:
+            if (memory && (op != 0xd6 || d.pp == 1)) {
+                store(8);
+            }
+            return;
+        case 0x29: case 0x2b: case 0x7f: case 0xe7:
+            if (memory) {
+                store(vector_size);
+            }
+            return;
+        case 0x7e:
+            if (d.pp != 2) {
+                write_rm(d.w ? 8 : 4);
+            }
+            return;
+        case 0x2c: case 0x2d: case 0x50: case 0xc5: case 0xd7:
+            insn.unknown(reg);
+            return;
+        case 0xae:
+            if (d.vex) {
+                if (memory && d.reg == 3) {
+                    store(4);
+                }
+            } else if (memory) {
+                static const uint16_t sizes[8] = {512, 0, 0, 4, 4096, 0, 4096, 0};
+                if (sizes[d.reg] != 0) {
+                    store(sizes[d.reg]);
+                }
+            } else if (d.pp == 2) {
+                insn.unknown(rm);  // rdfsbase and friends
+            }
+            return;
+        }
+        if (d.vex) {
+            if (op == 0x91 && memory) {
+                store(8);  // kmov to memory
+            } else if (op == 0x93) {
+                insn.unknown(reg);
+            } else if (d.evex && op >= 0x90 && op <= 0x93) {
+                unknown_instruction();
+            }
+            return;
+        }
+        switch (op) {
+        case 0x00:
+            if (d.reg <= 1) {
+                write_rm(2);
+            }
+            return;
+        case 0x02: case 0x03: case 0xaf: case 0xb2: case 0xb4: case 0xb5: case 0xb6: case 0xb7: case 0xb8:
+        case 0xbc: case 0xbd: case 0xbe: case 0xbf:
+            insn.unknown(reg);
+            return;
+        case 0x05:
+            insn.unknown(0);
+            insn.unknown(1);
+            insn.unknown(11);
+            return;
+        case 0x0b: case 0xb9: case 0xff:
+            insn.flow = Flow::Stop;
+            return;
+        case 0x20: case 0x21:
+            insn.unknown(rm);
+            return;
+        case 0x31: case 0x32: case 0x33:
+            insn.unknown(0);
+            insn.unknown(2);
+            return;
+        case 0xa2:
+            for (uint8_t r = 0; r < 4; ++r) {
+                insn.unknown(r);
+            }
+            return;
+        case 0xa4: case 0xa5: case 0xab: case 0xac: case 0xad: case 0xb3: case 0xbb:
+            write_rm(osize);
+            return;
+        case 0xba:
+            if (d.reg >= 5) {
+                write_rm(osize);
+            }
+            return;
+        case 0xb0: case 0xb1:
+            write_rm(op == 0xb0 ? 1 : osize);
+            insn.unknown(0);
+            return;
+        case 0xc0: case 0xc1:
+            write_rm(op == 0xc0 ? 1 : osize);
+            insn.unknown(reg);
+            return;
+        case 0xc3:
+            if (memory) {
+                store(osize);
+            }
+            return;
+        case 0xc7:
+            if (memory && d.reg == 1) {
+                store(d.w ? 16 : 8);
+                insn.unknown(0);
+                insn.unknown(2);
+            } else if (memory && (d.reg == 4 || d.reg == 5)) {
+                store(4096);
+            } else if (!memory && d.reg >= 6) {
+                insn.unknown(rm);
+            } else if (!(memory && d.reg == 3)) {
+                unknown_instruction();
+            }
+            return;
+        case 0xf7:
+            // maskmovq writes at rdi
+            insn.store_to(Target::Register, 16, 0, 7);
+            return;
+        case 0x01: case 0x07: case 0x34: case 0x35: case 0x78: case 0x79:
+            unknown_instruction();
+            return;
+        }
+        // The remaining opcodes write vector registers, flags or nothing
+        return;
+    }
+
+    if (d.map == 2) {
+        if (!d.vex) {
+            if (op == 0xf1 && d.pp != 3 && memory) {
+                store(osize);  // movbe to memory
+            } else if (op >= 0xf0 && op <= 0xf7) {
+                insn.unknown(reg);
+            } else if (op >= 0xf8) {
+                unknown_instruction();
+                insn.store_to(Target::Unknown, 64);
+            }
+            return;
+        }
+        if (op >= 0xf0 || (op >= 0xa0 && op <= 0xa3)) {
+            unknown_instruction();
+            if (op <= 0xa3) {
+                insn.store_to(Target::Unknown, 64);  // scatter
+            }
+        } else if (((op == 0x2e || op == 0x2f || op == 0x8e) && !d.evex) ||
+                   (d.evex && (op == 0x8a || op == 0x8b || op == 0x63 ||
+                               (d.pp == 2 && ((op >= 0x10 && op <= 0x15) || (op >= 0x20 && op <= 0x25) ||
+                                              (op >= 0x30 && op <= 0x35)))))) {
+            if (memory) {
+                store(vector_size);
+            }
+        }
+        return;
+    }
+
+    if (d.map == 3) {
+        if (op >= 0x14 && op <= 0x17) {
+            static const uint8_t sizes[4] = {1, 2, 4, 4};
+            write_rm(op == 0x16 && d.w ? 8 : sizes[op - 0x14]);
+        } else if (op >= 0x60 && op <= 0x63) {
+            insn.unknown(1);
+        } else if (d.vex && (op == 0x19 || op == 0x1b || op == 0x1d || op == 0x39 || op == 0x3b)) {
+            if (memory) {
+                store(32);
+            }
+        } else if (d.vex && op == 0xf0) {
+            insn.unknown(reg);
+        }
+        return;
+    }
+
+    unknown_instruction();
+}
+
+// Function to decode the x86-64 instruction at code, returns a zero length if it is invalid
+Instruction decode_x86_64(const uint8_t* code, size_t available, uint64_t address) {
+    Instruction insn;
+    insn.address = address;
+    const size_t limit = min<size_t>(available, 15);
+    X86 d;
+    size_t i = 0;
+
+    for (; i < limit; ++i) {
+        uint8_t p = code[i];
+        if (p == 0x66) {
+            d.opsize16 = true;
+            if (d.pp == 0) {
+                d.pp = 1;
+            }
+        } else if (p == 0x67) {
+            d.addr32 = true;
+        } else if (p == 0xf2 || p == 0xf3) {
+            d.rep = true;
+            d.pp = p == 0xf3 ? 2 : 3;
+        } else if (p == 0x64 || p == 0x65) {
+            d.segment = true;
+        } else if (p != 0xf0 && p != 0x2e && p != 0x36 && p != 0x3e && p != 0x26) {
+            break;
+        }
+    }
+    if (i < limit && (code[i] & 0xf0) == 0x40) {
+        uint8_t rex = code[i++];
+        d.rex = true;
+        d.w = rex & 8;
+        d.r = (rex >> 2) & 1;
+        d.x = (rex >> 1) & 1;
+        d.b = rex & 1;
+    }
+    if (i >= limit) {
+        return insn;
+    }
+
+    uint8_t op = code[i++];
+    bool modrm;
+    Immediate immediate;
+    if (op == 0xc4 || op == 0xc5 || op == 0x62) {
+        size_t payload = op == 0xc5 ? 1 : op == 0xc4 ? 2 : 3;
+        if (d.rex || i + payload >= limit) {
+            return insn;
+        }
+        const uint8_t* p = code + i;
+        d.vex = true;
+        d.r = !(p[0] >> 7);
+        if (op == 0xc5) {
+            d.map = 1;
+            d.pp = p[0] & 3;
+            d.vector_bytes = (p[0] & 4) ? 32 : 16;
+        } else {
+            d.x = !((p[0] >> 6) & 1);
+            d.b = !((p[0] >> 5) & 1);
+            d.map = op == 0xc4 ? (p[0] & 0x1f) : (p[0] & 7);
+            d.w = p[1] >> 7;
+            d.pp = p[1] & 3;
+            if (op == 0xc4) {
+                d.vector_bytes = (p[1] & 4) ? 32 : 16;
+            } else {
+                d.evex = true;
+                d.vector_bytes = 16 << ((p[2] >> 5) & 3);
+            }
+        }
+        i += payload;
+        d.op = code[i++];
+        if (d.map < 1 || d.map > 6 || d.map == 4) {
+            return insn;
+        }
+        modrm = !(d.map == 1 && d.op == 0x77);
+        immediate = (d.map == 3 || (d.map == 1 && ((d.op >= 0x70 && d.op <= 0x73) || d.op == 0xc2 ||
+                                                   (d.op >= 0xc4 && d.op <= 0xc6)))) ? I_B : I_NONE;
+    } else if (op == 0x0f) {
+        if (i >= limit) {
+            return insn;
+        }
+        op = code[i++];
+        if (op == 0x38 || op == 0x3a) {
+            if (i >= limit) {
+                return insn;
+            }
+            d.map = op == 0x38 ? 2 : 3;
+            d.op = code[i++];
+            modrm = true;
+            immediate = d.map == 3 ? I_B : I_NONE;
+        } else {
+            if (two_byte_invalid(op)) {
+                return insn;
+            }
+            d.map = 1;
+            d.op = op;
+            modrm = two_byte_modrm(op);
+            immediate = two_byte_immediate(op);
+        }
+    } else {
+        if (one_byte_invalid(op) || (op & 0xf0) == 0x40) {
+            return insn;
+        }
+        d.op = op;
+        modrm = one_byte_modrm(op);
+        immediate = one_byte_immediate(op);
+    }
+
+    // The memory operand is described in a scratch instruction, copied by stores that use it
+    Instruction operand;
+    d.modrm = modrm;
+    int64_t displacement = 0;
+    bool pc_relative = false;
+    if (modrm) {
+        if (i >= limit) {
+            return insn;
+        }
+        uint8_t m = code[i++];
+        d.mod = m >> 6;
+        d.reg = (m >> 3) & 7;
+        d.rm = m & 7;
+        if (d.mod != 3) {
+            size_t displacement_size = d.mod == 1 ? 1 : d.mod == 2 ? 4 : 0;
+            bool absolute = false;
+            uint8_t base = d.rm | (d.b << 3);
+            bool indexed = false;
+            if (d.rm == 4) {
+                if (i >= limit) {
+                    return insn;
+                }
+                uint8_t sib = code[i++];
+                indexed = (((sib >> 3) & 7) | (d.x << 3)) != 4;
+                base = (sib & 7) | (d.b << 3);
+                if ((sib & 7) == 5 && d.mod == 0) {
+                    absolute = true;
+                    displacement_size = 4;
+                }
+            } else if (d.rm == 5 && d.mod == 0) {
+                pc_relative = true;
+                displacement_size = 4;
+            }
+            if (i + displacement_size > limit) {
+                return insn;
+            }
+            displacement = sign_extend(read_le(code + i, displacement_size), displacement_size == 1 ? 8 : 32);
+            i += displacement_size;
+
+            if (d.segment) {
+                operand.store = Target::Segment;
+            } else if (d.addr32 || (absolute && indexed)) {
+                operand.store = Target::Unknown;
+            } else if (absolute) {
+                operand.store = Target::Absolute;
+                operand.address_value = displacement;
+            } else if (!pc_relative) {
+                operand.store = Target::Register;
+                operand.base = base;
+                operand.indexed = indexed;
+                operand.address_value = displacement;
+                // EVEX scales an 8-bit displacement by an operand-dependent factor
+                operand.exact = !(d.evex && d.mod == 1);
+            }
+        }
+    }
+
+    size_t immediate_size = 0;
+    switch (immediate) {
+    case I_NONE: break;
+    case I_B: immediate_size = 1; break;
+    case I_W: immediate_size = 2; break;
+    case I_Z: immediate_size = (d.opsize16 && !d.w) ? 2 : 4; break;
+    case I_V: immediate_size = d.w ? 8 : d.opsize16 ? 2 : 4; break;
+    case I_MOFFS: immediate_size = d.addr32 ? 4 : 8; break;
+    case I_ENTER: immediate_size = 3; break;
+    case I_GROUP3: immediate_size = d.reg >= 2 ? 0 : d.op == 0xf6 ? 1 : (d.opsize16 && !d.w) ? 2 : 4; break;
+    case I_REL32: immediate_size = 4; break;
+    }
+    if (i + immediate_size > limit) {
+        return insn;
+    }
+    d.imm64 = read_le(code + i, immediate_size);
+    d.imm = immediate_size == 0 || immediate_size == 8 || immediate == I_ENTER
+        ? (int64_t)d.imm64 : sign_extend(d.imm64, immediate_size * 8);
+    i += immediate_size;
+
+    insn.length = i;
+    if (pc_relative) {
+        operand.store = d.segment ? Target::Segment : d.addr32 ? Target::Unknown : Target::PcRelative;
+        operand.address_value = address + i + displacement;
+    }
+    describe_x86(d, operand, insn);
+    return insn;
+}
+
+// ---- ARM (A32) ----
+
+uint32_t rotate_right(uint32_t value, int amount) {
+    amount &= 31;
+    return amount == 0 ? value : (value >> amount) | (value << (32 - amount));
+}
+
+int popcount16(uint32_t value) {
+    return __builtin_popcount(value & 0xffff);
+}
+
+void unknown_list(Instruction& insn, uint32_t list) {
+    for (uint8_t r = 0; r < 15; ++r) {
+        if (list & (1u << r)) {
+            insn.unknown(r);
+        }
+    }
+}
+
+// Function to describe a coprocessor load/store or register transfer, shared by A32 and Thumb
+// (whose encodings agree in these fields)
+void describe_coprocessor(Instruction& insn, uint32_t high, uint32_t low, uint64_t pc) {
+    uint8_t rn = (high >> 0) & 15;
+    bool load = high & 0x10;
+    if ((high & 0x0e00) == 0x0c00) {
+        if ((high & 0x0fe0) == 0x0c40) {
+            // mcrr/mrrc: two core registers
+            if (load) {
+                insn.unknown(low >> 12);
+                insn.unknown(rn);
+            }
+            return;
+        }
+        bool p = high & 0x100, u = high & 0x80, w = high & 0x20;
+        int64_t bytes = (low & 0xff) * 4;
+        if (!load) {
+            uint64_t size = (p && !w) ? (((low >> 8) & 15) == 11 ? 8 : 4) : bytes;
+            int64_t displacement = p ? (u ? bytes : -bytes) : 0;
+            if (rn == 15) {
+                insn.store_to(Target::PcRelative, size, (int64_t)((pc & ~3ull) + displacement));
+            } else {
+                insn.store_to(Target::Register, size, displacement, rn);
+            }
+        }
+        if (w) {
+            insn.unknown(rn);
+        }
+    } else if ((high & 0x0f00) == 0x0e00 && (low & 0x10) && load) {
+        // mrc, vmov to a core register, vmrs
+        if ((low >> 12) != 15) {
+            insn.unknown(low >> 12);
+        }
+    }
+}
+
+Instruction decode_arm(const uint8_t* code, size_t available, uint64_t address, const Memory& memory) {
+    Instruction insn;
+    insn.address = address;
+    if (available < 4) {
+        return insn;
+    }
+    insn.length = 4;
+    const uint32_t w = read_le(code, 4);
+    const uint32_t cond = w >> 28;
+    const uint64_t pc = address + 8;
+    const uint8_t rn = (w >> 16) & 15;
+    const uint8_t rd = (w >> 12) & 15;
+
+    if (cond == 0xf) {
+        if ((w & 0x0e000000) == 0x0a000000) {
+            insn.flow = Flow::Call;  // blx to Thumb
+            insn.target = pc + (sign_extend(w & 0xffffff, 24) << 2) + ((w >> 23) & 2);
+        } else if ((w & 0xff100000) == 0xf4000000) {
+            insn.store_to(Target::Register, 64, 0, rn);  // vst1-4
+            insn.exact = false;
+            if ((w & 15) != 15) {
+                insn.unknown(rn);
+            }
+        } else if ((w & 0x0c000000) != 0x04000000 && (w & 0x0e000000) != 0x02000000) {
+            insn.clobbers_all = true;
+        }
+        return insn;
+    }
+    insn.conditional = cond != 0xe;
+    const uint32_t op = (w >> 25) & 7;
+    const uint32_t opcode = (w >> 21) & 15;
+    const bool s = w & (1 << 20);
+
+    switch (op) {
+    case 0:
+    case 1: {
+        if (op == 0 && (w & 0x90) == 0x90) {
+            if ((w & 0x60) == 0) {
+                if ((w & 0x0f800000) == 0x01800000) {
+                    // ldrex/strex
+                    if (s) {
+                        insn.unknown(rd);
+                        insn.unknown((rd + 1) & 15);
+                    } else {
+                        insn.store_to(Target::Register, 8, 0, rn);
+                        insn.unknown(rd);
+                    }
+                } else if ((w & 0x0fb00ff0) == 0x01000090) {
+                    insn.store_to(Target::Register, 4, 0, rn);  // swp
+                    insn.unknown(rd);
+                } else {
+                    insn.unknown(rn);  // multiplies write bits 19:16
+                    if (w & 0x00800000) {
+                        insn.unknown(rd);
+                    }
+                }
+                return insn;
+            }
+            // strh, ldrd, strd, ldrh, ldrsb, ldrsh
+            int op2 = (w >> 5) & 3;
+            bool p = w & (1 << 24), u = w & (1 << 23), writeback = w & (1 << 21), immediate = w & (1 << 22);
+            int64_t offset = immediate ? (((w >> 4) & 0xf0) | (w & 0xf)) : 0;
+            if (!u) {
+                offset = -offset;
+            }
+            if (!s && (op2 == 1 || op2 == 3)) {
+                uint64_t size = op2 == 1 ? 2 : 8;
+                if (rn == 15) {
+                    insn.store_to(Target::PcRelative, size, (int64_t)(pc + (p ? offset : 0)));
+                } else {
+                    insn.store_to(Target::Register, size, p ? offset : 0, rn);
+                    insn.indexed = !immediate;
+                }
+            } else {
+                insn.unknown(rd);
+                if (!s && op2 == 2) {
+                    insn.unknown((rd + 1) & 15);
+                }
+            }
+            if ((!p || writeback) && rn != 15) {
+                insn.unknown(rn);
+            }
+            return insn;
+        }
+        if ((opcode & 0xc) == 0x8 && !s) {
+            if (op == 1) {
+                uint32_t imm16 = ((w >> 4) & 0xf000) | (w & 0xfff);
+                if ((w & 0x0ff00000) == 0x03000000) {
+                    insn.write(rd, Op::Constant, imm16);
+                } else if ((w & 0x0ff00000) == 0x03400000) {
+                    insn.write(rd, Op::Top, imm16);
+                }
+                return insn;
+            }
+            if ((w & 0x0ffffff0) == 0x012fff10) {
+                insn.flow = (w & 15) == 14 ? Flow::Return : Flow::Indirect;  // bx
+            } else if ((w & 0x0ffffff0) == 0x012fff30) {
+                insn.flow = Flow::Call;  // blx register
+            } else if ((w & 0x0ff000f0) == 0x01200070) {
+                insn.flow = Flow::Stop;  // bkpt
+            } else if ((w & 0x0fff0ff0) == 0x016f0f10 || (w & 0x0fbf0fff) == 0x010f0000) {
+                insn.unknown(rd);  // clz, mrs
+            } else if ((w & 0x0fb0fff0) != 0x0120f000) {
+                insn.clobbers_all = true;
+            }
+            return insn;
+        }
+        if ((opcode & 0xc) == 0x8) {
+            return insn;  // tst, teq, cmp, cmn
+        }
+        if (rd == 15) {
+            insn.flow = (op == 0 && opcode == 13 && (w & 0xfff) == 14) ? Flow::Return : Flow::Indirect;
+            return insn;
+        }
+        if (op == 1) {
+            uint32_t imm = rotate_right(w & 0xff, 2 * ((w >> 8) & 15));
+            if (opcode == 4) {
+                insn.write(rd, rn == 15 ? Op::PcRelative : Op::AddImmediate, rn == 15 ? (int64_t)(pc + imm) : imm, rn);
+            } else if (opcode == 2) {
+                insn.write(rd, rn == 15 ? Op::PcRelative : Op::AddImmediate,
+                           rn == 15 ? (int64_t)(pc - imm) : -(int64_t)imm, rn);
+            } else if (opcode == 13) {
+                insn.write(rd, Op::Constant, imm);
+            } else if (opcode == 15) {
+                insn.write(rd, Op::Constant, (uint32_t)~imm);
+            } else {
+                insn.unknown(rd);
+            }
+            return insn;
+        }
+        uint8_t rm = w & 15;
+        bool plain = (w & 0xff0) == 0;
+        if (opcode == 13 && plain) {
+            if (rm == 15) {
+                insn.write(rd, Op::PcRelative, pc);
+            } else {
+                insn.write(rd, Op::Copy, 0, rm);
+            }
+        } else if (opcode == 4 && plain && (rn == 15) != (rm == 15)) {
+            insn.write(rd, Op::AddPc, pc, rn == 15 ? rm : rn);
+        } else if (opcode == 4 && plain && rn != 15) {
+            insn.write(rd, Op::AddRegisters, 0, rn, rm);
+        } else {
+            insn.unknown(rd);
+        }
+        return insn;
+    }
+    case 2:
+    case 3: {
+        if (op == 3 && (w & 0x10)) {
+            insn.clobbers_all = true;  // media instructions
+            return insn;
+        }
+        bool p = w & (1 << 24), u = w & (1 << 23), byte = w & (1 << 22), writeback = w & (1 << 21);
+        int64_t offset = op == 2 ? (u ? (int64_t)(w & 0xfff) : -(int64_t)(w & 0xfff)) : 0;
+        if (s) {
+            uint32_t value;
+            if (rd == 15) {
+                insn.flow = rn == 13 ? Flow::Return : Flow::Indirect;
+            } else if (rn == 15 && op == 2 && !byte && p && memory.read32(pc + offset, value)) {
+                insn.write(rd, Op::Constant, value);
+            } else {
+                insn.unknown(rd);
+            }
+        } else if (rn == 15) {
+            if (op == 2 && p) {
+                insn.store_to(Target::PcRelative, byte ? 1 : 4, (int64_t)(pc + offset));
+            } else {
+                insn.store_to(Target::Unknown, 4);
+            }
+        } else {
+            insn.store_to(Target::Register, byte ? 1 : 4, p ? offset : 0, rn);
+            insn.indexed = op == 3;
+        }
+        if ((!p || writeback) && rn != 15) {
+            insn.unknown(rn);
+        }
+        return insn;
+    }
+    case 4: {
+        uint32_t list = w & 0xffff;
+        int64_t bytes = 4 * popcount16(list);
+        bool p = w & (1 << 24), u = w & (1 << 23), writeback = w & (1 << 21);
+        if (s) {
+            unknown_list(insn, list);
+            if (list & 0x8000) {
+                insn.flow = rn == 13 ? Flow::Return : Flow::Indirect;
+            }
+        } else {
+            int64_t displacement = u ? (p ? 4 : 0) : (p ? -bytes : 4 - bytes);
+            insn.store_to(Target::Register, bytes, displacement, rn);
+        }
+        if (writeback) {
+            insn.unknown(rn);
+        }
+        return insn;
+    }
+    case 5:
+        insn.target = pc + (sign_extend(w & 0xffffff, 24) << 2);
+        insn.flow = (w & (1 << 24)) ? Flow::Call : insn.conditional ? Flow::Branch : Flow::Jump;
+        return insn;
+    case 6:
+        describe_coprocessor(insn, (w >> 16) & 0xfff, w & 0xffff, pc);
+        return insn;
+    default:
+        if (w & (1 << 24)) {
+            insn.clobbers_all = true;  // svc
+        } else {
+            describe_coprocessor(insn, (w >> 16) & 0xfff, w & 0xffff, pc);
+        }
+        return insn;
+    }
+}
+
+// ---- Thumb ----
+
+uint32_t thumb_expand_immediate(uint32_t imm12) {
+    uint32_t imm8 = imm12 & 0xff;
+    if ((imm12 & 0xc00) == 0) {
+        switch ((imm12 >> 8) & 3) {
+        case 0: return imm8;
+        case 1: return imm8 | (imm8 << 16);
+        case 2: return (imm8 << 8) | (imm8 << 24);
+        default: return imm8 | (imm8 << 8) | (imm8 << 16) | (imm8 << 24);
+        }
+    }
+    return rotate_right(0x80 | (imm12 & 0x7f), (imm12 >> 7) & 0x1f);
+}
+
+void decode_thumb32(Instruction& insn, uint32_t hw1, uint32_t hw2, const Memory& memory) {
+    const uint64_t pc = insn.address + 4;
+    const uint64_t aligned_pc = pc & ~3ull;
+    const uint32_t op1 = (hw1 >> 11) & 3;
+    const uint8_t rn = hw1 & 15;
+
+    if (op1 == 1) {
+        if ((hw1 & 0x0640) == 0x0000) {
+            // ldm/stm, push/pop
+            uint32_t op = (hw1 >> 7) & 3;
+            if (op == 0 || op == 3) {
+                insn.clobbers_all = true;
+                return;
+            }
+            int64_t bytes = 4 * popcount16(hw2);
+            if (hw1 & 0x10) {
+                unknown_list(insn, hw2);
+                if (hw2 & 0x8000) {
+                    insn.flow = rn == 13 ? Flow::Return : Flow::Indirect;
+                }
+            } else {
+                insn.store_to(Target::Register, bytes, op == 1 ? 0 : -bytes, rn);
+            }
+            if (hw1 & 0x20) {
+                insn.unknown(rn);
+            }
+        } else if ((hw1 & 0x0640) == 0x0040) {
+            // load/store dual and exclusive, table branch
+            uint32_t op1b = (hw1 >> 7) & 3, op2 = (hw1 >> 4) & 3;
+            if (op1b == 0 && op2 == 0) {
+                insn.store_to(Target::Register, 4, (hw2 & 0xff) * 4, rn);
+                insn.unknown((hw2 >> 8) & 15);
+            } else if (op1b == 0 && op2 == 1) {
+                insn.unknown(hw2 >> 12);
+            } else if (op1b == 1 && op2 == 0) {
+                insn.store_to(Target::Register, 8, 0, rn);
+                insn.unknown(hw2 & 15);
+            } else if (op1b == 1 && op2 == 1) {
+                if ((hw2 & 0xe0) == 0) {
+                    insn.flow = Flow::Indirect;  // tbb, tbh
+                } else {
+                    insn.unknown(hw2 >> 12);
+                    insn.unknown((hw2 >> 8) & 15);
+                }
+            } else {
+                bool p = hw1 & 0x100, u = hw1 & 0x80;
+                int64_t bytes = (hw2 & 0xff) * 4;
+                if (hw1 & 0x10) {
+                    insn.unknown(hw2 >> 12);
+                    insn.unknown((hw2 >> 8) & 15);
+                } else if (rn == 15) {
+                    insn.store_to(Target::Unknown, 8);
+                } else {
+                    insn.store_to(Target::Register, 8, p ? (u ? bytes : -bytes) : 0, rn);
+                }
+                if (hw1 & 0x20) {
+                    insn.unknown(rn);
+                }
+            }
+        } else if ((hw1 & 0x0600) == 0x0200) {
+            // data processing with a shifted register
+            uint32_t op = (hw1 >> 5) & 15;
+            uint8_t rd = (hw2 >> 8) & 15, rm = hw2 & 15;
+            bool plain = (hw2 & 0x70f0) == 0;
+            if (rd == 15 && (hw1 & 0x10) && (op == 0 || op == 4 || op == 8 || op == 13)) {
+                return;  // tst, teq, cmn, cmp
+            }
+            if (op == 2 && rn == 15 && plain) {
+                insn.write(rd, Op::Copy, 0, rm);
+            } else if (op == 8 && plain) {
+                insn.write(rd, Op::AddRegisters, 0, rn, rm);
+            } else {
+                insn.unknown(rd);
+            }
+        } else {
+            describe_coprocessor(insn, hw1 & 0xfff, hw2, pc);
+        }
+        return;
+    }
+
+    if (op1 == 2) {
+        uint8_t rd = (hw2 >> 8) & 15;
+        if (hw2 & 0x8000) {
+            uint32_t s = (hw1 >> 10) & 1, j1 = (hw2 >> 13) & 1, j2 = (hw2 >> 11) & 1;
+            if ((hw2 & 0x5000) == 0) {
+                if ((hw1 & 0x0380) != 0x0380) {
+                    uint32_t imm = (s << 20) | (j2 << 19) | (j1 << 18) | ((hw1 & 0x3f) << 12) | ((hw2 & 0x7ff) << 1);
+                    insn.flow = Flow::Branch;
+                    insn.target = pc + sign_extend(imm, 21);
+                } else if ((hw1 & 0x07e0) == 0x03e0) {
+                    insn.unknown(rd);  // mrs
+                } else if (hw1 == 0xf3de) {
+                    insn.flow = Flow::Return;  // subs pc, lr
+                }
+                return;
+            }
+            uint32_t i1 = !(j1 ^ s), i2 = !(j2 ^ s);
+            uint32_t imm = (s << 24) | (i1 << 23) | (i2 << 22) | ((hw1 & 0x3ff) << 12) | ((hw2 & 0x7ff) << 1);
+            if (hw2 & 0x1000) {
+                insn.flow = (hw2 & 0x4000) ? Flow::Call : Flow::Jump;
+                insn.target = pc + sign_extend(imm, 25);
+            } else {
+                insn.flow = Flow::Call;  // blx to ARM
+                insn.target = aligned_pc + sign_extend(imm & ~2u, 25);
+            }
+            return;
+        }
+        if (hw1 & 0x0200) {
+            // plain binary immediate
+            uint32_t op = (hw1 >> 4) & 0x1f;
+            uint32_t imm12 = ((hw1 & 0x0400) << 1) | ((hw2 >> 4) & 0x700) | (hw2 & 0xff);
+            uint32_t imm16 = ((hw1 & 15) << 12) | imm12;
+            if (op == 0x00) {
+                insn.write(rd, rn == 15 ? Op::PcRelative : Op::AddImmediate,
+                           rn == 15 ? (int64_t)(aligned_pc + imm12) : imm12, rn);
+            } else if (op == 0x0a) {
+                insn.write(rd, rn == 15 ? Op::PcRelative : Op::AddImmediate,
+                           rn == 15 ? (int64_t)(aligned_pc - imm12) : -(int64_t)imm12, rn);
+            } else if (op == 0x04) {
+                insn.write(rd, Op::Constant, imm16);
+            } else if (op == 0x0c) {
+                insn.write(rd, Op::Top, imm16);
+            } else {
+                insn.unknown(rd);
+            }
+            return;
+        }
+        // modified immediate
+        uint32_t op = (hw1 >> 5) & 15;
+        uint32_t imm = thumb_expand_immediate(((hw1 & 0x0400) << 1) | ((hw2 >> 4) & 0x700) | (hw2 & 0xff));
+        if (rd == 15 && (hw1 & 0x10) && (op == 0 || op == 4 || op == 8 || op == 13)) {
+            return;
+        }
+        if (op == 2 && rn == 15) {
+            insn.write(rd, Op::Constant, imm);
+        } else if (op == 3 && rn == 15) {
+            insn.write(rd, Op::Constant, (uint32_t)~imm);
+        } else if (op == 8) {
+            insn.write(rd, Op::AddImmediate, imm, rn);
+        } else if (op == 13) {
+            insn.write(rd, Op::AddImmediate, -(int64_t)imm, rn);
+        } else {
+            insn.unknown(rd);
+        }
+        return;
+    }
+
+    const uint32_t op2 = (hw1 >> 4) & 0x7f;
+    const uint8_t rt = hw2 >> 12;
+    if ((op2 & 0x71) == 0x00) {
+        // store single data item
+        static const uint8_t sizes[4] = {1, 2, 4, 0};
+        uint64_t size = sizes[(hw1 >> 5) & 3];
+        if (size == 0 || rn == 15) {
+            insn.clobbers_all = true;
+            return;
+        }
+        if (hw1 & 0x80) {
+            insn.store_to(Target::Register, size, hw2 & 0xfff, rn);
+        } else if (hw2 & 0x800) {
+            int64_t imm8 = hw2 & 0xff;
+            int64_t offset = (hw2 & 0x200) ? imm8 : -imm8;
+            insn.store_to(Target::Register, size, (hw2 & 0x400) ? offset : 0, rn);
+            if (hw2 & 0x100) {
+                insn.unknown(rn);
+            }
+        } else {
+            insn.store_to(Target::Register, size, 0, rn);
+            insn.indexed = true;
+        }
+    } else if ((op2 & 0x71) == 0x10) {
+        // advanced SIMD element or structure load/store
+        if (!(hw1 & 0x20)) {
+            insn.store_to(Target::Register, 64, 0, rn);
+            insn.exact = false;
+        }
+        if ((hw2 & 15) != 15) {
+            insn.unknown(rn);
+        }
+    } else if ((op2 & 0x67) == 0x01 || (op2 & 0x67) == 0x03 || (op2 & 0x67) == 0x05) {
+        bool word = (op2 & 0x67) == 0x05;
+        uint32_t value;
+        if (rt == 15) {
+            if (word) {
+                insn.flow = rn == 13 ? Flow::Return : Flow::Indirect;
+            }
+        } else if (rn == 15 && word &&
+                   memory.read32(aligned_pc + ((hw1 & 0x80) ? (int64_t)(hw2 & 0xfff) : -(int64_t)(hw2 & 0xfff)), value)) {
+            insn.write(rt, Op::Constant, value);
+        } else {
+            insn.unknown(rt);
+        }
+        if (rn != 15 && !(hw1 & 0x80) && (hw2 & 0x800) && (hw2 & 0x100)) {
+            insn.unknown(rn);
+        }
+    } else if ((op2 & 0x70) == 0x20 || (op2 & 0x78) == 0x30) {
+        insn.unknown((hw2 >> 8) & 15);  // data processing (register), multiply
+    } else if ((op2 & 0x78) == 0x38) {
+        insn.unknown(rt);  // long multiply and divide
+        insn.unknown((hw2 >> 8) & 15);
+    } else if (op2 & 0x40) {
+        describe_coprocessor(insn, hw1 & 0xfff, hw2, pc);
+    } else {
+        insn.clobbers_all = true;
+    }
+}
+
+Instruction decode_thumb(const uint8_t* code, size_t available, uint64_t address, const Memory& memory) {
+    Instruction insn;
+    insn.address = address;
+    if (available < 2) {
+        return insn;
+    }
+    const uint32_t hw1 = read_le(code, 2);
+    if ((hw1 >> 11) >= 0x1d) {
+        if (available < 4) {
+            return insn;
+        }
+        insn.length = 4;
+        decode_thumb32(insn, hw1, read_le(code + 2, 2), memory);
+        return insn;
+    }
+    insn.length = 2;
+    const uint64_t pc = address + 4;
+    const uint64_t aligned_pc = pc & ~3ull;
+    const uint8_t low = hw1 & 7;
+    const uint8_t middle = (hw1 >> 3) & 7;
+    const uint8_t high = (hw1 >> 8) & 7;
+    const uint32_t imm8 = hw1 & 0xff;
+    const uint32_t imm5 = (hw1 >> 6) & 0x1f;
+
+    switch (hw1 >> 11) {
+    case 0x00: case 0x01: case 0x02:
+        insn.unknown(low);  // shifts by an immediate
+        return insn;
+    case 0x03:
+        if (hw1 & 0x0400) {
+            int64_t imm3 = (hw1 >> 6) & 7;
+            insn.write(low, Op::AddImmediate, (hw1 & 0x0200) ? -imm3 : imm3, middle);
+        } else if (!(hw1 & 0x0200)) {
+            insn.write(low, Op::AddRegisters, 0, middle, (hw1 >> 6) & 7);
+        } else {
+            insn.unknown(low);
+        }
+        return insn;
+    case 0x04:
+        insn.write(high, Op::Constant, imm8);
+        return insn;
+    case 0x05:
+        return insn;  // cmp
+    case 0x06:
+        insn.write(high, Op::AddImmediate, imm8, high);
+        return insn;
+    case 0x07:
+        insn.write(high, Op::AddImmediate, -(int64_t)imm8, high);
+        return insn;
+    case 0x08:
+        if (!(hw1 & 0x0400)) {
+            uint32_t op = (hw1 >> 6) & 15;
+            if (op != 8 && op != 10 && op != 11) {
+                insn.unknown(low);
+            }
+        } else {
+            uint8_t rdn = low | ((hw1 >> 4) & 8);
+            uint8_t rm = (hw1 >> 3) & 15;
+            switch ((hw1 >> 8) & 3) {
+            case 0:
+                if (rdn == 15) {
+                    insn.flow = Flow::Indirect;
+                } else if (rm == 15) {
+                    insn.write(rdn, Op::AddPc, pc, rdn);
+                } else {
+                    insn.write(rdn, Op::AddRegisters, 0, rdn, rm);
+                }
+                break;
+            case 1:
+                break;
+            case 2:
+                if (rdn == 15) {
+                    insn.flow = rm == 14 ? Flow::Return : Flow::Indirect;
+                } else if (rm == 15) {
+                    insn.write(rdn, Op::PcRelative, pc);
+                } else {
+                    insn.write(rdn, Op::Copy, 0, rm);
+                }
+                break;
+            case 3:
+                insn.flow = (hw1 & 0x80) ? Flow::Call : rm == 14 ? Flow::Return : Flow::Indirect;
+                break;
+            }
+        }
+        return insn;
+    case 0x09: {
+        uint32_t value;
+        if (memory.read32(aligned_pc + imm8 * 4, value)) {
+            insn.write(high, Op::Constant, value);
+        } else {
+            insn.unknown(high);
+        }
+        return insn;
+    }
+    case 0x0a: case 0x0b: {
+        static const uint8_t sizes[3] = {4, 2, 1};
+        uint32_t op = (hw1 >> 9) & 7;
+        if (op <= 2) {
+            insn.store_to(Target::Register, sizes[op], 0, middle);
+            insn.indexed = true;
+        } else {
+            insn.unknown(low);
+        }
+        return insn;
+    }
+    case 0x0c: case 0x0d: case 0x0e: case 0x0f: case 0x10: case 0x11: {
+        bool load = hw1 & 0x0800;
+        uint32_t size = (hw1 >> 11) <= 0x0d ? 4 : (hw1 >> 11) <= 0x0f ? 1 : 2;
+        if (load) {
+            insn.unknown(low);
+        } else {
+            insn.store_to(Target::Register, size, imm5 * size, middle);
+        }
+        return insn;
+    }
+    case 0x12:
+        insn.store_to(Target::Register, 4, imm8 * 4, 13);
+        return insn;
+    case 0x13:
+        insn.unknown(high);
+        return insn;
+    case 0x14:
+        insn.write(high, Op::PcRelative, aligned_pc + imm8 * 4);
+        return insn;
+    case 0x15:
+        insn.write(high, Op::AddImmediate, imm8 * 4, 13);
+        return insn;
+    case 0x16: case 0x17:
+        if ((hw1 & 0xff00) == 0xb000 || (hw1 & 0xff00) == 0xb600 || (hw1 & 0xfe00) == 0xb400) {
+            return insn;  // sp adjustment, cps, push
+        }
+        if ((hw1 & 0xf500) == 0xb100) {
+            insn.flow = Flow::Branch;  // cbz, cbnz
+            insn.target = pc + ((((hw1 >> 9) & 1) << 6) | (((hw1 >> 3) & 0x1f) << 1));
+        } else if ((hw1 & 0xff00) == 0xb200 || (hw1 & 0xff00) == 0xba00) {
+            insn.unknown(low);  // extends, byte reversals
+        } else if ((hw1 & 0xfe00) == 0xbc00) {
+            unknown_list(insn, hw1 & 0xff);
+            if (hw1 & 0x100) {
+                insn.flow = Flow::Return;
+            }
+        } else if ((hw1 & 0xff00) == 0xbe00) {
+            insn.flow = Flow::Stop;
+        } else if ((hw1 & 0xff00) == 0xbf00) {
+            if (hw1 & 15) {
+                insn.it_length = 4 - __builtin_ctz(hw1 & 15);
+            }
+        } else {
+            insn.clobbers_all = true;
+        }
+        return insn;
+    case 0x18:
+        insn.store_to(Target::Register, 4 * popcount16(imm8), 0, high);
+        insn.unknown(high);
+        return insn;
+    case 0x19:
+        unknown_list(insn, imm8);
+        insn.unknown(high);
+        return insn;
+    case 0x1a: case 0x1b: {
+        uint32_t cond = (hw1 >> 8) & 15;
+        if (cond == 14) {
+            insn.flow = Flow::Stop;
+        } else if (cond == 15) {
+            insn.clobbers_all = true;
+        } else {
+            insn.flow = Flow::Branch;
+            insn.target = pc + (sign_extend(imm8, 8) << 1);
+        }
+        return insn;
+    }
+    default:
+        insn.flow = Flow::Jump;
+        insn.target = pc + (sign_extend(hw1 & 0x7ff, 11) << 1);
+        return insn;
+    }
+}
+
+// ---- analysis ----
+
+enum class Mode : uint8_t { X86_64, Arm, Thumb };
+
+struct Region {
+    uint64_t start;
+    uint64_t end;
+    Mode mode;
+    string function;
+};
+
+enum class Kind : uint8_t { Unknown, Constant, PcRelative, Stack };
+
+struct Value {
+    Kind kind = Kind::Unknown;
+    uint64_t value = 0;
+};
+
+class Analyzer {
+public:
+    Analyzer(const ELFIO::elfio& reader, const vector<pair<uint64_t, uint64_t>>& watched, StoreSiteReport& report)
+        : memory(reader), watched(watched), report(report), is_arm(reader.get_machine() == ELFIO::EM_ARM),
+          // Without relocations a position-independent image holds no absolute addresses
+          absolute_addresses(reader.get_type() == ELFIO::ET_EXEC) {}
+
+    void analyze(const Region& region) {
+        uint64_t available;
+        const uint8_t* bytes = memory.bytes(region.start, available);
+        if (bytes == nullptr) {
+            return;
+        }
+        uint64_t size = min(available, region.end - region.start);
+
+        vector<Instruction> code;
+        for (uint64_t offset = 0; offset < size;) {
+            uint64_t address = region.start + offset;
+            Instruction insn = region.mode == Mode::X86_64 ? decode_x86_64(bytes + offset, size - offset, address)
+                             : region.mode == Mode::Arm ? decode_arm(bytes + offset, size - offset, address, memory)
+                             : decode_thumb(bytes + offset, size - offset, address, memory);
+            if (insn.length == 0) {
+                uint32_t skip = region.mode == Mode::X86_64 ? 1 : region.mode == Mode::Arm ? 4 : 2;
+                skip = min<uint64_t>(skip, size - offset);
+                report.undecodable += skip;
+                insn.length = skip;
+                insn.flow = Flow::Stop;
+            } else {
+                ++report.instructions;
+            }
+            offset += insn.length;
+            code.push_back(insn);
+        }
+
+        // Branch targets start straight-line code, and Thumb IT blocks make instructions conditional
+        unordered_set<uint64_t> targets;
+        bool indirect = false;
+        for (size_t i = 0; i < code.size(); ++i) {
+            if (code[i].flow == Flow::Branch || code[i].flow == Flow::Jump) {
+                targets.insert(code[i].target);
+            }
+            indirect |= code[i].flow == Flow::Indirect;
+            for (size_t k = 1; k <= code[i].it_length && i + k < code.size(); ++k) {
+                code[i + k].conditional = true;
+            }
+        }
+
+        stack_pointer = region.mode == Mode::X86_64 ? 4 : 13;
+        frame_pointer = region.mode == Mode::X86_64 ? 5 : region.mode == Mode::Thumb ? 7 : 11;
+        frame = has_frame_pointer(code);
+
+        reset();
+        for (size_t i = 0; i < code.size(); ++i) {
+            const Instruction& insn = code[i];
+            // Jump tables can enter anywhere, so nothing is assumed across instructions
+            if (i > 0 && (indirect || targets.count(insn.address) ||
+                          (code[i - 1].flow != Flow::Next && code[i - 1].flow != Flow::Branch))) {
+                reset();
+            }
+            if (insn.store != Target::None) {
+                classify(insn, region);
+            }
+            apply(insn);
+        }
+    }
+
+private:
+    void reset() {
+        for (Value& value : registers) {
+            value = Value();
+        }
+        registers[stack_pointer].kind = Kind::Stack;
+        if (frame) {
+            registers[frame_pointer].kind = Kind::Stack;
+        }
+    }
+
+    // Function to decide whether the frame pointer holds a stack address throughout a function:
+    // it is set up from the stack pointer, and otherwise only moved within the stack or restored
+    // right before returning
+    bool has_frame_pointer(const vector<Instruction>& code) const {
+        bool set_up = false;
+        for (size_t i = 0; i < code.size(); ++i) {
+            const Instruction& insn = code[i];
+            bool returning = insn.flow == Flow::Return || (i + 1 < code.size() && code[i + 1].flow == Flow::Return);
+            if (insn.clobbers_all && !returning) {
+                return false;
+            }
+            for (size_t k = 0; k < insn.write_count; ++k) {
+                const RegisterWrite& w = insn.writes[k];
+                if (w.reg != frame_pointer) {
+                    continue;
+                }
+                if ((w.op == Op::Copy || w.op == Op::AddImmediate) && w.a == stack_pointer) {
+                    set_up = true;
+                } else if (!(w.op == Op::AddImmediate && w.a == frame_pointer) && !returning) {
+                    return false;
+                }
+            }
+        }
+        return set_up;
+    }
+
+    Value add(Value value, int64_t amount) const {
+        if (value.kind == Kind::Constant || value.kind == Kind::PcRelative) {
+            value.value = truncate(value.value + amount);
+        }
+        return value;
+    }
+
+    uint64_t truncate(uint64_t value) const {
+        return is_arm ? (value & 0xffffffffull) : value;
+    }
+
+    Value evaluate(const RegisterWrite& w) const {
+        switch (w.op) {
+        case Op::Unknown:
+            return Value();
+        case Op::Constant:
+            return {Kind::Constant, truncate(w.value)};
+        case Op::PcRelative:
+            return {Kind::PcRelative, truncate(w.value)};
+        case Op::Copy:
+            return registers[w.a];
+        case Op::AddImmediate:
+            return add(registers[w.a], w.value);
+        case Op::AddRegisters: {
+            Value a = registers[w.a], b = registers[w.b];
+            if (b.kind == Kind::Constant && a.kind != Kind::Unknown) {
+                return add(a, b.value);
+            }
+            if (a.kind == Kind::Constant && b.kind != Kind::Unknown) {
+                return add(b, a.value);
+            }
+            return Value();
+        }
+        case Op::AddPc:
+            if (registers[w.a].kind == Kind::Constant) {
+                return {Kind::PcRelative, truncate(registers[w.a].value + w.value)};
+            }
+            return Value();
+        case Op::Top:
+            if (registers[w.reg].kind == Kind::Constant) {
+                return {Kind::Constant, (registers[w.reg].value & 0xffff) | ((uint64_t)w.value << 16)};
+            }
+            return Value();
+        }
+        return Value();
+    }
+
+    void apply(const Instruction& insn) {
+        Value results[4];
+        for (size_t k = 0; k < insn.write_count; ++k) {
+            results[k] = insn.conditional ? Value() : evaluate(insn.writes[k]);
+        }
+        for (size_t k = 0; k < insn.write_count; ++k) {
+            registers[insn.writes[k].reg & 15] = results[k];
+        }
+        if (insn.clobbers_all || insn.flow == Flow::Call) {
+            reset();
+        }
+        registers[stack_pointer].kind = Kind::Stack;
+        if (frame) {
+            registers[frame_pointer].kind = Kind::Stack;
+        }
+    }
+
+    // Function to record a store as a site, an unresolved store, or neither
+    void classify(const Instruction& insn, const Region& region) {
+        Value target;
+        switch (insn.store) {
+        case Target::None:
+        case Target::Segment:
+            return;
+        case Target::Unknown:
+            break;
+        case Target::Absolute:
+            target = {Kind::Constant, truncate(insn.address_value)};
+            break;
+        case Target::PcRelative:
+            target = {Kind::PcRelative, truncate(insn.address_value)};
+            break;
+        case Target::Register: {
+            Value base = registers[insn.base & 15];
+            if (base.kind == Kind::Stack) {
+                return;
+            }
+            if (!insn.indexed && insn.exact) {
+                target = add(base, insn.address_value);
+            }
+            break;
+        }
+        }
+
+        if (target.kind == Kind::Stack) {
+            return;
+        }
+        if (target.kind == Kind::PcRelative || (target.kind == Kind::Constant && absolute_addresses)) {
+            uint64_t hits = 0;
+            for (size_t i = 0; i < watched.size(); ++i) {
+                if (target.value < watched[i].second && watched[i].first < target.value + insn.store_size) {
+                    hits |= 1ull << i;
+                }
+            }
+            if (hits != 0) {
+                report.sites.push_back({insn.address, target.value, insn.length, region.mode == Mode::Thumb, hits});
+            }
+            return;
+        }
+        report.unresolved.push_back({insn.address, region.function});
+    }
+
+    Memory memory;
+    const vector<pair<uint64_t, uint64_t>>& watched;
+    StoreSiteReport& report;
+    bool is_arm;
+    bool absolute_addresses;
+    uint8_t stack_pointer = 4;
+    uint8_t frame_pointer = 5;
+    bool frame = false;
+    Value registers[16];
+};
+
+struct CodeSymbol {
+    uint64_t address;
+    uint64_t size;
+    string name;
+};
+
+// Function to split the executable sections into functions and the gaps between them, and ARM
+// code further into its ARM, Thumb and data parts by mapping symbols
+vector<Region> code_regions(const ELFIO::elfio& reader) {
+    const bool arm = reader.get_machine() == ELFIO::EM_ARM;
+    // Functions per section index, and ARM mapping symbols ($a, $t, $d) per section index
+    map<ELFIO::Elf_Half, vector<CodeSymbol>> functions;
+    map<ELFIO::Elf_Half, vector<pair<uint64_t, char>>> mappings;
+
+    bool has_symtab = false;
+    for (const auto& section : reader.sections) {
+        has_symtab |= section->get_type() == ELFIO::SHT_SYMTAB;
+    }
+    for (const auto& section : reader.sections) {
+        if (section->get_type() != (has_symtab ? ELFIO::SHT_SYMTAB : ELFIO::SHT_DYNSYM)) {
+            continue;
+        }
+        ELFIO::const_symbol_section_accessor symbols(reader, section.get());
+        for (ELFIO::Elf_Xword i = 0; i < symbols.get_symbols_num(); ++i) {
+            string name;
+            ELFIO::Elf64_Addr value;
+            ELFIO::Elf_Xword size;
+            unsigned char bind, type, other;
+            ELFIO::Elf_Half index;
+            if (!symbols.get_symbol(i, name, value, size, bind, type, index, other) || index == ELFIO::SHN_UNDEF ||
+                index >= reader.sections.size()) {
+                continue;
+            }
+            if (arm && name.size() >= 2 && name[0] == '$' && (name[1] == 'a' || name[1] == 't' || name[1] == 'd') &&
+                (name.size() == 2 || name[2] == '.')) {
+                mappings[index].push_back({value, name[1]});
+            } else if (type == ELFIO::STT_FUNC && size > 0) {
+                functions[index].push_back({value, size, name});
+            }
+        }
+    }
+
+    vector<Region> regions;
+    for (const auto& section : reader.sections) {
+        if (!(section->get_flags() & ELFIO::SHF_EXECINSTR) || section->get_type() == ELFIO::SHT_NOBITS) {
+            continue;
+        }
+        uint64_t start = section->get_address(), end = start + section->get_size();
+        vector<CodeSymbol>& list = functions[section->get_index()];
+        for (CodeSymbol& f : list) {
+            f.address &= arm ? ~1ull : ~0ull;
+        }
+        sort(list.begin(), list.end(), [](const CodeSymbol& a, const CodeSymbol& b) { return a.address < b.address; });
+
+        // Functions and gaps, each byte in one piece
+        vector<tuple<uint64_t, uint64_t, string>> pieces;
+        uint64_t cursor = start;
+        for (const CodeSymbol& f : list) {
+            uint64_t f_start = max(f.address, cursor), f_end = min(f.address + f.size, end);
+            if (f_start >= f_end) {
+                continue;
+            }
+            if (f_start > cursor) {
+                pieces.emplace_back(cursor, f_start, "");
+            }
+            pieces.emplace_back(f_start, f_end, f.name);
+            cursor = f_end;
+        }
+        if (cursor < end) {
+            pieces.emplace_back(cursor, end, "");
+        }
+
+        if (!arm) {
+            for (auto& [piece_start, piece_end, name] : pieces) {
+                regions.push_back({piece_start, piece_end, Mode::X86_64, name});
+            }
+            continue;
+        }
+        vector<pair<uint64_t, char>>& marks = mappings[section->get_index()];
+        sort(marks.begin(), marks.end());
+        for (auto& [piece_start, piece_end, name] : pieces) {
+            // The mapping symbol in force at the start, then every one inside
+            auto it = upper_bound(marks.begin(), marks.end(), make_pair(piece_start, (char)127));
+            char kind = it == marks.begin() ? 'a' : prev(it)->second;
+            uint64_t from = piece_start;
+            for (;; ++it) {
+                uint64_t to = (it == marks.end() || it->first >= piece_end) ? piece_end : it->first;
+                if (to > from && kind != 'd') {
+                    regions.push_back({from, to, kind == 't' ? Mode::Thumb : Mode::Arm, name});
+                }
+                if (to == piece_end) {
+                    break;
+                }
+                kind = it->second;
+                from = to;
+            }
+        }
+    }
+    return regions;
+}
+
+} // namespace
+
+StoreSiteReport find_store_sites(const ELFIO::elfio& reader, const vector<pair<uint64_t, uint64_t>>& watched) {
+    if (watched.size() > 64) {
+        throw runtime_error("Store sites can be found for at most 64 variables");
+    }
+    StoreSiteReport report;
+    if (reader.get_machine() == ELFIO::EM_X86_64) {
+        report.architecture = "x86-64";
+    } else if (reader.get_machine() == ELFIO::EM_ARM) {
+        report.architecture = "arm";
+    } else {
+        throw runtime_error("Store sites can only be found in x86-64 and ARM executables");
+    }
+
+    Analyzer analyzer(reader, watched, report);
+    for (const Region& region : code_regions(reader)) {
+        analyzer.analyze(region);
+    }
+    return report;
+}
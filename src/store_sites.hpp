@@ -0,0 +1,43 @@
+#ifndef RV_STORE_SITES_HPP
+#define RV_STORE_SITES_HPP
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+#include "elfio/elfio.hpp"
+
+// A store instruction whose target is known statically and overlaps watched ranges. Addresses
+// are link-time addresses of the ELF file.
+struct StoreSite {
+    uint64_t address;
+    uint64_t target;   // first byte written
+    uint32_t length;   // of the instruction in bytes
+    bool thumb;        // ARM only: a Thumb instruction
+    uint64_t watches;  // bit i for each watched range i it overlaps
+};
+
+// A store whose target could not be resolved statically, so it may write a watched range
+struct UnresolvedStore {
+    uint64_t address;
+    std::string function;  // empty outside any function symbol
+};
+
+struct StoreSiteReport {
+    std::string architecture;
+    std::vector<StoreSite> sites;
+    std::vector<UnresolvedStore> unresolved;
+    uint64_t instructions = 0;
+    uint64_t undecodable = 0;  // bytes of code no instruction could be decoded at
+};
+
+// Function to find the store sites of the watched [start, end) link-time ranges (at most 64) in
+// the executable sections of an x86-64 or ARM ELF file. Each function is decoded on its own
+// (ARM and Thumb code told apart by mapping symbols); a store is resolved when its address is
+// absolute, PC-relative (RIP-relative, or built from a literal pool or movw/movt and the PC on
+// ARM) or a known register plus a displacement, with registers tracked within straight-line
+// code. Stores relative to the stack pointer or a frame pointer set up from it are stack stores
+// and never reported; every other store is unresolved. Throws runtime_error for other machines.
+StoreSiteReport find_store_sites(const ELFIO::elfio& reader, const std::vector<std::pair<uint64_t, uint64_t>>& watched);
+
+#endif // RV_STORE_SITES_HPP
@@ -0,0 +1,239 @@
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/ptrace.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "supervisor.hpp"
+#include "threads.hpp"
+
+using namespace std;
+
+// Tag of the signalfd in the epoll set; the others are the session index and the descriptor
+static const uint64_t signal_tag = UINT64_MAX;
+
+static uint64_t tag_of(size_t index, int fd) {
+    return (uint64_t)index << 32 | (uint32_t)fd;
+}
+
+Supervisor::Supervisor() {
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    sigprocmask(SIG_BLOCK, &mask, nullptr);
+    signal_fd = signalfd(-1, &mask, SFD_CLOEXEC | SFD_NONBLOCK);
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (signal_fd < 0 || epoll_fd < 0) {
+        throw runtime_error(string("Could not set up the event loop: ") + strerror(errno));
+    }
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.u64 = signal_tag;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, signal_fd, &event);
+}
+
+Supervisor::~Supervisor() {
+    for (const Entry& entry : entries) {
+        if (entry.live) {
+            close(entry.pidfd);
+        }
+    }
+    close(signal_fd);
+    close(epoll_fd);
+}
+
+void Supervisor::add(Session& session) {
+    int pidfd = syscall(SYS_pidfd_open, session.pid(), 0);
+    if (pidfd < 0) {
+        throw runtime_error("pidfd_open of process " + to_string(session.pid()) + " failed: " + strerror(errno));
+    }
+    size_t index = entries.size();
+    entries.push_back({&session, pidfd, {}, session.arms(), true});
+    by_pid[session.pid()] = index;
+    ++live;
+    session.set_blocking(false);
+
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.u64 = tag_of(index, pidfd);
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, pidfd, &event);
+    watch_fds(index);
+}
+
+void Supervisor::watch_fds(size_t index) {
+    Entry& entry = entries[index];
+    // Descriptors closed by the backend have left the set already
+    for (int fd : entry.fds) {
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+    }
+    entry.fds = entry.session->backend().wait_fds();
+    for (int fd : entry.fds) {
+        epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.u64 = tag_of(index, fd);
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event);
+    }
+}
+
+void Supervisor::end(size_t index) {
+    Entry& entry = entries[index];
+    for (int fd : entry.fds) {
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+    }
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, entry.pidfd, nullptr);
+    close(entry.pidfd);
+    entry.fds.clear();
+    entry.live = false;
+    --live;
+}
+
+void Supervisor::advance(size_t index) {
+    Entry& entry = entries[index];
+    bool running;
+    try {
+        running = entry.session->advance();
+    } catch (const exception& e) {
+        // Only this process is given up, with its instrumentation removed if it still can be
+        cerr << "Error in process " << entry.session->pid() << ": " << e.what() << endl;
+        try {
+            entry.session->detach();
+        } catch (const exception&) {
+        }
+        end(index);
+        return;
+    }
+    if (!running) {
+        end(index);
+        on_end(*entry.session);
+    } else if (entry.session->arms() != entry.arms) {
+        entry.arms = entry.session->arms();
+        watch_fds(index);
+    }
+}
+
+void Supervisor::detach_all() {
+    for (size_t index = 0; index < entries.size(); ++index) {
+        Entry& entry = entries[index];
+        if (!entry.live) {
+            continue;
+        }
+        try {
+            entry.session->detach();
+        } catch (const exception& e) {
+            cerr << "Error in process " << entry.session->pid() << ": " << e.what() << endl;
+        }
+        end(index);
+        on_end(*entry.session);
+    }
+}
+
+long Supervisor::owner(pid_t tid) {
+    auto found = by_pid.find(tid);
+    if (found != by_pid.end()) {
+        return found->second;
+    }
+    // Another thread of a process, found by its thread group
+    found = by_pid.find(thread_group(tid));
+    return found == by_pid.end() ? -1 : (long)found->second;
+}
+
+void Supervisor::route_stops() {
+    for (;;) {
+        siginfo_t info;
+        info.si_pid = 0;
+        // Ptrace stops are reported without WSTOPPED, which would add job control stops
+        if (waitid(P_ALL, 0, &info, WEXITED | WNOHANG | WNOWAIT | __WALL) != 0 || info.si_pid == 0) {
+            return;
+        }
+        long index = owner(info.si_pid);
+        if (index >= 0 && entries[index].live) {
+            advance(index);
+            continue;
+        }
+        // A thread no session follows: reaped if it exited, passed its signal if it stopped
+        int status;
+        if (wait_tracee(info.si_pid, &status, WNOHANG | __WALL) > 0 && WIFSTOPPED(status)) {
+            ptrace(PTRACE_CONT, info.si_pid, nullptr, (void*)(long)(WSTOPSIG(status) == SIGTRAP ? 0 : WSTOPSIG(status)));
+        }
+    }
+}
+
+void Supervisor::run(const function<void(Session&)>& ended) {
+    on_end = ended;
+
+    // Backends without descriptors for all their news are advanced every so often
+    int interval = -1;
+    for (const Entry& entry : entries) {
+        int wanted = entry.session->backend().poll_interval_ms();
+        if (wanted >= 0 && (interval < 0 || wanted < interval)) {
+            interval = wanted;
+        }
+    }
+    auto polled = chrono::steady_clock::now();
+
+    // The first advance resumes the processes
+    for (size_t index = 0; index < entries.size(); ++index) {
+        if (entries[index].live) {
+            advance(index);
+        }
+    }
+    vector<epoll_event> events(64);
+    while (live > 0) {
+        // Stops are looked for before every wait, so none waits on a SIGCHLD read elsewhere
+        route_stops();
+        if (live == 0) {
+            break;
+        }
+        int ready = epoll_wait(epoll_fd, events.data(), events.size(), interval);
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw runtime_error(string("epoll_wait failed: ") + strerror(errno));
+        }
+        for (int i = 0; i < ready; ++i) {
+            uint64_t tag = events[i].data.u64;
+            if (tag == signal_tag) {
+                signalfd_siginfo info;
+                while (read(signal_fd, &info, sizeof(info)) == sizeof(info)) {
+                    if (info.ssi_signo != SIGCHLD) {
+                        stop_signal = info.ssi_signo;
+                    }
+                }
+                continue;
+            }
+            size_t index = tag >> 32;
+            int fd = (int)(uint32_t)tag;
+            if (!entries[index].live) {
+                continue;
+            }
+            if ((events[i].events & (EPOLLHUP | EPOLLERR)) && fd != entries[index].pidfd) {
+                // The event of a thread that exited, which would wake every round
+                epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+            }
+            advance(index);
+        }
+        if (stop_signal != 0) {
+            detach_all();
+            return;
+        }
+        auto now = chrono::steady_clock::now();
+        if (interval >= 0 && now - polled >= chrono::milliseconds(interval)) {
+            polled = now;
+            for (size_t index = 0; index < entries.size(); ++index) {
+                if (entries[index].live && entries[index].session->backend().poll_interval_ms() >= 0) {
+                    advance(index);
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,68 @@
+#ifndef RV_SUPERVISOR_HPP
+#define RV_SUPERVISOR_HPP
+
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+#include <sys/types.h>
+#include "session.hpp"
+
+// One tracer for many monitored processes. The backends of its sessions do not block, and a
+// single epoll set holds what they wait on: a signalfd for SIGCHLD, which every ptrace stop
+// raises, a pidfd per process, readable at its exit even once it is no longer traced, and the
+// descriptors of the backends. Pending stops are peeked with waitid(WNOWAIT) and handed to the
+// session of the stopped thread, so an event costs the same however many processes there are.
+// SIGINT and SIGTERM come through the same signalfd, and end the run with every session
+// detached, so no breakpoint or debug register is left behind in a process.
+class Supervisor {
+public:
+    // SIGCHLD, SIGINT and SIGTERM are blocked from here on, before any session is started
+    Supervisor();
+    Supervisor(const Supervisor&) = delete;
+    Supervisor& operator=(const Supervisor&) = delete;
+    ~Supervisor();
+
+    // Function to supervise a started session, which must outlive run()
+    void add(Session& session);
+
+    // Function to advance the sessions as their processes have news until all have ended, calling
+    // ended(session) as each one does
+    void run(const std::function<void(Session&)>& ended);
+
+    // The SIGINT or SIGTERM that ended run() early, 0 if none did
+    int interrupted() const { return stop_signal; }
+
+private:
+    struct Entry {
+        Session* session;
+        int pidfd;
+        std::vector<int> fds;
+        uint64_t arms;
+        bool live;
+    };
+
+    // Function to advance one session, and to end it or watch its new descriptors
+    void advance(size_t index);
+    void watch_fds(size_t index);
+    void end(size_t index);
+
+    // Function to detach every session that is still live and end it
+    void detach_all();
+
+    // Function to hand every pending stop of a traced thread to its session
+    void route_stops();
+
+    // Function to find the session of a thread, -1 if none
+    long owner(pid_t tid);
+
+    int epoll_fd = -1;
+    int signal_fd = -1;
+    std::vector<Entry> entries;
+    std::unordered_map<pid_t, size_t> by_pid;
+    size_t live = 0;
+    int stop_signal = 0;
+    std::function<void(Session&)> on_end;
+};
+
+#endif // RV_SUPERVISOR_HPP
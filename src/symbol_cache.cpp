@@ -0,0 +1,274 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <stdexcept>
+#include <string_view>
+#include <unordered_set>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "symbol_cache.hpp"
+
+using namespace std;
+
+static const char index_magic[8] = {'R', 'V', 'S', 'Y', 'M', 'I', 'D', 'X'};
+static const uint32_t index_version = 1;
+
+// Layout of an index file: header, entries sorted by name, string table
+struct IndexHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t count;
+    uint64_t strings_size;
+};
+
+struct IndexEntry {
+    uint32_t name_offset;
+    uint32_t name_length;
+    uint64_t address;
+    uint64_t size;
+    uint32_t section_offset;
+    uint32_t is_function;
+};
+
+// Read-only mapping of an index file
+class SymbolIndex {
+public:
+    SymbolIndex() = default;
+    SymbolIndex(const SymbolIndex&) = delete;
+    SymbolIndex& operator=(const SymbolIndex&) = delete;
+    ~SymbolIndex() {
+        if (base != nullptr) {
+            munmap(base, length);
+        }
+    }
+
+    // Function to map an index file, returns false if it is missing or malformed
+    bool open(const string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(IndexHeader)) {
+            close(fd);
+            return false;
+        }
+        void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (p == MAP_FAILED) {
+            return false;
+        }
+        base = p;
+        length = st.st_size;
+
+        header = static_cast<const IndexHeader*>(base);
+        if (memcmp(header->magic, index_magic, sizeof(index_magic)) != 0 || header->version != index_version ||
+            sizeof(IndexHeader) + (uint64_t)header->count * sizeof(IndexEntry) + header->strings_size != length) {
+            return false;
+        }
+        entries = reinterpret_cast<const IndexEntry*>(header + 1);
+        strings = reinterpret_cast<const char*>(entries + header->count);
+        return true;
+    }
+
+    // Function to look a symbol up by binary search over the sorted entries
+    bool find(string_view name, SymbolInfo& info) const {
+        const IndexEntry* end = entries + header->count;
+        const IndexEntry* it = lower_bound(entries, end, name, [&](const IndexEntry& e, string_view n) {
+            return name_of(e) < n;
+        });
+        if (it == end || name_of(*it) != name || it->section_offset >= header->strings_size) {
+            return false;
+        }
+        info = {it->address, it->size, it->is_function ? "function" : "object", 
+                string(strings + it->section_offset, strnlen(strings + it->section_offset,
+                                                             header->strings_size - it->section_offset))};
+        return true;
+    }
+
+private:
+    string_view name_of(const IndexEntry& e) const {
+        if ((uint64_t)e.name_offset + e.name_length > header->strings_size) {
+            return {};
+        }
+        return string_view(strings + e.name_offset, e.name_length);
+    }
+
+    void* base = nullptr;
+    size_t length = 0;
+    const IndexHeader* header = nullptr;
+    const IndexEntry* entries = nullptr;
+    const char* strings = nullptr;
+};
+
+// Function to read the GNU build-id of the loaded file as a hex string, empty if it has none
+static string build_id_of(const ELFIO::elfio& reader) {
+    for (const auto& section_ptr : reader.sections) {
+        if (section_ptr->get_type() != ELFIO::SHT_NOTE) {
+            continue;
+        }
+        ELFIO::note_section_accessor notes(reader, section_ptr.get());
+        for (ELFIO::Elf_Word i = 0; i < notes.get_notes_num(); ++i) {
+            ELFIO::Elf_Word type;
+            string name;
+            char* desc;
+            ELFIO::Elf_Word desc_size;
+            if (notes.get_note(i, type, name, desc, desc_size) && type == ELFIO::NT_GNU_BUILD_ID &&
+                name == "GNU" && desc != nullptr) {
+                stringstream ss;
+                for (ELFIO::Elf_Word j = 0; j < desc_size; ++j) {
+                    ss << hex << setw(2) << setfill('0') << (unsigned)(unsigned char)desc[j];
+                }
+                return ss.str();
+            }
+        }
+    }
+    return "";
+}
+
+// Function to name the index file of an ELF file: its build-id, else its path, mtime and size
+static string index_name(const ELFIO::elfio& reader, const string& elf_file) {
+    string build_id = build_id_of(reader);
+    if (!build_id.empty()) {
+        return build_id + ".idx";
+    }
+
+    struct stat st;
+    char resolved[PATH_MAX];
+    if (stat(elf_file.c_str(), &st) != 0 || realpath(elf_file.c_str(), resolved) == nullptr) {
+        throw runtime_error("Could not stat ELF file: " + elf_file);
+    }
+
+    // FNV-1a keeps the file name short whatever the length of the path
+    uint64_t path_hash = 14695981039346656037ull;
+    for (const char* c = resolved; *c; ++c) {
+        path_hash = (path_hash ^ (unsigned char)*c) * 1099511628211ull;
+    }
+    stringstream ss;
+    ss << "path-" << hex << path_hash << dec << "-" << st.st_mtim.tv_sec << "." << st.st_mtim.tv_nsec
+       << "-" << st.st_size << ".idx";
+    return ss.str();
+}
+
+// Function to create a directory and its missing parents
+static bool make_directories(const string& path) {
+    for (size_t pos = 1; pos <= path.size(); ++pos) {
+        if (pos == path.size() || path[pos] == '/') {
+            string prefix = path.substr(0, pos);
+            if (mkdir(prefix.c_str(), 0755) != 0 && errno != EEXIST) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Function to write an index file. It is written under a temporary name and renamed, so
+// concurrent runs never map a partial index. Failing to write only costs the next run a rebuild.
+static void write_index(const string& directory, const string& path,
+                        const vector<pair<string, SymbolInfo>>& symbols) {
+    if (!make_directories(directory)) {
+        return;
+    }
+
+    vector<size_t> order(symbols.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        order[i] = i;
+    }
+    sort(order.begin(), order.end(), [&](size_t a, size_t b) { return symbols[a].first < symbols[b].first; });
+
+    string strings;
+    map<string, uint32_t> section_offsets;
+    vector<IndexEntry> entries;
+    entries.reserve(symbols.size());
+    for (size_t i : order) {
+        const auto& [name, info] = symbols[i];
+        auto section = section_offsets.find(info.section);
+        if (section == section_offsets.end()) {
+            section = section_offsets.emplace(info.section, (uint32_t)strings.size()).first;
+            strings.append(info.section).push_back('\0');
+        }
+        entries.push_back({(uint32_t)strings.size(), (uint32_t)name.size(), info.address, info.size,
+                           section->second, info.type == "function"});
+        strings.append(name);
+    }
+
+    IndexHeader header;
+    memcpy(header.magic, index_magic, sizeof(index_magic));
+    header.version = index_version;
+    header.count = entries.size();
+    header.strings_size = strings.size();
+
+    string temp_path = path + ".tmp." + to_string(getpid());
+    ofstream out(temp_path, ios::binary | ios::trunc);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(IndexEntry));
+    out.write(strings.data(), strings.size());
+    out.close();
+    if (!out || rename(temp_path.c_str(), path.c_str()) != 0) {
+        unlink(temp_path.c_str());
+    }
+}
+
+SymbolCache::SymbolCache(string directory) : directory(move(directory)) {}
+
+string SymbolCache::default_directory() {
+    if (const char* dir = getenv("RV_CACHE_DIR"); dir != nullptr && *dir) {
+        return dir;
+    }
+    if (const char* dir = getenv("XDG_CACHE_HOME"); dir != nullptr && *dir) {
+        return string(dir) + "/rv-tool";
+    }
+    if (const char* home = getenv("HOME"); home != nullptr && *home) {
+        return string(home) + "/.cache/rv-tool";
+    }
+    return "/tmp/rv-tool";
+}
+
+map<string, SymbolInfo> SymbolCache::find_addresses(const string& elf_file,
+                                                    const vector<string>& required_symbols) const {
+    ELFIO::elfio reader;
+    // Only the headers and the build-id note are touched here
+    if (!reader.load_mapped(elf_file)) {
+        throw runtime_error("Could not open ELF file: " + elf_file);
+    }
+
+    string path = directory + "/" + index_name(reader, elf_file);
+    map<string, SymbolInfo> symbol_map;
+
+    SymbolIndex index;
+    if (index.open(path)) {
+        for (const auto& sym : required_symbols) {
+            SymbolInfo info;
+            if (!index.find(sym, info)) {
+                throw runtime_error("Symbol not found: " + sym);
+            }
+            symbol_map[sym] = info;
+        }
+        return symbol_map;
+    }
+
+    vector<pair<string, SymbolInfo>> symbols = collect_symbols(reader);
+    write_index(directory, path, symbols);
+
+    unordered_set<string_view> wanted(required_symbols.begin(), required_symbols.end());
+    for (const auto& [name, info] : symbols) {
+        if (wanted.erase(name) != 0) {
+            symbol_map[name] = info;
+        }
+    }
+    for (const auto& sym : required_symbols) {
+        if (symbol_map.find(sym) == symbol_map.end()) {
+            throw runtime_error("Symbol not found: " + sym);
+        }
+    }
+    return symbol_map;
+}
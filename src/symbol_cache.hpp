@@ -0,0 +1,30 @@
+#ifndef RV_SYMBOL_CACHE_HPP
+#define RV_SYMBOL_CACHE_HPP
+
+#include <map>
+#include <string>
+#include <vector>
+#include "symbols.hpp"
+
+// On-disk cache of the symbol index of ELF files. Every binary gets one index file, named after
+// its GNU build-id or, when it has none, after its path, mtime and size. An index is a table of
+// (name, address, size, type, section) entries sorted by name that is mapped and binary searched,
+// so a cache hit only reads the ELF headers and the build-id note, never the symbol tables.
+class SymbolCache {
+public:
+    explicit SymbolCache(std::string directory);
+
+    // Function to resolve the required symbols like find_addresses, through the index of the
+    // file. A missing index is built from all symbols of the file and stored for later runs.
+    std::map<std::string, SymbolInfo> find_addresses(const std::string& elf_file,
+                                                     const std::vector<std::string>& required_symbols) const;
+
+    // Function to get the cache directory used when none is given: $RV_CACHE_DIR, else
+    // $XDG_CACHE_HOME/rv-tool, else ~/.cache/rv-tool
+    static std::string default_directory();
+
+private:
+    std::string directory;
+};
+
+#endif // RV_SYMBOL_CACHE_HPP
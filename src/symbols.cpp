@@ -0,0 +1,260 @@
+#include <iostream>
+#include <iomanip>
+#include <climits>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string_view>
+#include <unordered_set>
+#include <cstring>
+#include <unistd.h>
+#include "symbols.hpp"
+
+using namespace std;
+
+// Function to build the SymbolInfo entry of a symbol
+static SymbolInfo make_symbol_info(const ELFIO::elfio& reader, ELFIO::Elf64_Addr value, ELFIO::Elf_Xword size,
+                            unsigned char type, ELFIO::Elf_Half section_index) {
+    string section_name;
+    if (section_index == ELFIO::SHN_ABS) {
+        section_name = "ABS";
+    } else if (section_index == ELFIO::SHN_COMMON) {
+        section_name = "COMMON";
+    } else if (section_index < reader.sections.size()) {
+        section_name = reader.sections[section_index]->get_name();
+    }
+    return {value, size, (type == ELFIO::STT_FUNC) ? "function" : "object", section_name};
+}
+
+// Function to call visit(name, sym) for every named, defined entry of a raw symbol table, in
+// table order, until it returns false. Names are views into the string table, so no string is
+// allocated per symbol.
+template <class Sym, class Visit>
+void for_each_defined_symbol(const ELFIO::elfio& reader, const ELFIO::section* symtab, Visit visit) {
+    const auto& convertor = reader.get_convertor();
+    const char* data = symtab->get_data();
+    ELFIO::Elf_Xword entry_size = symtab->get_entry_size();
+    if (data == nullptr || entry_size < sizeof(Sym) || symtab->get_link() >= reader.sections.size()) {
+        return;
+    }
+
+    const ELFIO::section* strtab = reader.sections[symtab->get_link()];
+    const char* strings = strtab->get_data();
+    size_t strings_size = strtab->get_size();
+    if (strings == nullptr) {
+        return;
+    }
+
+    ELFIO::Elf_Xword count = symtab->get_size() / entry_size;
+    for (ELFIO::Elf_Xword i = 0; i < count; ++i) {
+        const Sym* sym = reinterpret_cast<const Sym*>(data + i * entry_size);
+        ELFIO::Elf_Half section_index = (*convertor)(sym->st_shndx);
+        ELFIO::Elf_Word name_offset = (*convertor)(sym->st_name);
+        // Undefined symbols only refer to a definition elsewhere
+        if (section_index == ELFIO::SHN_UNDEF || name_offset == 0 || name_offset >= strings_size) {
+            continue;
+        }
+
+        const char* name_ptr = strings + name_offset;
+        const char* name_end = static_cast<const char*>(memchr(name_ptr, '\0', strings_size - name_offset));
+        if (name_end == nullptr) {
+            continue;
+        }
+
+        if (!visit(string_view(name_ptr, name_end - name_ptr), sym)) {
+            return;
+        }
+    }
+}
+
+// Function to build the SymbolInfo entry of a raw symbol table entry
+template <class Sym>
+SymbolInfo make_symbol_info(const ELFIO::elfio& reader, const Sym* sym) {
+    const auto& convertor = reader.get_convertor();
+    return make_symbol_info(reader, (*convertor)(sym->st_value), (*convertor)(sym->st_size),
+                            ELF_ST_TYPE(sym->st_info), (*convertor)(sym->st_shndx));
+}
+
+// Function to scan a raw symbol table once, moving every defined symbol whose name is still
+// wanted into symbol_map. The scan stops as soon as nothing is left to find.
+template <class Sym>
+void scan_symbol_table(const ELFIO::elfio& reader, const ELFIO::section* symtab,
+                       unordered_set<string_view>& wanted, map<string, SymbolInfo>& symbol_map) {
+    for_each_defined_symbol<Sym>(reader, symtab, [&](string_view name, const Sym* sym) {
+        auto it = wanted.find(name);
+        if (it != wanted.end()) {
+            symbol_map[string(*it)] = make_symbol_info(reader, sym);
+            wanted.erase(it);
+        }
+        return !wanted.empty();
+    });
+}
+
+// Function to look the wanted names up through the .hash/.gnu_hash section attached to a symbol table
+static void lookup_hashed_symbols(const ELFIO::elfio& reader, ELFIO::section* symtab,
+                           unordered_set<string_view>& wanted, map<string, SymbolInfo>& symbol_map) {
+    ELFIO::symbol_section_accessor symbols(reader, symtab);
+    for (auto it = wanted.begin(); it != wanted.end();) {
+        string name(*it);
+        ELFIO::Elf64_Addr value;
+        ELFIO::Elf_Xword size;
+        unsigned char bind;
+        unsigned char type;
+        ELFIO::Elf_Half section_index;
+        unsigned char other;
+
+        if (symbols.get_symbol(name, value, size, bind, type, section_index, other) &&
+            section_index != ELFIO::SHN_UNDEF) {
+            symbol_map[name] = make_symbol_info(reader, value, size, type, section_index);
+            it = wanted.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+// Function to check whether a symbol table has a .hash/.gnu_hash section linked to it
+static bool has_hash_section(const ELFIO::elfio& reader, const ELFIO::section* symtab) {
+    for (const auto& section_ptr : reader.sections) {
+        ELFIO::Elf_Word type = section_ptr->get_type();
+        if ((type == ELFIO::SHT_HASH || type == ELFIO::SHT_GNU_HASH) &&
+            section_ptr->get_link() == symtab->get_index()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Function to list the symbol tables of the ELF file, .symtab first: it is complete, while
+// .dynsym only matters for stripped binaries
+static vector<ELFIO::section*> symbol_tables_of(const ELFIO::elfio& reader) {
+    vector<ELFIO::section*> symbol_tables;
+    for (const auto& section_ptr : reader.sections) {
+        if (section_ptr->get_type() == ELFIO::SHT_SYMTAB) {
+            symbol_tables.insert(symbol_tables.begin(), section_ptr.get());
+        } else if (section_ptr->get_type() == ELFIO::SHT_DYNSYM) {
+            symbol_tables.push_back(section_ptr.get());
+        }
+    }
+    return symbol_tables;
+}
+
+map<string, SymbolInfo> find_addresses(const string& elf_file, const vector<string>& required_symbols) {
+    ELFIO::elfio reader;
+    // Load ELF data
+    if (!reader.load_mapped(elf_file)) {
+        throw runtime_error("Could not open ELF file: " + elf_file);
+    }
+
+    // Map to hold symbol information
+    map<string, SymbolInfo> symbol_map;
+    unordered_set<string_view> wanted(required_symbols.begin(), required_symbols.end());
+
+    // .dynsym is only consulted for names .symtab did not define, through its hash table when
+    // it has one
+    vector<ELFIO::section*> symbol_tables = symbol_tables_of(reader);
+    for (ELFIO::section* section : symbol_tables) {
+        if (wanted.empty()) {
+            break;
+        }
+        if (has_hash_section(reader, section)) {
+            lookup_hashed_symbols(reader, section, wanted, symbol_map);
+        } else if (reader.get_class() == ELFIO::ELFCLASS32) {
+            scan_symbol_table<ELFIO::Elf32_Sym>(reader, section, wanted, symbol_map);
+        } else {
+            scan_symbol_table<ELFIO::Elf64_Sym>(reader, section, wanted, symbol_map);
+        }
+    }
+
+    for (const auto& sym : required_symbols) {
+        if (symbol_map.find(sym) == symbol_map.end()) {
+            throw runtime_error("Symbol not found: " + sym);
+        }
+    }
+
+    return symbol_map;
+}
+
+vector<pair<string, SymbolInfo>> collect_symbols(const ELFIO::elfio& reader) {
+    vector<pair<string, SymbolInfo>> symbols;
+    unordered_set<string_view> seen;
+
+    for (ELFIO::section* section : symbol_tables_of(reader)) {
+        auto add = [&](string_view name, const auto* sym) {
+            if (seen.insert(name).second) {
+                symbols.emplace_back(string(name), make_symbol_info(reader, sym));
+            }
+            return true;
+        };
+        if (reader.get_class() == ELFIO::ELFCLASS32) {
+            for_each_defined_symbol<ELFIO::Elf32_Sym>(reader, section, add);
+        } else {
+            for_each_defined_symbol<ELFIO::Elf64_Sym>(reader, section, add);
+        }
+    }
+
+    return symbols;
+}
+
+map<string, SymbolInfo> update_with_base_address(map<string, SymbolInfo>& symbol_map ,uint64_t base_address) {
+    for (auto& i: symbol_map) {
+        i.second.address += base_address;
+    }
+    return symbol_map;
+}
+
+uint64_t load_bias(pid_t pid, const ELFIO::elfio& reader) {
+    string proc = "/proc/" + to_string(pid);
+    char exe[PATH_MAX];
+    ssize_t length = readlink((proc + "/exe").c_str(), exe, sizeof(exe) - 1);
+    if (length < 0) {
+        throw runtime_error("Could not find the executable of process " + to_string(pid) + ": " + strerror(errno));
+    }
+    exe[length] = '\0';
+
+    uint64_t first_vaddr = UINT64_MAX;
+    for (const auto& segment : reader.segments) {
+        if (segment->get_type() == ELFIO::PT_LOAD) {
+            first_vaddr = min<uint64_t>(first_vaddr, segment->get_virtual_address());
+        }
+    }
+    ifstream maps(proc + "/maps");
+    string line;
+    while (getline(maps, line)) {
+        stringstream ss(line);
+        string range, permissions, offset, device, inode;
+        ss >> range >> permissions >> offset >> device >> inode;
+        if (mapped_path(ss) == exe && stoull(offset, nullptr, 16) == 0) {
+            return stoull(range.substr(0, range.find('-')), nullptr, 16) - (first_vaddr & ~0xfffull);
+        }
+    }
+    throw runtime_error(string("Could not find the mapping of ") + exe);
+}
+
+string mapped_path(istream& line) {
+    string path;
+    getline(line >> ws, path);
+    return path;
+}
+
+void print_symbol_info(const map<string, SymbolInfo>& symbol_map) {
+    cout << left << setw(20) << "Symbol" 
+        << setw(20) << "Address"
+        << setw(10) << "Size"
+        << setw(12) << "Type"
+        << "Section" << endl;
+    cout << string(70, '-') << endl;
+
+    for (const auto& [name, info] : symbol_map) {
+        stringstream ss_addr;
+        ss_addr << "0x" << hex << uppercase << setw(16) << setfill('0') << info.address;
+        cout << left << setw(20) << name 
+             << setw(20) << ss_addr.str()
+             << dec << setfill(' ') 
+             << setw(10) << info.size 
+             << setw(12) << info.type 
+             << info.section << endl;
+    }
+    cout << string(70, '-') << endl;
+}
+
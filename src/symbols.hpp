@@ -0,0 +1,49 @@
+#ifndef RV_SYMBOLS_HPP
+#define RV_SYMBOLS_HPP
+
+#include <cstdint>
+#include <istream>
+#include <map>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+#include "elfio/elfio.hpp"
+
+//Struct which holds information about a symbol
+struct SymbolInfo {
+    uint64_t address;
+    uint64_t size;
+    std::string type;
+    std::string section;
+};
+
+// Function to find addresses of required symbols from the symbol tables of the ELF file,
+// without adjusting them with the base address
+std::map<std::string, SymbolInfo> find_addresses(const std::string& elf_file,
+                                                 const std::vector<std::string>& required_symbols);
+
+// Function to collect every named, defined symbol of the loaded ELF file. A name defined in
+// several tables keeps the entry find_addresses would pick (.symtab before .dynsym).
+std::vector<std::pair<std::string, SymbolInfo>> collect_symbols(const ELFIO::elfio& reader);
+
+/// @brief Function to add the offset of base_address to the value in the symbol map
+/// @param symbol_map
+/// @param base_address
+/// @return updated symbol_map
+std::map<std::string, SymbolInfo> update_with_base_address(std::map<std::string, SymbolInfo>& symbol_map,
+                                                           uint64_t base_address);
+
+// Function to find where the executable of process pid, loaded in reader, is mapped: the start
+// of its mapping at file offset 0 less the page of its first loadable segment. Adding it to a
+// link-time address gives the run-time one; it is 0 for position-dependent executables.
+uint64_t load_bias(pid_t pid, const ELFIO::elfio& reader);
+
+// Function to read the path of a /proc/<pid>/maps line whose fields up to the inode have been
+// read from line: the rest of the line without its leading spaces, as paths may hold spaces.
+// Empty for anonymous mappings.
+std::string mapped_path(std::istream& line);
+
+// Function to print the symbol information in a formatted table
+void print_symbol_info(const std::map<std::string, SymbolInfo>& symbol_map);
+
+#endif // RV_SYMBOLS_HPP
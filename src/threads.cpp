@@ -0,0 +1,296 @@
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+#include <dirent.h>
+#include <signal.h>
+#include <sys/ptrace.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "backend.hpp"
+#include "threads.hpp"
+
+using namespace std;
+
+static void cont(pid_t tid, int signal) {
+    if (ptrace(PTRACE_CONT, tid, nullptr, (void*)(long)signal) != 0) {
+        throw runtime_error("PTRACE_CONT of thread " + to_string(tid) + " failed: " + strerror(errno));
+    }
+}
+
+// Function to wait for a stop of one thread, or any with tid -1
+static pid_t wait_thread(pid_t tid, int& status) {
+    for (;;) {
+        pid_t stopped = wait_tracee(tid, &status, __WALL);
+        if (stopped >= 0) {
+            return stopped;
+        }
+        if (errno != EINTR) {
+            throw runtime_error(string("waitpid failed: ") + strerror(errno));
+        }
+    }
+}
+
+static bool is_clone_event(int status) {
+    return status >> 8 == (SIGTRAP | (PTRACE_EVENT_CLONE << 8));
+}
+
+// Function to tell the stops of PTRACE_INTERRUPT, and the first stops of the clones of seized
+// threads, from signal stops
+static bool is_interrupt_stop(int status) {
+    return status >> 16 == PTRACE_EVENT_STOP;
+}
+
+bool is_exit_stop(int status) {
+    return status >> 8 == (SIGTRAP | (PTRACE_EVENT_EXIT << 8));
+}
+
+vector<pid_t> thread_ids(pid_t pid) {
+    vector<pid_t> tids;
+    DIR* dir = opendir(("/proc/" + to_string(pid) + "/task").c_str());
+    if (dir == nullptr) {
+        return tids;
+    }
+    while (dirent* entry = readdir(dir)) {
+        if (entry->d_name[0] != '.') {
+            tids.push_back(stoi(entry->d_name));
+        }
+    }
+    closedir(dir);
+    return tids;
+}
+
+pid_t thread_group(pid_t tid) {
+    ifstream status("/proc/" + to_string(tid) + "/status");
+    string line;
+    while (getline(status, line)) {
+        if (line.compare(0, 5, "Tgid:") == 0) {
+            return stoi(line.substr(5));
+        }
+    }
+    return 0;
+}
+
+void Threads::attach(pid_t pid, function<void(pid_t)> setup, bool exit_stops) {
+    this->pid = pid;
+    this->setup = move(setup);
+    options = PTRACE_O_TRACECLONE | (exit_stops ? PTRACE_O_TRACEEXIT : 0);
+    if (ptrace(PTRACE_SETOPTIONS, pid, nullptr, (void*)options) != 0) {
+        throw runtime_error(string("PTRACE_SETOPTIONS failed: ") + strerror(errno));
+    }
+    threads.clear();
+    threads[pid].state = State::Stopped;
+    current_tid = pid;
+    created = 1;
+
+    // Threads that exist already may start more meanwhile, untraced, so until none is new
+    for (bool found = true; found;) {
+        found = false;
+        for (pid_t tid : thread_ids(pid)) {
+            if (threads.count(tid) != 0) {
+                continue;
+            }
+            found = true;
+            if (ptrace(PTRACE_SEIZE, tid, nullptr, (void*)options) != 0 ||
+                ptrace(PTRACE_INTERRUPT, tid, nullptr, nullptr) != 0) {
+                // Gone already
+                continue;
+            }
+            int stop;
+            wait_thread(tid, stop);
+            while (WIFSTOPPED(stop) && !is_interrupt_stop(stop)) {
+                // A signal came first, it is delivered and the interrupt follows
+                cont(tid, WSTOPSIG(stop));
+                wait_thread(tid, stop);
+            }
+            if (WIFSTOPPED(stop)) {
+                threads[tid].state = State::Stopped;
+                ++created;
+                if (this->setup) {
+                    this->setup(tid);
+                }
+                cont(tid, 0);
+                threads[tid].state = State::Running;
+            }
+        }
+    }
+}
+
+bool Threads::wait(int& status, bool block) {
+    for (;;) {
+        pid_t tid;
+        int stop;
+        if (!queue.empty()) {
+            tie(tid, stop) = queue.front();
+            queue.pop_front();
+        } else if (block) {
+            tid = wait_thread(-1, stop);
+        } else if ((tid = poll_threads(stop)) == 0) {
+            status = 0;
+            return true;
+        }
+        if (WIFEXITED(stop) || WIFSIGNALED(stop)) {
+            threads.erase(tid);
+            if (tid == pid) {
+                status = stop;
+                return false;
+            }
+            continue;
+        }
+        if (absorb(tid, stop)) {
+            continue;
+        }
+        current_tid = tid;
+        threads[tid].state = State::Stopped;
+        status = stop;
+        return true;
+    }
+}
+
+pid_t Threads::poll_threads(int& status) {
+    // One peek at whichever child has news, as the Supervisor routes them, instead of a waitpid
+    // per thread. A new thread may report before the clone event that adds it.
+    siginfo_t info;
+    info.si_pid = 0;
+    if (waitid(P_ALL, 0, &info, WEXITED | WNOHANG | WNOWAIT | __WALL) != 0 || info.si_pid == 0) {
+        return 0;
+    }
+    pid_t tid = info.si_pid;
+    if (threads.count(tid) == 0 && thread_group(tid) != pid) {
+        return 0;
+    }
+    return wait_tracee(tid, &status, WNOHANG | __WALL) > 0 ? tid : 0;
+}
+
+bool Threads::absorb(pid_t tid, int status) {
+    Thread& thread = threads[tid];
+    if (is_clone_event(status)) {
+        unsigned long child = 0;
+        ptrace(PTRACE_GETEVENTMSG, tid, nullptr, &child);
+        // The child may have reported its first stop already
+        threads.emplace((pid_t)child, Thread());
+        cont(tid, 0);
+        threads[tid].state = State::Running;
+        return true;
+    }
+    // The first stop of a new thread, SIGSTOP or the event stop of a seized one
+    bool first = thread.state == State::New && (WSTOPSIG(status) == SIGSTOP || is_interrupt_stop(status));
+    if (!first && WSTOPSIG(status) != SIGSTOP) {
+        return false;
+    }
+    if (first) {
+        ++created;
+        if (setup) {
+            setup(tid);
+        }
+    } else if (thread.stop_pending) {
+        thread.stop_pending = false;
+    } else {
+        return false;
+    }
+    cont(tid, 0);
+    thread.state = State::Running;
+    return true;
+}
+
+void Threads::resume(int signal) {
+    cont(current_tid, signal);
+    threads[current_tid].state = State::Running;
+}
+
+void Threads::stop_others() {
+    stop_running(false);
+}
+
+void Threads::stop_all() {
+    stop_running(true);
+}
+
+void Threads::stop_running(bool current) {
+    vector<pid_t> stopping;
+    for (auto& [tid, thread] : threads) {
+        if ((current || tid != current_tid) && thread.state == State::Running) {
+            // A thread resumed from the queue may have its SIGSTOP still coming
+            if (!thread.stop_pending) {
+                syscall(SYS_tgkill, pid, tid, SIGSTOP);
+                thread.stop_pending = true;
+            }
+            stopping.push_back(tid);
+        }
+    }
+    for (pid_t tid : stopping) {
+        int stop;
+        wait_thread(tid, stop);
+        Thread& thread = threads[tid];
+        if (WIFEXITED(stop) || WIFSIGNALED(stop)) {
+            // Reported by wait(), which ends the trace if it is the leader
+            thread.state = State::Queued;
+            queue.push_back({tid, stop});
+        } else if (is_clone_event(stop)) {
+            // Stopped all the same, the SIGSTOP comes after the next resume
+            unsigned long child = 0;
+            ptrace(PTRACE_GETEVENTMSG, tid, nullptr, &child);
+            threads.emplace((pid_t)child, Thread());
+            threads[tid].state = State::StoppedByUs;
+        } else if (WSTOPSIG(stop) == SIGSTOP) {
+            thread.stop_pending = false;
+            thread.state = State::StoppedByUs;
+        } else {
+            thread.state = State::Queued;
+            queue.push_back({tid, stop});
+        }
+    }
+}
+
+void Threads::resume_others() {
+    for (auto& [tid, thread] : threads) {
+        if (thread.state == State::StoppedByUs) {
+            cont(tid, 0);
+            thread.state = State::Running;
+        }
+    }
+}
+
+void Threads::detach(int signal) {
+    unordered_map<pid_t, int> signals;
+    for (auto [tid, stop] : queue) {
+        if (WIFSTOPPED(stop) && WSTOPSIG(stop) != SIGTRAP) {
+            signals[tid] = WSTOPSIG(stop);
+        }
+    }
+    queue.clear();
+    // A current thread that stop_all() found running keeps the signal it stopped with
+    signals.emplace(current_tid, signal);
+
+    for (auto& [tid, thread] : threads) {
+        int stop;
+        bool gone = false;
+        if (thread.state == State::New) {
+            // Stopped at its start, which is yet to be reported
+            wait_thread(tid, stop);
+            gone = WIFEXITED(stop) || WIFSIGNALED(stop);
+        }
+        // A SIGSTOP still coming would stop the whole process once it is untraced
+        while (thread.stop_pending && !gone) {
+            cont(tid, 0);
+            wait_thread(tid, stop);
+            gone = WIFEXITED(stop) || WIFSIGNALED(stop);
+            if (!gone && WSTOPSIG(stop) == SIGSTOP) {
+                thread.stop_pending = false;
+            } else if (!gone && WSTOPSIG(stop) != SIGTRAP) {
+                signals[tid] = WSTOPSIG(stop);
+            }
+        }
+        if (gone) {
+            continue;
+        }
+        if (ptrace(PTRACE_DETACH, tid, nullptr, (void*)(long)signals[tid]) != 0 && errno != ESRCH) {
+            throw runtime_error("PTRACE_DETACH of thread " + to_string(tid) + " failed: " + strerror(errno));
+        }
+    }
+    threads.clear();
+}
@@ -0,0 +1,109 @@
+#ifndef RV_THREADS_HPP
+#define RV_THREADS_HPP
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <sys/types.h>
+
+// Every thread of a tracee stopped under ptrace. New threads are followed through
+// PTRACE_O_TRACECLONE and set up while stopped, before their first instruction. Stops are
+// collected with one waitpid(-1) each, so handling an event costs the same however many
+// threads there are; only stopping all of them, which is needed to change state that every
+// thread must see at once, visits each one.
+class Threads {
+public:
+    // Function to follow the threads of pid, stopped under ptrace. Threads it already has, as
+    // a process attached with --pid may, are seized too. setup is called with each thread other
+    // than pid while it is stopped. With exit_stops every thread also stops at its exit
+    // (PTRACE_O_TRACEEXIT), where the memory of the process can still be read, and wait()
+    // returns those stops.
+    void attach(pid_t pid, std::function<void(pid_t)> setup = {}, bool exit_stops = false);
+
+    // Function to wait for the next stop of any thread that the backend must handle, which
+    // becomes current() and stays stopped. Clone events, the first stops of new threads and the
+    // stops requested by stop_others() are handled here. Returns false with the wait status once
+    // the whole tracee has exited. Without block it returns true with status 0 when no thread has
+    // a stop to report, and waits for its own threads only, so other tracees keep theirs.
+    bool wait(int& status, bool block = true);
+
+    // The thread of the last stop, which ptrace requests go to
+    pid_t current() const { return current_tid; }
+
+    size_t size() const { return threads.size(); }
+    uint64_t followed() const { return created; }
+
+    // Function to continue the current thread, delivering signal
+    void resume(int signal = 0);
+
+    // Function to stop every thread but the current one, which then runs alone, until
+    // resume_others(). Stops of other kinds that arrive meanwhile are queued for wait().
+    void stop_others();
+    void resume_others();
+
+    // Function to stop every thread, the current one too if it was resumed, before detach()
+    void stop_all();
+
+    // Function to call visit(tid) for every thread, all of which must be stopped
+    template <typename Visit>
+    void for_each(Visit visit) {
+        for (auto& [tid, thread] : threads) {
+            if (thread.state != State::New) {
+                visit(tid);
+            }
+        }
+    }
+
+    // Function to call visit(tid, status) for every stop queued but not yet returned by wait()
+    template <typename Visit>
+    void for_each_queued(Visit visit) {
+        for (auto& [tid, status] : queue) {
+            visit(tid, status);
+        }
+    }
+
+    // Function to detach from every thread, all of which must be stopped; the current one gets
+    // signal, queued stops get their signal unless it is SIGTRAP
+    void detach(int signal);
+
+private:
+    enum class State : uint8_t { New, Running, Stopped, StoppedByUs, Queued };
+
+    struct Thread {
+        State state = State::New;
+        // A SIGSTOP of stop_others() is still to arrive and be swallowed
+        bool stop_pending = false;
+    };
+
+    // Function to handle a stop that no backend sees, returns false if it is one for wait()
+    bool absorb(pid_t tid, int status);
+
+    // Function to stop the running threads, all or all but the current one
+    void stop_running(bool current);
+
+    // Function to collect a stop of any thread of the tracee without waiting, returns its tid
+    // or 0 when the next reportable stop is none or another process's
+    pid_t poll_threads(int& status);
+
+    pid_t pid = 0;
+    pid_t current_tid = 0;
+    long options = 0;
+    std::function<void(pid_t)> setup;
+    std::unordered_map<pid_t, Thread> threads;
+    std::deque<std::pair<pid_t, int>> queue;
+    uint64_t created = 0;
+};
+
+// Function to list the thread ids of process pid
+std::vector<pid_t> thread_ids(pid_t pid);
+
+// Function to find the process of thread tid, 0 if it is gone
+pid_t thread_group(pid_t tid);
+
+// Function to tell the exit stops of Threads::attach with exit_stops from other stops
+bool is_exit_stop(int status);
+
+#endif // RV_THREADS_HPP
@@ -0,0 +1,517 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef RV_ZSTD
+#include <zstd.h>
+#endif
+#include "backend.hpp"
+#include "trace_file.hpp"
+
+using namespace std;
+
+static const char trace_magic[8] = {'R', 'V', 'T', 'R', 'A', 'C', 'E', '0'};
+// Version 2 adds compression to the header, version 1 traces are still read
+static const uint32_t trace_version = 2;
+// Largest encoded block: every varint of its columns at its longest, their sizes and the bitmap
+static const size_t block_bytes_max = 2 * 10 + TraceWriter::block_events * 5 * 10 + 5 * 10 + TraceWriter::block_events / 8;
+
+static uint64_t zigzag(int64_t value) {
+    return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static int64_t unzigzag(uint64_t value) {
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+static void put_varint(vector<uint8_t>& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back((uint8_t)value | 0x80);
+        value >>= 7;
+    }
+    out.push_back((uint8_t)value);
+}
+
+static void put_string(vector<uint8_t>& out, const string& text) {
+    put_varint(out, text.size());
+    out.insert(out.end(), text.begin(), text.end());
+}
+
+// Bounds checked cursor over the mapped file
+struct Cursor {
+    const uint8_t* p;
+    const uint8_t* end;
+
+    bool varint(uint64_t& value) {
+        value = 0;
+        for (unsigned shift = 0; p < end && shift < 64; shift += 7) {
+            uint8_t byte = *p++;
+            value |= (uint64_t)(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool text(string& value) {
+        uint64_t size;
+        if (!varint(size) || size > (uint64_t)(end - p)) {
+            return false;
+        }
+        value.assign((const char*)p, size);
+        p += size;
+        return true;
+    }
+};
+
+TraceWriter::TraceWriter(const string& path, TraceHeader header, int level)
+    : path(path), header(move(header)), level(level), out(path, ios::binary | ios::trunc) {
+#ifndef RV_ZSTD
+    if (level != 0) {
+        throw runtime_error("Trace compression needs zstd, which this tool was built without");
+    }
+#endif
+    if (!out) {
+        throw runtime_error("Could not create trace file " + path + ": " + strerror(errno));
+    }
+    this->header.compressed = level != 0;
+    block.reserve(block_events);
+}
+
+TraceWriter::~TraceWriter() {
+    try {
+        close();
+    } catch (const runtime_error&) {
+    }
+}
+
+int TraceWriter::default_level() {
+#ifdef RV_ZSTD
+    return ZSTD_CLEVEL_DEFAULT;
+#else
+    return 0;
+#endif
+}
+
+void TraceWriter::begin(const vector<int64_t>& initial) {
+    timespec wall, clock;
+    clock_gettime(CLOCK_REALTIME, &wall);
+    clock_gettime(CLOCK_MONOTONIC, &clock);
+    header.start_time = (uint64_t)wall.tv_sec * 1000000000 + wall.tv_nsec;
+    start = (uint64_t)clock.tv_sec * 1000000000 + clock.tv_nsec;
+
+    buffer.assign(trace_magic, trace_magic + sizeof(trace_magic));
+    put_varint(buffer, trace_version);
+    put_string(buffer, header.formula);
+    put_string(buffer, header.elf_file);
+    put_string(buffer, header.backend);
+    put_varint(buffer, header.pid);
+    put_varint(buffer, header.start_time);
+    put_varint(buffer, header.compressed);
+    put_varint(buffer, header.variables.size());
+    for (size_t v = 0; v < header.variables.size(); ++v) {
+        TraceVariable& variable = header.variables[v];
+        variable.initial = initial[v];
+        put_string(buffer, variable.name);
+        put_string(buffer, variable.symbol);
+        put_varint(buffer, variable.kind);
+        put_varint(buffer, variable.address);
+        put_varint(buffer, variable.size);
+        put_varint(buffer, zigzag(variable.initial));
+    }
+    if (!out.write((const char*)buffer.data(), buffer.size())) {
+        throw runtime_error("Could not write trace file " + path + ": " + strerror(errno));
+    }
+    bytes += buffer.size();
+    raw_bytes += buffer.size();
+    writer = thread([this] { write_blocks(); });
+}
+
+uint64_t TraceWriter::now() const {
+    timespec clock;
+    clock_gettime(CLOCK_MONOTONIC, &clock);
+    return (uint64_t)clock.tv_sec * 1000000000 + clock.tv_nsec - start;
+}
+
+void TraceWriter::add(const TraceEvent& event) {
+    block.push_back(event);
+    if (block.size() == block_events) {
+        hand_off();
+    }
+}
+
+void TraceWriter::hand_off() {
+    unique_lock<mutex> guard(lock);
+    if (pending.size() == pending_blocks) {
+        // The disk or the compression falls behind: the tracee waits rather than memory grows
+        ++waits;
+        emptied.wait(guard, [this] { return pending.size() < pending_blocks; });
+    }
+    pending.push_back(move(block));
+    if (spare.empty()) {
+        block = vector<TraceEvent>();
+        block.reserve(block_events);
+    } else {
+        block = move(spare.back());
+        spare.pop_back();
+    }
+    filled.notify_one();
+}
+
+void TraceWriter::write_blocks() {
+    block_tracer_signals();
+
+    unique_lock<mutex> guard(lock);
+    for (;;) {
+        filled.wait(guard, [this] { return !pending.empty() || closing; });
+        if (pending.empty()) {
+            return;
+        }
+        vector<TraceEvent> events = move(pending.front());
+        pending.pop_front();
+        emptied.notify_one();
+        guard.unlock();
+        write_block(events);
+        events.clear();
+        guard.lock();
+        spare.push_back(move(events));
+    }
+}
+
+void TraceWriter::write_block(const vector<TraceEvent>& block) {
+    buffer.clear();
+    put_varint(buffer, block.size());
+    put_varint(buffer, block.front().time);
+
+    vector<uint8_t> column;
+    auto put_column = [&](auto encode) {
+        column.clear();
+        for (const TraceEvent& event : block) {
+            encode(event);
+        }
+        put_varint(buffer, column.size());
+        buffer.insert(buffer.end(), column.begin(), column.end());
+    };
+    uint64_t time = block.front().time;
+    put_column([&](const TraceEvent& event) {
+        put_varint(column, event.time - time);
+        time = event.time;
+    });
+    put_column([&](const TraceEvent& event) { put_varint(column, event.variable); });
+    pid_t thread = 0;
+    put_column([&](const TraceEvent& event) {
+        put_varint(column, zigzag((int64_t)event.thread - thread));
+        thread = event.thread;
+    });
+    // The old value is most often the last one the block gave the variable, at most 64 of them
+    int64_t last[64] = {};
+    put_column([&](const TraceEvent& event) {
+        put_varint(column, zigzag(event.old_value - last[event.variable]));
+        last[event.variable] = event.value;
+    });
+    put_column([&](const TraceEvent& event) { put_varint(column, zigzag(event.value - event.old_value)); });
+    size_t bitmap = buffer.size();
+    buffer.resize(bitmap + (block.size() + 7) / 8);
+    for (size_t i = 0; i < block.size(); ++i) {
+        if (block[i].end) {
+            buffer[bitmap + i / 8] |= 1 << (i % 8);
+        }
+    }
+    events += block.size();
+    raw_bytes += buffer.size();
+    ++blocks;
+
+    // A compressed trace prefixes each block with its size, doubled and plus one when it is a
+    // zstd frame. A block that does not get smaller is stored as it is.
+    if (header.compressed) {
+        bool packed = false;
+#ifdef RV_ZSTD
+        static thread_local unique_ptr<ZSTD_CCtx, size_t (*)(ZSTD_CCtx*)> context(ZSTD_createCCtx(), ZSTD_freeCCtx);
+        frame.resize(ZSTD_compressBound(buffer.size()));
+        size_t size = ZSTD_compressCCtx(context.get(), frame.data(), frame.size(), buffer.data(), buffer.size(), level);
+        packed = !ZSTD_isError(size) && size < buffer.size();
+        frame.resize(packed ? size : 0);
+#endif
+        if (!packed) {
+            frame.assign(buffer.begin(), buffer.end());
+        }
+        buffer.clear();
+        put_varint(buffer, frame.size() << 1 | packed);
+        buffer.insert(buffer.end(), frame.begin(), frame.end());
+    }
+    // A failed write is reported by close(), the blocks after it are not written
+    if (error.empty() && !out.write((const char*)buffer.data(), buffer.size())) {
+        error = strerror(errno);
+    }
+    bytes += buffer.size();
+}
+
+void TraceWriter::close() {
+    if (!block.empty() && writer.joinable()) {
+        hand_off();
+    }
+    if (writer.joinable()) {
+        {
+            lock_guard<mutex> guard(lock);
+            closing = true;
+            filled.notify_one();
+        }
+        writer.join();
+    }
+    if (!out.is_open()) {
+        return;
+    }
+    out.close();
+    if (!out && error.empty()) {
+        error = strerror(errno);
+    }
+    if (!error.empty()) {
+        throw runtime_error("Could not write trace file " + path + ": " + error);
+    }
+}
+
+void TraceWriter::print_stats(ostream& out) const {
+    out << "record: " << events << " events in " << blocks << " blocks, " << bytes << " bytes";
+    if (events != 0) {
+        out << " (" << (double)bytes / events << " per event";
+        if (header.compressed) {
+            out << ", " << (double)raw_bytes / bytes << "x smaller with zstd level " << level;
+        }
+        out << ")";
+    }
+    if (waits != 0) {
+        out << ", " << waits << " waits for the writer";
+    }
+    out << " to " << path << endl;
+}
+
+bool is_trace_file(const string& path) {
+    char magic[sizeof(trace_magic)];
+    ifstream in(path, ios::binary);
+    return in.read(magic, sizeof(magic)) && memcmp(magic, trace_magic, sizeof(magic)) == 0;
+}
+
+// Function to unmap a trace file and throw, as the destructor does not run for a constructor
+// that throws
+[[noreturn]] static void unmap_and_fail(void* map, size_t length, const string& message) {
+    munmap(map, length);
+    throw runtime_error(message);
+}
+
+TraceReader::TraceReader(const string& path) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw runtime_error("Could not open trace file " + path + ": " + strerror(errno));
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(trace_magic)) {
+        close(fd);
+        throw runtime_error(path + " is not a trace file");
+    }
+    void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        throw runtime_error("Could not map trace file " + path + ": " + strerror(errno));
+    }
+    base = static_cast<const uint8_t*>(p);
+    length = st.st_size;
+    madvise(p, length, MADV_SEQUENTIAL);
+
+    Cursor cursor{base + sizeof(trace_magic), base + length};
+    uint64_t version = 0, pid = 0, count = 0;
+    if (memcmp(base, trace_magic, sizeof(trace_magic)) != 0 || !cursor.varint(version)) {
+        unmap_and_fail(p, length, path + " is not a trace file");
+    }
+    if (version == 0 || version > trace_version) {
+        unmap_and_fail(p, length, path + " has trace format version " + to_string(version) + ", expected " +
+                                      to_string(trace_version));
+    }
+    uint64_t compressed = 0;
+    if (!cursor.text(trace_header.formula) || !cursor.text(trace_header.elf_file) ||
+        !cursor.text(trace_header.backend) || !cursor.varint(pid) || !cursor.varint(trace_header.start_time) ||
+        (version >= 2 && (!cursor.varint(compressed) || compressed > 1)) || !cursor.varint(count) || count > 64) {
+        unmap_and_fail(p, length, "The header of trace file " + path + " is malformed");
+    }
+    trace_header.pid = pid;
+    trace_header.compressed = compressed;
+    for (uint64_t v = 0; v < count; ++v) {
+        TraceVariable variable;
+        uint64_t kind = 0, initial = 0;
+        if (!cursor.text(variable.name) || !cursor.text(variable.symbol) || !cursor.varint(kind) ||
+            kind > Watch::ReturnCount || !cursor.varint(variable.address) || !cursor.varint(variable.size) ||
+            !cursor.varint(initial)) {
+            unmap_and_fail(p, length, "The header of trace file " + path + " is malformed");
+        }
+        variable.kind = (Watch::Kind)kind;
+        variable.initial = unzigzag(initial);
+        trace_header.variables.push_back(variable);
+    }
+#ifndef RV_ZSTD
+    if (trace_header.compressed) {
+        unmap_and_fail(p, length, path + " is compressed with zstd, which this tool was built without");
+    }
+#endif
+    offset = cursor.p - base;
+}
+
+TraceReader::~TraceReader() {
+    munmap((void*)base, length);
+}
+
+bool TraceReader::next(TraceEvent& event) {
+    if (position == block.size()) {
+        block.clear();
+        position = 0;
+        if (!read_block()) {
+            return false;
+        }
+    }
+    event = block[position++];
+    return true;
+}
+
+bool TraceReader::read_block() {
+    if (offset == length) {
+        return false;
+    }
+    if (!decode_block(offset, block)) {
+        cut = true;
+        return false;
+    }
+    ++block_count;
+    return true;
+}
+
+vector<size_t> TraceReader::block_offsets(bool& truncated) const {
+    vector<size_t> offsets;
+    size_t at = offset;
+    truncated = false;
+    while (at != length) {
+        Cursor cursor{base + at, base + length};
+        uint64_t count, time, size;
+        bool valid;
+        if (trace_header.compressed) {
+            // The size prefix is enough to find the next block
+            valid = cursor.varint(size) && size >> 1 <= (uint64_t)(cursor.end - cursor.p);
+            cursor.p += valid ? size >> 1 : 0;
+        } else {
+            valid = cursor.varint(count) && count != 0 && count <= TraceWriter::block_events && cursor.varint(time);
+            for (int column = 0; valid && column < 5; ++column) {
+                valid = cursor.varint(size) && size <= (uint64_t)(cursor.end - cursor.p);
+                cursor.p += valid ? size : 0;
+            }
+            valid = valid && (count + 7) / 8 <= (uint64_t)(cursor.end - cursor.p);
+            cursor.p += valid ? (count + 7) / 8 : 0;
+        }
+        if (!valid) {
+            truncated = true;
+            break;
+        }
+        offsets.push_back(at);
+        at = cursor.p - base;
+    }
+    return offsets;
+}
+
+bool TraceReader::decode_block(size_t& offset, vector<TraceEvent>& block) const {
+    const uint8_t* next;
+    if (!trace_header.compressed) {
+        if (!decode_events(base + offset, base + length, block, next)) {
+            return false;
+        }
+        offset = next - base;
+        return true;
+    }
+    Cursor cursor{base + offset, base + length};
+    uint64_t size;
+    if (!cursor.varint(size) || size >> 1 > (uint64_t)(cursor.end - cursor.p)) {
+        return false;
+    }
+    const uint8_t* start = cursor.p;
+    const uint8_t* end = cursor.p + (size >> 1);
+#ifdef RV_ZSTD
+    if (size & 1) {
+        // One context and buffer per decoding thread
+        static thread_local unique_ptr<ZSTD_DCtx, size_t (*)(ZSTD_DCtx*)> context(ZSTD_createDCtx(), ZSTD_freeDCtx);
+        static thread_local vector<uint8_t> raw;
+        unsigned long long raw_size = ZSTD_getFrameContentSize(start, end - start);
+        if (raw_size == ZSTD_CONTENTSIZE_UNKNOWN || raw_size == ZSTD_CONTENTSIZE_ERROR || raw_size > block_bytes_max) {
+            return false;
+        }
+        raw.resize(raw_size);
+        size_t decoded = ZSTD_decompressDCtx(context.get(), raw.data(), raw.size(), start, end - start);
+        if (ZSTD_isError(decoded) || decoded != raw_size) {
+            return false;
+        }
+        start = raw.data();
+        end = raw.data() + raw.size();
+    }
+#endif
+    if (!decode_events(start, end, block, next) || next != end) {
+        block.clear();
+        return false;
+    }
+    offset = cursor.p + (size >> 1) - base;
+    return true;
+}
+
+bool TraceReader::decode_events(const uint8_t* p, const uint8_t* end, vector<TraceEvent>& block,
+                                const uint8_t*& next) const {
+    Cursor cursor{p, end};
+    uint64_t count, time;
+    if (!cursor.varint(count) || count == 0 || count > TraceWriter::block_events || !cursor.varint(time)) {
+        return false;
+    }
+    block.resize(count);
+
+    // Each column is its length in bytes and count varints
+    auto column = [&](auto decode) {
+        uint64_t size, value;
+        if (!cursor.varint(size) || size > (uint64_t)(cursor.end - cursor.p)) {
+            return false;
+        }
+        Cursor values{cursor.p, cursor.p + size};
+        for (TraceEvent& event : block) {
+            if (!values.varint(value)) {
+                return false;
+            }
+            decode(event, value);
+        }
+        cursor.p += size;
+        return true;
+    };
+    // The value columns hold deltas, resolved in order once both are read
+    uint64_t thread = 0;
+    bool valid =
+        column([&](TraceEvent& event, uint64_t value) { event.time = time += value; }) &&
+        column([&](TraceEvent& event, uint64_t value) { event.variable = value; }) &&
+        column([&](TraceEvent& event, uint64_t value) { event.thread = thread += unzigzag(value); }) &&
+        column([&](TraceEvent& event, uint64_t value) { event.old_value = unzigzag(value); }) &&
+        column([&](TraceEvent& event, uint64_t value) { event.value = unzigzag(value); });
+    size_t bitmap = (count + 7) / 8;
+    valid = valid && all_of(block.begin(), block.end(), [&](const TraceEvent& event) {
+        return event.variable < trace_header.variables.size();
+    });
+    if (!valid || bitmap > (size_t)(cursor.end - cursor.p)) {
+        block.clear();
+        return false;
+    }
+    int64_t last[64] = {};
+    for (size_t i = 0; i < count; ++i) {
+        TraceEvent& event = block[i];
+        int64_t& previous = last[event.variable];
+        event.old_value += previous;
+        event.value += event.old_value;
+        previous = event.value;
+        event.end = (cursor.p[i / 8] >> (i % 8)) & 1;
+    }
+    next = cursor.p + bitmap;
+    return true;
+}
@@ -0,0 +1,177 @@
+#ifndef RV_TRACE_FILE_HPP
+#define RV_TRACE_FILE_HPP
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <iosfwd>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/types.h>
+#include "backend.hpp"
+
+// A recorded variable: the watch it was, with the symbol it was resolved from and its value
+// at the first position
+struct TraceVariable {
+    std::string name;
+    std::string symbol;
+    Watch::Kind kind;
+    uint64_t address;
+    uint64_t size;
+    int64_t initial;
+};
+
+// What a trace file starts with: the properties it was recorded for, where it was recorded
+// and the symbol map of its variables
+struct TraceHeader {
+    std::string formula;
+    std::string elf_file;
+    std::string backend;
+    pid_t pid = 0;
+    // Wall clock time of the first position, in nanoseconds since the epoch
+    uint64_t start_time = 0;
+    std::vector<TraceVariable> variables;
+    // Each block is a zstd frame of its own
+    bool compressed = false;
+};
+
+// One change of a variable
+struct TraceEvent {
+    // Nanoseconds since the first position
+    uint64_t time;
+    uint32_t variable;
+    pid_t thread;
+    int64_t old_value;
+    int64_t value;
+    // Last change of its position
+    bool end;
+};
+
+// Writer of trace files. After the header, events are written in blocks of up to block_events,
+// each stored column by column so that like values sit together: time deltas, variables, thread
+// deltas, old values as deltas from the last value of the variable in the block, and new values
+// as deltas from the old ones, all as LEB128 varints (zigzag for the signed ones), then a bitmap
+// of the position ends. With compression each block is then a zstd frame of its own, preceded by
+// its size. A block depends on no other, so a trace cut short by a crash loses at most its last
+// block, and blocks can be decoded in parallel.
+//
+// Filled blocks are handed to a thread of the writer that encodes, compresses and writes them,
+// so that adding an event only copies it.
+class TraceWriter {
+public:
+    static constexpr size_t block_events = 4096;
+    // Filled blocks waiting for the writing thread before add() waits for it
+    static constexpr size_t pending_blocks = 8;
+
+    // Function to create the trace file, throws runtime_error if it cannot be written or level
+    // asks for compression this build does not have. Blocks are compressed at zstd level level,
+    // stored as they are for 0. The initial values of the header are filled in by begin().
+    TraceWriter(const std::string& path, TraceHeader header, int level);
+    TraceWriter(const TraceWriter&) = delete;
+    TraceWriter& operator=(const TraceWriter&) = delete;
+    ~TraceWriter();
+
+    // Function to get the compression level used unless another is asked for: zstd's default
+    // when built with it, else 0
+    static int default_level();
+
+    // Function to write the header with the initial values (initial[v] for variable v), start
+    // the clock of the events and the writing thread. Throws runtime_error if the header cannot
+    // be written.
+    void begin(const std::vector<int64_t>& initial);
+
+    // Function to get the time of an event happening now
+    uint64_t now() const;
+
+    // Function to append an event
+    void add(const TraceEvent& event);
+
+    // Function to write the last block, wait for the writing thread and close the file. Throws
+    // runtime_error if any of the trace could not be written, as on a full disk.
+    void close();
+
+    // Function to print the size of the trace
+    void print_stats(std::ostream& out) const;
+
+private:
+    void hand_off();
+    void write_blocks();
+    void write_block(const std::vector<TraceEvent>& events);
+
+    std::string path;
+    TraceHeader header;
+    int level;
+    std::ofstream out;
+    uint64_t start = 0;
+    std::vector<TraceEvent> block;
+
+    // Shared with the writing thread
+    std::thread writer;
+    std::mutex lock;
+    std::condition_variable filled;
+    std::condition_variable emptied;
+    std::deque<std::vector<TraceEvent>> pending;
+    std::vector<std::vector<TraceEvent>> spare;
+    bool closing = false;
+    uint64_t waits = 0;
+
+    // Of the writing thread
+    std::vector<uint8_t> buffer;
+    std::vector<uint8_t> frame;
+    uint64_t events = 0;
+    uint64_t blocks = 0;
+    uint64_t raw_bytes = 0;
+    uint64_t bytes = 0;
+    // Why the first failed write failed, empty while none has
+    std::string error;
+};
+
+// Function to tell whether a file starts like a trace file
+bool is_trace_file(const std::string& path);
+
+// Reader of trace files, which maps the file and decodes one block at a time
+class TraceReader {
+public:
+    // Function to map a trace file and read its header, throws runtime_error if it is not one
+    explicit TraceReader(const std::string& path);
+    TraceReader(const TraceReader&) = delete;
+    TraceReader& operator=(const TraceReader&) = delete;
+    ~TraceReader();
+
+    const TraceHeader& header() const { return trace_header; }
+
+    // Function to get the next event, false at the end of the trace
+    bool next(TraceEvent& event);
+
+    // Function to find where the whole blocks after the header start, and whether the file ends
+    // within one. Blocks are decoded on their own by decode_block.
+    std::vector<size_t> block_offsets(bool& truncated) const;
+
+    // Function to decode the block at offset into events and move offset past it, false if it
+    // is malformed or cut short. Safe to call from several threads at once.
+    bool decode_block(size_t& offset, std::vector<TraceEvent>& events) const;
+
+    uint64_t blocks() const { return block_count; }
+    uint64_t size() const { return length; }
+    // The file ends within a block, as when the recording was cut short
+    bool truncated() const { return cut; }
+
+private:
+    bool read_block();
+    bool decode_events(const uint8_t* p, const uint8_t* end, std::vector<TraceEvent>& events,
+                       const uint8_t*& next) const;
+
+    const uint8_t* base = nullptr;
+    size_t length = 0;
+    size_t offset = 0;
+    TraceHeader trace_header;
+    std::vector<TraceEvent> block;
+    size_t position = 0;
+    uint64_t block_count = 0;
+    bool cut = false;
+};
+
+#endif // RV_TRACE_FILE_HPP
@@ -0,0 +1,373 @@
+#if defined(__x86_64__)
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+#include <fcntl.h>
+#include <linux/userfaultfd.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/ptrace.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "backend.hpp"
+#include "inject.hpp"
+#include "threads.hpp"
+
+using namespace std;
+
+// Write-protect backend through userfaultfd: the pages holding watched variables are write
+// protected with UFFDIO_WRITEPROTECT, so any number of variables can be watched. A write to a
+// protected page blocks the writing thread and reports its exact address and thread id; the
+// monitor stops every thread, unprotects the page, single-steps the store in the thread that
+// faulted and protects the page again, so no other thread writes the page unobserved meanwhile.
+// The pages are looked up in a page -> watched ranges index, so writes to unwatched bytes of a
+// watched page (false positives) are told apart without reading any value.
+//
+// The userfaultfd is created inside the tracee with an injected system call and taken over with
+// pidfd_getfd. Write protection faults only work on anonymous memory, so the pages are first
+// replaced by anonymous copies of themselves.
+class UffdBackend : public Backend {
+public:
+    const char* name() const override { return "uffd"; }
+
+    ~UffdBackend() override {
+        if (uffd >= 0) {
+            close(uffd);
+        }
+        if (signal_fd >= 0) {
+            close(signal_fd);
+            sigprocmask(SIG_SETMASK, &saved_mask, nullptr);
+        }
+    }
+
+    void attach(pid_t pid, const vector<Watch>& watches) override {
+        this->pid = pid;
+        this->watches = watches;
+        build_index();
+        // The threads run between faults, their stops are noticed through a signalfd for SIGCHLD
+        sigset_t mask;
+        sigemptyset(&mask);
+        sigaddset(&mask, SIGCHLD);
+        sigprocmask(SIG_BLOCK, &mask, &saved_mask);
+        signal_fd = signalfd(-1, &mask, SFD_CLOEXEC | SFD_NONBLOCK);
+        if (signal_fd < 0) {
+            throw runtime_error(string("signalfd failed: ") + strerror(errno));
+        }
+        threads.attach(pid);
+        // The pages are copied out and back around the remap, a store of another thread
+        // meanwhile would be lost, so none runs until they are protected
+        threads.stop_others();
+        open_userfaultfd();
+        for (auto [start, end] : page_runs()) {
+            make_anonymous(start, end);
+            uffdio_register reg;
+            memset(&reg, 0, sizeof(reg));
+            reg.range = {start, end - start};
+            reg.mode = UFFDIO_REGISTER_MODE_WP;
+            if (ioctl(uffd, UFFDIO_REGISTER, &reg) != 0) {
+                throw runtime_error(string("UFFDIO_REGISTER failed: ") + strerror(errno));
+            }
+        }
+        arm(vector<bool>(watches.size(), true));
+        threads.resume_others();
+        threads.resume();
+    }
+
+    void arm(const vector<bool>& armed) override {
+        this->armed = armed;
+        for (auto& [page, ranges] : pages) {
+            bool wanted = any_of(ranges.begin(), ranges.end(), [&](const Range& r) { return armed[r.watch]; });
+            protect(page, wanted);
+        }
+        try_read_values(pid, watches, values);
+    }
+
+    bool next(vector<Change>& changes) override {
+        // Stops queued while every thread was stopped raise no SIGCHLD, they are looked for first
+        bool check = true;
+        if (stepped) {
+            stepped = false;
+            threads.resume_others();
+        }
+
+        pollfd fds[2] = {{uffd, POLLIN, 0}, {signal_fd, POLLIN, 0}};
+        for (;;) {
+            if (poll(fds, 2, blocking && !check ? -1 : 0) < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw runtime_error(string("poll failed: ") + strerror(errno));
+            }
+            if (check || !blocking || (fds[1].revents & POLLIN)) {
+                check = false;
+                if (!handle_stops()) {
+                    return false;
+                }
+            }
+
+            uffd_msg msg;
+            while (read(uffd, &msg, sizeof(msg)) == sizeof(msg)) {
+                if (msg.event == UFFD_EVENT_PAGEFAULT && (msg.arg.pagefault.flags & UFFD_PAGEFAULT_FLAG_WP)) {
+                    pid_t tid = msg.arg.pagefault.feat.ptid;
+                    handle_fault(msg.arg.pagefault.address, tid);
+                    if (compare(changes, tid)) {
+                        return true;
+                    }
+                    stepped = false;
+                    threads.resume_others();
+                    check = true;
+                }
+            }
+            if (!blocking) {
+                return true;
+            }
+        }
+    }
+
+    vector<int> wait_fds() const override {
+        return {uffd};
+    }
+
+    void detach() override {
+        for (auto& [page, ranges] : pages) {
+            protect(page, false);
+        }
+        stepped = false;
+        threads.stop_all();
+        threads.detach(0);
+    }
+
+    void print_stats(ostream& out) const override {
+        out << "uffd: " << faults << " write faults on " << pages.size() << " pages, " << false_positives
+            << " false positives";
+        if (faults != 0) {
+            out << " (" << 100.0 * false_positives / faults << "%)";
+        }
+        out << endl;
+        if (threads.followed() > 1) {
+            out << "uffd: " << threads.followed() << " threads" << endl;
+        }
+    }
+
+private:
+    struct Range {
+        uint64_t start;
+        uint64_t end;
+        uint32_t watch;
+    };
+
+    static uint64_t page_size() {
+        static const uint64_t size = sysconf(_SC_PAGESIZE);
+        return size;
+    }
+
+    // Function to index the watched byte ranges by page
+    void build_index() {
+        for (uint32_t i = 0; i < watches.size(); ++i) {
+            uint64_t start = watches[i].address;
+            uint64_t end = start + watches[i].size;
+            for (uint64_t page = start & ~(page_size() - 1); page < end; page += page_size()) {
+                pages[page].push_back({max(start, page), min(end, page + page_size()), i});
+            }
+        }
+        for (auto& [page, ranges] : pages) {
+            sort(ranges.begin(), ranges.end(), [](const Range& a, const Range& b) { return a.start < b.start; });
+        }
+    }
+
+    // Function to group the watched pages into runs of adjacent pages
+    vector<pair<uint64_t, uint64_t>> page_runs() const {
+        vector<uint64_t> sorted;
+        for (const auto& entry : pages) {
+            sorted.push_back(entry.first);
+        }
+        sort(sorted.begin(), sorted.end());
+        vector<pair<uint64_t, uint64_t>> runs;
+        for (uint64_t page : sorted) {
+            if (!runs.empty() && runs.back().second == page) {
+                runs.back().second += page_size();
+            } else {
+                runs.push_back({page, page + page_size()});
+            }
+        }
+        return runs;
+    }
+
+    void open_userfaultfd() {
+        long remote = inject_syscall(pid, SYS_userfaultfd, O_CLOEXEC | O_NONBLOCK);
+        if (remote < 0) {
+            throw runtime_error(string("userfaultfd in the tracee failed: ") + strerror(-remote));
+        }
+        int pidfd = syscall(SYS_pidfd_open, pid, 0);
+        uffd = pidfd < 0 ? -1 : syscall(SYS_pidfd_getfd, pidfd, remote, 0);
+        int error = errno;
+        if (pidfd >= 0) {
+            close(pidfd);
+        }
+        inject_syscall(pid, SYS_close, remote);
+        if (uffd < 0) {
+            throw runtime_error(string("Could not take the userfaultfd from the tracee: ") + strerror(error));
+        }
+
+        uffdio_api api;
+        memset(&api, 0, sizeof(api));
+        api.api = UFFD_API;
+        api.features = UFFD_FEATURE_EXACT_ADDRESS | UFFD_FEATURE_THREAD_ID;
+        if (ioctl(uffd, UFFDIO_API, &api) != 0 || !(api.features & UFFD_FEATURE_PAGEFAULT_FLAG_WP)) {
+            throw runtime_error("userfaultfd write protection is not supported by this kernel");
+        }
+        if (!(api.features & UFFD_FEATURE_THREAD_ID)) {
+            throw runtime_error("userfaultfd cannot tell the faulting thread on this kernel");
+        }
+    }
+
+    // Function to replace pages of the tracee by anonymous private pages with the same contents,
+    // with every thread stopped
+    void make_anonymous(uint64_t start, uint64_t end) {
+        if (!writable(start, end)) {
+            throw runtime_error("Watched variables must be in writable memory");
+        }
+        vector<char> contents(end - start);
+        iovec local = {contents.data(), contents.size()};
+        iovec remote = {(void*)start, contents.size()};
+        if (process_vm_readv(pid, &local, 1, &remote, 1, 0) != (ssize_t)contents.size()) {
+            throw runtime_error(string("Could not read watched pages: ") + strerror(errno));
+        }
+        long mapped = inject_syscall(pid, SYS_mmap, start, end - start, PROT_READ | PROT_WRITE,
+                                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+        if (mapped != (long)start) {
+            throw runtime_error("Could not remap watched pages in the tracee");
+        }
+        // Writing every byte back also populates the pages, protection only applies to present ones
+        if (process_vm_writev(pid, &local, 1, &remote, 1, 0) != (ssize_t)contents.size()) {
+            throw runtime_error(string("Could not restore watched pages: ") + strerror(errno));
+        }
+    }
+
+    // Function to check /proc/<pid>/maps for a writable mapping covering a range
+    bool writable(uint64_t start, uint64_t end) const {
+        ifstream maps("/proc/" + to_string(pid) + "/maps");
+        string line;
+        uint64_t covered = start;
+        while (getline(maps, line) && covered < end) {
+            stringstream ss(line);
+            string range, permissions;
+            ss >> range >> permissions;
+            size_t dash = range.find('-');
+            uint64_t low = stoull(range.substr(0, dash), nullptr, 16);
+            uint64_t high = stoull(range.substr(dash + 1), nullptr, 16);
+            if (low <= covered && covered < high) {
+                if (permissions.size() < 2 || permissions[1] != 'w') {
+                    return false;
+                }
+                covered = high;
+            }
+        }
+        return covered >= end;
+    }
+
+    void protect(uint64_t page, bool enable) {
+        uffdio_writeprotect wp;
+        wp.range = {page, page_size()};
+        wp.mode = enable ? UFFDIO_WRITEPROTECT_MODE_WP : 0;
+        if (ioctl(uffd, UFFDIO_WRITEPROTECT, &wp) != 0) {
+            throw runtime_error(string("UFFDIO_WRITEPROTECT failed: ") + strerror(errno));
+        }
+    }
+
+    // Function to pass the signals of stopped threads on, returns false with the wait status
+    // once the tracee has exited
+    bool handle_stops() {
+        signalfd_siginfo info;
+        while (read(signal_fd, &info, sizeof(info)) == sizeof(info)) {
+        }
+        int stop;
+        while (threads.wait(stop, false)) {
+            if (stop == 0) {
+                return true;
+            }
+            threads.resume(WSTOPSIG(stop) == SIGTRAP ? 0 : WSTOPSIG(stop));
+        }
+        status = stop;
+        return false;
+    }
+
+    // Function to let a faulting write through: stop every thread, unprotect the page, step the
+    // store in the thread tid that faulted and protect the page again. Leaves the threads stopped
+    // with stepped set.
+    void handle_fault(uint64_t address, pid_t tid) {
+        ++faults;
+        uint64_t page = address & ~(page_size() - 1);
+        auto it = pages.find(page);
+        // The access size is unknown, a hit is any watched range within a word of the address
+        bool hit = it != pages.end() && any_of(it->second.begin(), it->second.end(), [&](const Range& r) {
+            return armed[r.watch] && r.start < address + 8 && address < r.end;
+        });
+        if (!hit) {
+            ++false_positives;
+        }
+
+        // The SIGSTOP interrupts the fault, which the thread retries from the store once stepped
+        threads.stop_all();
+        stepped = true;
+        protect(page, false);
+        int step;
+        do {
+            if (ptrace(PTRACE_SINGLESTEP, tid, nullptr, nullptr) != 0) {
+                if (errno == ESRCH) {
+                    // Gone before its write, as a killed thread is
+                    break;
+                }
+                throw runtime_error(string("Could not step the faulting write: ") + strerror(errno));
+            }
+            if (wait_tracee(tid, &step, __WALL) < 0) {
+                throw runtime_error(string("waitpid failed: ") + strerror(errno));
+            }
+        } while (WIFSTOPPED(step) && WSTOPSIG(step) != SIGTRAP);
+        protect(page, true);
+    }
+
+    // Function to append the armed watches whose values changed, by the write of thread tid
+    bool compare(vector<Change>& changes, pid_t tid) {
+        vector<int64_t> current;
+        if (!try_read_values(pid, watches, current)) {
+            return false;
+        }
+        for (size_t i = 0; i < watches.size(); ++i) {
+            if (armed[i] && current[i] != values[i]) {
+                changes.push_back({watches[i].variable, current[i], tid});
+            }
+        }
+        values = move(current);
+        return !changes.empty();
+    }
+
+    pid_t pid = 0;
+    int uffd = -1;
+    int signal_fd = -1;
+    sigset_t saved_mask;
+    Threads threads;
+    vector<Watch> watches;
+    vector<int64_t> values;
+    vector<bool> armed;
+    unordered_map<uint64_t, vector<Range>> pages;
+    bool stepped = false;
+    uint64_t faults = 0;
+    uint64_t false_positives = 0;
+};
+
+unique_ptr<Backend> make_uffd_backend() {
+    return make_unique<UffdBackend>();
+}
+
+#endif // __x86_64__
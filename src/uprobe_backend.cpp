@@ -0,0 +1,336 @@
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <unistd.h>
+#include "backend.hpp"
+#include "perf_ring.hpp"
+#include "symbols.hpp"
+#include "threads.hpp"
+
+using namespace std;
+
+// Directory of the uprobe PMU of perf_event_open
+static const char* const uprobe_pmu = "/sys/bus/event_source/devices/uprobe";
+
+// Data pages of each ring. A full ring loses calls, and hot functions fill one quickly while the
+// monitor waits for a CPU.
+static const size_t probe_ring_pages = 64;
+
+// Function counting backend through perf_event_open: a uprobe (calls(f)) or uretprobe
+// (returns(f)) event of the uprobe PMU per watched function and thread, sampling into a mmap
+// ring buffer of its own. Uprobe events cannot be inherited by new threads, so every thread is
+// followed and gets its events while it is stopped at its clone, before its first call. The
+// kernel counts every call without stopping the tracee; the monitor wakes up on new samples,
+// drains every ring in one batch and reads the value watches with one process_vm_readv, so
+// values are seen as of the calls. The counts are exact, lost samples included, but calls made
+// while a batch is processed merge into the next position. The threads also stop at their
+// exit, so the last counts and values are read at the exit of the tracee.
+class UprobeBackend : public Backend {
+public:
+    const char* name() const override { return "uprobe"; }
+
+    ~UprobeBackend() override {
+        events.clear();
+        if (epoll_fd >= 0) {
+            close(epoll_fd);
+        }
+        if (signal_fd >= 0) {
+            close(signal_fd);
+            sigprocmask(SIG_SETMASK, &saved_mask, nullptr);
+        }
+    }
+
+    bool supports(Watch::Kind kind) const override {
+        return kind == Watch::Value || kind == Watch::CallCount || kind == Watch::ReturnCount;
+    }
+
+    void attach(pid_t pid, const vector<Watch>& watches) override {
+        this->pid = pid;
+        this->watches = watches;
+        // The threads run between calls, their stops are noticed through a signalfd for SIGCHLD
+        sigset_t mask;
+        sigemptyset(&mask);
+        sigaddset(&mask, SIGCHLD);
+        sigprocmask(SIG_BLOCK, &mask, &saved_mask);
+        signal_fd = signalfd(-1, &mask, SFD_CLOEXEC | SFD_NONBLOCK);
+        if (signal_fd < 0) {
+            throw runtime_error(string("signalfd failed: ") + strerror(errno));
+        }
+        // The rings of the threads come and go, one epoll set holds them for the supervisor
+        epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (epoll_fd < 0) {
+            throw runtime_error(string("epoll_create1 failed: ") + strerror(errno));
+        }
+        find_probes();
+        open_events(pid);
+        threads.attach(pid, [this](pid_t tid) { open_events(tid); }, true);
+        arm(vector<bool>(watches.size(), true));
+        threads.resume();
+    }
+
+    void arm(const vector<bool>& armed) override {
+        // The kernel counts whether armed or not, so reported counts never fall behind
+        this->armed = armed;
+        try_read_values(pid, watches, values);
+    }
+
+    bool next(vector<Change>& changes) override {
+        if (exiting) {
+            return finish();
+        }
+
+        pollfd fds[2] = {{epoll_fd, POLLIN, 0}, {signal_fd, POLLIN, 0}};
+        for (;;) {
+            if (blocking && poll(fds, 2, -1) < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw runtime_error(string("poll failed: ") + strerror(errno));
+            }
+            // Without blocking the rings are drained as they are, and stops looked for at once
+            if ((!blocking || (fds[1].revents & POLLIN)) && !handle_stops()) {
+                return false;
+            }
+            if (drain() == 0 && !exiting) {
+                if (!blocking) {
+                    return true;
+                }
+                continue;
+            }
+
+            // Changes of disarmed watches alone are no position, they go with the next one
+            ++batches;
+            vector<int64_t> current;
+            bool alive = try_read_values(pid, watches, current);
+            bool moved = false;
+            for (size_t i = 0; i < watches.size(); ++i) {
+                bool changed = watches[i].kind == Watch::Value ? alive && current[i] != values[i]
+                                                               : counts[probe_of[i]] != reported[i];
+                moved |= armed[i] && changed;
+            }
+            if (moved) {
+                for (size_t i = 0; i < watches.size(); ++i) {
+                    if (watches[i].kind != Watch::Value && counts[probe_of[i]] != reported[i]) {
+                        reported[i] = counts[probe_of[i]];
+                        changes.push_back({watches[i].variable, (int64_t)reported[i]});
+                    } else if (watches[i].kind == Watch::Value && armed[i] && current[i] != values[i]) {
+                        values[i] = current[i];
+                        changes.push_back({watches[i].variable, current[i]});
+                    }
+                }
+            }
+            if (moved || exiting) {
+                // At the exit stop the last changes are reported first, the next call finishes
+                return moved || next(changes);
+            }
+        }
+    }
+
+    void detach() override {
+        events.clear();
+        threads.stop_all();
+        threads.detach(0);
+    }
+
+    vector<int> wait_fds() const override {
+        return {epoll_fd};
+    }
+
+    void print_stats(ostream& out) const override {
+        uint64_t calls = 0, returns = 0;
+        for (size_t p = 0; p < counts.size(); ++p) {
+            (returning[p] ? returns : calls) += counts[p];
+        }
+        out << "uprobe: " << calls << " calls and " << returns << " returns in " << batches << " batches, " << lost
+            << " lost" << endl;
+        if (threads.followed() > 1) {
+            out << "uprobe: " << threads.followed() << " threads" << endl;
+        }
+    }
+
+private:
+    // Function to read the first word of a file of the uprobe PMU
+    static string read_pmu_file(const string& name) {
+        ifstream in(string(uprobe_pmu) + "/" + name);
+        string text;
+        if (!(in >> text)) {
+            throw runtime_error(string("The kernel has no uprobe PMU for perf_event_open (") + uprobe_pmu + ")");
+        }
+        return text;
+    }
+
+    // Function to find the probe of every watched function and kind; watches of the same one
+    // share it
+    void find_probes() {
+        uint32_t type = stoul(read_pmu_file("type"));
+        // The format is config:<bit>
+        string format = read_pmu_file("format/retprobe");
+        uint64_t retprobe = 1ull << stoul(format.substr(format.find(':') + 1));
+
+        map<pair<uint64_t, bool>, size_t> opened;
+        probe_of.assign(watches.size(), 0);
+        reported.assign(watches.size(), 0);
+        for (size_t i = 0; i < watches.size(); ++i) {
+            const Watch& watch = watches[i];
+            if (watch.kind == Watch::Value) {
+                continue;
+            }
+            bool is_return = watch.kind == Watch::ReturnCount;
+            auto [it, inserted] = opened.insert({{watch.address, is_return}, probes.size()});
+            probe_of[i] = it->second;
+            if (!inserted) {
+                continue;
+            }
+            Probe probe;
+            probe.name = watch.name;
+            tie(probe.path, probe.offset) = file_offset(watch.address);
+            memset(&probe.attr, 0, sizeof(probe.attr));
+            probe.attr.type = type;
+            probe.attr.size = sizeof(probe.attr);
+            probe.attr.config = is_return ? retprobe : 0;
+            probe.attr.probe_offset = probe.offset;
+            probe.attr.sample_period = 1;
+            probe.attr.wakeup_events = 1;
+            probes.push_back(move(probe));
+            returning.push_back(is_return);
+        }
+        counts.assign(probes.size(), 0);
+    }
+
+    // Function to open the events of every probe on thread tid, stopped before it can call any
+    void open_events(pid_t tid) {
+        for (size_t p = 0; p < probes.size(); ++p) {
+            Probe& probe = probes[p];
+            probe.attr.uprobe_path = (uint64_t)(uintptr_t)probe.path.c_str();
+            try {
+                events.emplace_back(probe.attr, tid, -1, probe_ring_pages);
+            } catch (const runtime_error& e) {
+                throw runtime_error(probe.name + ": " + e.what());
+            }
+            probe_of_event.push_back(p);
+            epoll_event event = {};
+            event.events = EPOLLIN;
+            event.data.fd = events.back().fd();
+            if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, events.back().fd(), &event) != 0) {
+                throw runtime_error(string("epoll_ctl failed: ") + strerror(errno));
+            }
+        }
+    }
+
+    // Function to pass the signals of stopped threads on and let the exit stops of all but the
+    // first one go. Returns false with the wait status once the tracee has exited.
+    bool handle_stops() {
+        signalfd_siginfo info;
+        while (read(signal_fd, &info, sizeof(info)) == sizeof(info)) {
+        }
+        int stop;
+        while (!exiting && threads.wait(stop, false)) {
+            if (stop == 0) {
+                return true;
+            }
+            if (is_exit_stop(stop) && threads.current() == pid) {
+                // Stays stopped while the last changes are read
+                exiting = true;
+            } else {
+                threads.resume(WSTOPSIG(stop) == SIGTRAP ? 0 : WSTOPSIG(stop));
+            }
+        }
+        if (!exiting) {
+            status = stop;
+        }
+        return exiting;
+    }
+
+    // Function to let the tracee run on from its exit stop, returns false once it has exited
+    bool finish() {
+        if (!finishing) {
+            finishing = true;
+            threads.resume();
+        }
+        int stop;
+        while (threads.wait(stop, blocking)) {
+            if (stop == 0) {
+                return true;
+            }
+            threads.resume(WSTOPSIG(stop) == SIGTRAP ? 0 : WSTOPSIG(stop));
+        }
+        status = stop;
+        return false;
+    }
+
+    // Function to find the mapped file holding a code address of the tracee, and the offset of
+    // the address in it, which is where a uprobe is placed
+    pair<string, uint64_t> file_offset(uint64_t address) {
+        ifstream maps("/proc/" + to_string(pid) + "/maps");
+        string line;
+        while (getline(maps, line)) {
+            stringstream ss(line);
+            string range, permissions, offset, device, inode;
+            ss >> range >> permissions >> offset >> device >> inode;
+            string path = mapped_path(ss);
+            size_t dash = range.find('-');
+            uint64_t start = stoull(range.substr(0, dash), nullptr, 16);
+            uint64_t end = stoull(range.substr(dash + 1), nullptr, 16);
+            if (address >= start && address < end && !path.empty() && path[0] == '/') {
+                return {path, address - start + stoull(offset, nullptr, 16)};
+            }
+        }
+        throw runtime_error("No file is mapped at 0x" + to_hex(address));
+    }
+
+    static string to_hex(uint64_t value) {
+        stringstream ss;
+        ss << hex << value;
+        return ss.str();
+    }
+
+    // Function to consume every record in the rings, returns the number of calls they report
+    size_t drain() {
+        size_t drained = 0;
+        for (size_t e = 0; e < events.size(); ++e) {
+            uint64_t count = events[e].drain(lost);
+            counts[probe_of_event[e]] += count;
+            drained += count;
+        }
+        return drained;
+    }
+
+    // A uprobe_path is read again by each perf_event_open, so the paths live as long as the probes
+    struct Probe {
+        string name;
+        string path;
+        uint64_t offset;
+        perf_event_attr attr;
+    };
+
+    pid_t pid = 0;
+    int signal_fd = -1;
+    int epoll_fd = -1;
+    sigset_t saved_mask;
+    Threads threads;
+    bool exiting = false;
+    bool finishing = false;
+    vector<Watch> watches;
+    vector<int64_t> values;
+    vector<bool> armed;
+    vector<Probe> probes;
+    vector<PerfRing> events;
+    vector<size_t> probe_of_event;
+    vector<bool> returning;   // per probe
+    vector<uint64_t> counts;  // per probe
+    vector<size_t> probe_of;  // per watch
+    vector<uint64_t> reported;  // per watch, the count last reported
+    uint64_t batches = 0;
+    uint64_t lost = 0;
+};
+
+unique_ptr<Backend> make_uprobe_backend() {
+    return make_unique<UprobeBackend>();
+}
@@ -3,235 +3,817 @@
 #include <string>
 #include <vector>
 #include <map>
-#include <regex>
+#include <cerrno>
+#include <cstring>
 #include <stdexcept>
 #include <sstream>
 #include <algorithm>
 #include <cstdint>
 #include <memory>
+#include <chrono>
+#include <thread>
 #include <unistd.h>
 #include <sys/ptrace.h>
 #include <signal.h>
 #include <sys/wait.h>
 #include <fstream>
 #include <sys/prctl.h> 
-#include "elfio/elfio.hpp"
+#include <sys/stat.h>
+#include "symbols.hpp"
+#include "symbol_cache.hpp"
+#include "ltl.hpp"
+#include "monitor.hpp"
+#include "backend.hpp"
+#include "store_sites.hpp"
+#include "session.hpp"
+#include "supervisor.hpp"
+#include "pipeline.hpp"
+#include "trace_file.hpp"
+#include "offline_check.hpp"
+#include "latency.hpp"
+#include "overhead.hpp"
 
 using namespace std;
 
-//Struct which holds information about a symbol
-struct SymbolInfo {
-    uint64_t address;
-    uint64_t size;
-    string type;
-    string section;
+//Struct which holds the command line options
+struct Options {
+    string elf_file;
+    string ltl_formula;
+    bool use_cache = true;
+    string cache_dir;
+    string backend = "step";
+    BackendOptions backend_options;
+    bool verbose = false;
+    bool detach_on_verdict = false;
+    bool list_store_sites = false;
+    std::vector<pid_t> pids;
+    size_t instances = 1;
+    bool pause = false;
+    PipelineOptions pipeline;
+    string record;
+    int compression = TraceWriter::default_level();
+    string replay;
+    string check;
+    bool latency = false;
+    string latency_json;
+    bool overhead = false;
+    bool baseline = false;
 };
 
-// Function to extract required symbols from the LTL formula
-vector<string> extract_required_symbols(const string ltl_formula){
-    vector<string> required_symbols;
-    
-    // Use regex to find all potential symbols in the formula
-    regex symbol_regex(R"(\b([a-zA-Z_][a-zA-Z0-9_]*)\b)");
-    auto words_begin = sregex_iterator(ltl_formula.begin(), ltl_formula.end(), symbol_regex);
-    auto words_end = sregex_iterator();
-
-    // Exclude LTL keywords from the symbols
-    const vector<string> ltl_keywords = {"true", "false", "U", "V", "X"};
-    for (auto it = words_begin; it != words_end; ++it) {
-        string symbol = it->str();
-        // if symbol not in the keywords list
-        if (find(ltl_keywords.begin(), ltl_keywords.end(), symbol) == ltl_keywords.end()) {
-            // if not already in the required_symbols list
-            if (find(required_symbols.begin(), required_symbols.end(), symbol) == required_symbols.end())
-                required_symbols.push_back(symbol);
-        }
-    }
-    return required_symbols;
+// Function to print the command line usage
+void print_usage(const char* program) {
+    cerr << "Usage: " << program << " [options] <elf_file> <ltl_formula>[;<ltl_formula>...]" << endl
+         << "       " << program << " [options] --pid <pid>[,<pid>...] [<elf_file>] <ltl_formula>[;<ltl_formula>...]" << endl
+         << "       " << program << " [options] --replay <trace_file> [<ltl_formula>[;<ltl_formula>...]]" << endl
+         << "       " << program << " [options] --check <trace_file|event_log> [<ltl_formula>[;<ltl_formula>...]]" << endl
+         << "Options:" << endl
+         << "  --no-cache         always resolve symbols from the ELF file" << endl
+         << "  --cache-dir <dir>  directory of the symbol index cache (default: "
+         << SymbolCache::default_directory() << ")" << endl
+         << "  --backend <name>   how writes are captured: step (default), dr, perf, uffd, sample, agent, hooks, sites, uprobe" << endl
+         << "  --interval <us>    sampling period of the sample and agent backends (default: 1000)" << endl
+         << "  --agent <path>     library preloaded by the agent backend (default: agent/librv_agent.so next to the tool)" << endl
+         << "  --verbose          print every trace position" << endl
+         << "  --detach-on-verdict  stop tracing the child once the verdict can no longer change" << endl
+         << "  --list-store-sites print the stores that can write the variables of the formula and exit" << endl
+         << "  --pid <pids>       monitor running processes, a comma separated list, instead of starting the ELF file" << endl
+         << "  --instances <n>    start n copies of the ELF file and monitor them all from one tracer (default: 1)" << endl
+         << "  --pause            wait for Enter before the traced process continues" << endl
+         << "  --workers <n>      step the monitors on n threads, apart from the tracer (default: 0, on the tracer)" << endl
+         << "  --queue <records>  capacity of the queue of each worker (default: 4096)" << endl
+         << "  --drop-when-full   drop positions a full queue cannot take instead of stopping the tracee" << endl
+         << "  --record <file>    write every change to a binary trace file, suffixed .<pid> for several processes" << endl
+         << "  --compress <level> zstd level of the trace blocks, 0 to store them uncompressed (default: "
+         << TraceWriter::default_level() << ")" << endl
+         << "  --replay <file>    check a recorded trace, against its own formula unless another is given" << endl
+         << "  --check <file>     check a recorded trace or a text event log in parallel chunks on --workers" << endl
+         << "                     threads (default: all cores)" << endl
+         << "  --latency          time every stage of every event, print histograms on SIGUSR1 and at exit" << endl
+         << "  --latency-json <file>  also write the histograms as JSON to file" << endl
+         << "  --overhead         report what monitoring cost the processes: time, context switches, ptrace stops" << endl
+         << "  --baseline         with --overhead, also run the ELF file once unmonitored to compare" << endl;
 }
 
-// Function to find addresses of required symbols from the symbol table in the ELF file and adjust them with base address
-map<string, SymbolInfo> find_addresses(const string& elf_file, const vector<string>& required_symbols) {
-    ELFIO::elfio reader;
-    // Load ELF data
-    if (!reader.load(elf_file)) {
-        throw runtime_error("Could not open ELF file: " + elf_file);
+// Function to parse the command line, throws on malformed arguments
+Options parse_options(int argc, char* argv[]) {
+    Options options;
+    vector<string> positional;
+
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--no-cache") {
+            options.use_cache = false;
+        } else if (arg == "--cache-dir") {
+            if (++i == argc) {
+                throw invalid_argument("--cache-dir needs a directory");
+            }
+            options.cache_dir = argv[i];
+        } else if (arg == "--backend") {
+            if (++i == argc) {
+                throw invalid_argument("--backend needs a name");
+            }
+            options.backend = argv[i];
+        } else if (arg == "--interval") {
+            if (++i == argc) {
+                throw invalid_argument("--interval needs a number of microseconds");
+            }
+            options.backend_options.sample_interval_us = stoull(argv[i]);
+            if (options.backend_options.sample_interval_us == 0) {
+                throw invalid_argument("--interval must be positive");
+            }
+        } else if (arg == "--agent") {
+            if (++i == argc) {
+                throw invalid_argument("--agent needs a library path");
+            }
+            options.backend_options.agent_library = argv[i];
+        } else if (arg == "--verbose") {
+            options.verbose = true;
+        } else if (arg == "--detach-on-verdict") {
+            options.detach_on_verdict = true;
+        } else if (arg == "--list-store-sites") {
+            options.list_store_sites = true;
+        } else if (arg == "--pid") {
+            if (++i == argc) {
+                throw invalid_argument("--pid needs a process id");
+            }
+            // Repeated, or a list as pgrep -d, prints
+            stringstream list(argv[i]);
+            string item;
+            while (getline(list, item, ',')) {
+                options.pids.push_back(stoi(item));
+                if (options.pids.back() <= 0) {
+                    throw invalid_argument("--pid must be positive");
+                }
+            }
+        } else if (arg == "--instances") {
+            if (++i == argc) {
+                throw invalid_argument("--instances needs a number");
+            }
+            options.instances = stoull(argv[i]);
+            if (options.instances == 0) {
+                throw invalid_argument("--instances must be positive");
+            }
+        } else if (arg == "--pause") {
+            options.pause = true;
+        } else if (arg == "--workers") {
+            if (++i == argc) {
+                throw invalid_argument("--workers needs a number");
+            }
+            options.pipeline.workers = stoull(argv[i]);
+        } else if (arg == "--queue") {
+            if (++i == argc) {
+                throw invalid_argument("--queue needs a number of records");
+            }
+            options.pipeline.capacity = stoull(argv[i]);
+            if (options.pipeline.capacity == 0) {
+                throw invalid_argument("--queue must be positive");
+            }
+        } else if (arg == "--drop-when-full") {
+            options.pipeline.drop = true;
+        } else if (arg == "--record") {
+            if (++i == argc) {
+                throw invalid_argument("--record needs a file");
+            }
+            options.record = argv[i];
+        } else if (arg == "--compress") {
+            if (++i == argc) {
+                throw invalid_argument("--compress needs a level");
+            }
+            options.compression = stoi(argv[i]);
+        } else if (arg == "--replay") {
+            if (++i == argc) {
+                throw invalid_argument("--replay needs a trace file");
+            }
+            options.replay = argv[i];
+        } else if (arg == "--check") {
+            if (++i == argc) {
+                throw invalid_argument("--check needs a trace file or an event log");
+            }
+            options.check = argv[i];
+        } else if (arg == "--latency") {
+            options.latency = true;
+        } else if (arg == "--latency-json") {
+            if (++i == argc) {
+                throw invalid_argument("--latency-json needs a file");
+            }
+            options.latency = true;
+            options.latency_json = argv[i];
+        } else if (arg == "--overhead") {
+            options.overhead = true;
+        } else if (arg == "--baseline") {
+            options.overhead = true;
+            options.baseline = true;
+        } else if (arg.size() > 2 && arg.compare(0, 2, "--") == 0) {
+            throw invalid_argument("Unknown option: " + arg);
+        } else {
+            positional.push_back(arg);
+        }
     }
 
-    // Map to hold symbol information
-    map<string, SymbolInfo> symbol_map;
-    
-    // Iterate through sections to find symbol tables
-    for (const auto& section_ptr : reader.sections) {
-        // Get the current section
-        ELFIO::section* section = section_ptr.get();
-        // if the section is a symbol table
-        if (section->get_type() == ELFIO::SHT_SYMTAB || section->get_type() == ELFIO::SHT_DYNSYM) {
-            ELFIO::symbol_section_accessor symbols(reader, section);
-            for (unsigned int i = 0; i < symbols.get_symbols_num(); ++i) {
-                string name;
-                ELFIO::Elf64_Addr value;
-                ELFIO::Elf_Xword size;
-                unsigned char bind;
-                unsigned char type;
-                ELFIO::Elf_Half section_index;
-                unsigned char other;
-
-                symbols.get_symbol(i, name, value, size, bind, type, section_index, other);
-                // if name is in required_symbols
-                if (find(required_symbols.begin(), required_symbols.end(), name) != required_symbols.end()) {
-                    // Add base_address to value to get runtime virtual memory address
-                    SymbolInfo info = {value, size, (type == ELFIO::STT_FUNC) ? "function" : "object", reader.sections[section_index]->get_name()};
-                    symbol_map[name] = info;
-                }
+    // A trace brings its formula and its variables
+    if (!options.replay.empty() || !options.check.empty()) {
+        if (positional.size() > 1) {
+            throw invalid_argument("--replay and --check take at most an LTL formula");
+        }
+        options.ltl_formula = positional.empty() ? "" : positional[0];
+        return options;
+    }
+    // Running processes bring their executable
+    if (!options.pids.empty() && positional.size() == 1) {
+        positional.insert(positional.begin(), "/proc/" + to_string(options.pids.front()) + "/exe");
+    }
+    if (!options.pids.empty() && options.instances != 1) {
+        throw invalid_argument("--instances starts the processes, --pid attaches to running ones");
+    }
+    if (!options.pids.empty() && options.baseline) {
+        throw invalid_argument("--baseline starts the ELF file, it cannot compare with running processes");
+    }
+    if (positional.size() != 2) {
+        throw invalid_argument("Expected an ELF file and an LTL formula");
+    }
+    options.elf_file = positional[0];
+    options.ltl_formula = positional[1];
+    if (options.cache_dir.empty()) {
+        options.cache_dir = SymbolCache::default_directory();
+    }
+    return options;
+}
+
+// The variables of all properties, each once, in the order of the watches
+struct Variables {
+    vector<string> names;
+    vector<string> symbols;
+    vector<VariableKind> kinds;
+};
+
+// Function to parse the properties, formulas separated by ';'. Their variables are gathered in
+// variables, each once by name. Throws invalid_argument on a malformed formula.
+vector<Property> parse_properties(const string& text, Variables& variables) {
+    vector<Property> properties;
+    stringstream list(text);
+    string item;
+    while (getline(list, item, ';')) {
+        Property property;
+        property.formula = parse_ltl(item);
+        const Formula& formula = property.formula;
+        for (uint32_t v = 0; v < formula.variables().size(); ++v) {
+            auto found = find(variables.names.begin(), variables.names.end(), formula.variables()[v]);
+            property.watch_of.push_back(found - variables.names.begin());
+            if (found == variables.names.end()) {
+                variables.names.push_back(formula.variables()[v]);
+                variables.symbols.push_back(formula.symbols()[v]);
+                variables.kinds.push_back(formula.variable_kinds()[v]);
             }
         }
+        properties.push_back(move(property));
     }
+    if (properties.empty()) {
+        throw invalid_argument("Expected an LTL formula");
+    }
+    return properties;
+}
 
-    for (const auto& sym : required_symbols) {
-        if (symbol_map.find(sym) == symbol_map.end()) {
-            throw runtime_error("Symbol not found: " + sym);
+// Function to print the size of the compiled monitors
+void print_monitors(const vector<Property>& properties) {
+    for (size_t i = 0; i < properties.size(); ++i) {
+        const MonitorAutomaton& automaton = properties[i].automaton;
+        if (properties.size() > 1) {
+            cout << "Property " << i + 1 << ": " << properties[i].formula.to_string() << endl << "  ";
         }
+        cout << "Monitor: " << automaton.state_count() << " states over " << automaton.predicate_count()
+             << " predicates" << endl;
     }
+}
 
-    return symbol_map;
+// Function to parse and compile the properties to check over a recorded trace, formula unless it
+// is empty and else the one it was recorded for. Their watches are the variables of the trace.
+vector<Property> trace_properties(const string& formula, const TraceHeader& header, const string& path) {
+    Variables variables;
+    vector<Property> properties = parse_properties(formula.empty() ? header.formula : formula, variables);
+    for (Property& property : properties) {
+        for (uint32_t& watch : property.watch_of) {
+            const string& name = variables.names[watch];
+            auto found = find_if(header.variables.begin(), header.variables.end(),
+                                 [&](const TraceVariable& variable) { return variable.name == name; });
+            if (found == header.variables.end()) {
+                throw runtime_error(name + " is not recorded in " + path);
+            }
+            watch = found - header.variables.begin();
+        }
+        property.automaton = MonitorAutomaton::compile(property.formula);
+    }
+    return properties;
 }
 
-/// @brief Function to add the offset of base_address to the value in the symbol map
-/// @param symbol_map 
-/// @param base_address 
-/// @return updated symbol_map
-map<string, SymbolInfo> update_with_base_address(map<string, SymbolInfo>& symbol_map ,uint64_t base_address) {
-    for (auto& i: symbol_map) {
-        i.second.address += base_address;
+// Function to check properties over a recorded trace, offline: the monitors step over its
+// positions as they would have live. The properties are those it was recorded for, unless
+// options gives others over its variables.
+void replay_trace(const Options& options) {
+    TraceReader reader(options.replay);
+    const TraceHeader& header = reader.header();
+    cout << "Trace of " << header.elf_file << " (pid " << header.pid << ", " << header.backend << " backend), "
+         << header.variables.size() << " variables" << endl;
+
+    vector<Property> properties = trace_properties(options.ltl_formula, header, options.replay);
+    print_monitors(properties);
+
+    vector<int64_t> initial;
+    for (const TraceVariable& variable : header.variables) {
+        initial.push_back(variable.initial);
     }
-    return symbol_map;
+    vector<unique_ptr<Shard>> shards;
+    for (size_t i = 0; i < properties.size(); ++i) {
+        string name = properties.size() > 1 ? "property " + to_string(i + 1) : "";
+        shards.push_back(make_unique<Shard>(properties[i], header.variables.size(), "", name, options.verbose));
+        shards.back()->start(initial);
+    }
+
+    auto started = chrono::steady_clock::now();
+    TraceEvent event;
+    uint64_t events = 0, positions = 0;
+    bool open = false;
+    while (reader.next(event)) {
+        ++events;
+        if (options.verbose) {
+            cout << "  " << header.variables[event.variable].name << " = " << event.value;
+            if (event.thread != 0) {
+                cout << " (thread " << event.thread << ")";
+            }
+            cout << " at " << fixed << setprecision(6) << event.time / 1e9 << " s" << defaultfloat << endl;
+        }
+        for (unique_ptr<Shard>& shard : shards) {
+            shard->set(event.variable, event.value);
+        }
+        open = !event.end;
+        if (event.end) {
+            ++positions;
+            for (unique_ptr<Shard>& shard : shards) {
+                shard->end();
+            }
+        }
+    }
+    // A position the end of the trace cut in two
+    if (open) {
+        ++positions;
+        for (unique_ptr<Shard>& shard : shards) {
+            shard->end();
+        }
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+
+    if (reader.truncated()) {
+        cout << "The trace ends in a truncated block, its events are lost" << endl;
+    }
+    for (const unique_ptr<Shard>& shard : shards) {
+        cout << "Final verdict" << (shard->label().empty() ? "" : " of " + shard->label()) << ": "
+             << verdict_name(shard->verdict()) << " after " << shard->steps() << " steps" << endl;
+    }
+    cout << "replay: " << events << " events, " << positions << " positions in " << reader.blocks() << " blocks of "
+         << reader.size() << " bytes, " << (uint64_t)(events / max(seconds, 1e-9)) << " events/s" << endl;
 }
 
-// Function to print the symbol information in a formatted table
-void print_symbol_info(const map<string, SymbolInfo>& symbol_map) {
-    cout << left << setw(20) << "Symbol" 
-        << setw(20) << "Address"
-        << setw(10) << "Size"
-        << setw(12) << "Type"
-        << "Section" << endl;
-    cout << string(70, '-') << endl;
-
-    for (const auto& [name, info] : symbol_map) {
-        stringstream ss_addr;
-        ss_addr << "0x" << hex << uppercase << setw(16) << setfill('0') << info.address;
-        cout << left << setw(20) << name 
-             << setw(20) << ss_addr.str()
-             << dec << setfill(' ') 
-             << setw(10) << info.size 
-             << setw(12) << info.type 
-             << info.section << endl;
-    }
-    cout << string(70, '-') << endl;
+// Function to check properties over a long recorded trace or text event log, split in chunks
+// checked in parallel (see check_log). A text log needs a formula, a trace has its own.
+void check_event_log(const Options& options) {
+    size_t threads = options.pipeline.workers != 0 ? options.pipeline.workers
+                                                   : max(1u, std::thread::hardware_concurrency());
+    // Several chunks per thread even out their costs
+    size_t chunks = threads * 4;
+    unique_ptr<TraceReader> reader;
+    unique_ptr<EventLog> log;
+    vector<Property> properties;
+    if (is_trace_file(options.check)) {
+        reader = make_unique<TraceReader>(options.check);
+        properties = trace_properties(options.ltl_formula, reader->header(), options.check);
+        log = make_unique<TraceLog>(*reader, chunks);
+    } else {
+        if (options.ltl_formula.empty()) {
+            throw runtime_error(options.check + " is a text event log, it needs an LTL formula");
+        }
+        Variables variables;
+        properties = parse_properties(options.ltl_formula, variables);
+        for (Property& property : properties) {
+            property.automaton = MonitorAutomaton::compile(property.formula);
+        }
+        log = make_unique<TextLog>(options.check, variables.names, chunks);
+    }
+    print_monitors(properties);
+    cout << "Checking " << options.check << " in " << log->chunks() << " chunks on " << threads
+         << (threads == 1 ? " thread" : " threads") << endl;
+
+    auto started = chrono::steady_clock::now();
+    CheckReport report = check_log(*log, properties, threads);
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+
+    if (reader && static_cast<TraceLog&>(*log).truncated()) {
+        cout << "The trace ends in a truncated block, its events are lost" << endl;
+    }
+    for (size_t i = 0; i < properties.size(); ++i) {
+        const CheckResult& result = report.results[i];
+        cout << "Final verdict" << (properties.size() > 1 ? " of property " + to_string(i + 1) : "") << ": "
+             << verdict_name(result.verdict);
+        if (result.decided_at != 0) {
+            cout << " at position " << result.decided_at << " of " << report.positions << endl;
+        } else {
+            cout << " after " << report.positions << " positions" << endl;
+        }
+    }
+    cout << "check: " << report.events << " events, " << report.positions << " positions in " << fixed
+         << setprecision(3) << seconds << " s, " << defaultfloat << (uint64_t)(report.events / max(seconds, 1e-9))
+         << " events/s" << endl;
 }
 
-int main(int argc, char* argv[]) {
-    if (argc != 3) {
-        cerr << "Usage: " << argv[0] << " <elf_file> <ltl_formula>" << endl;
-        return 1;
+// Function to print the store sites of the resolved symbols, and the stores the analysis could
+// not resolve grouped by function
+void list_store_sites(const string& elf_file, const Variables& variables, map<string, SymbolInfo>& symbol_map) {
+    ELFIO::elfio reader;
+    if (!reader.load_mapped(elf_file)) {
+        throw runtime_error("Could not load ELF file: " + elf_file);
+    }
+    // Function events have no stores, their empty ranges match none
+    vector<pair<uint64_t, uint64_t>> ranges;
+    for (uint32_t v = 0; v < variables.names.size(); ++v) {
+        const SymbolInfo& info = symbol_map[variables.symbols[v]];
+        if (variables.kinds[v] == VariableKind::Value) {
+            ranges.push_back({info.address, info.address + (info.size ? info.size : 8)});
+        } else {
+            ranges.push_back({0, 0});
+        }
     }
+    StoreSiteReport report = find_store_sites(reader, ranges);
 
-    string elf_file = argv[1];
-    string ltl_formula = argv[2];
-    
-    vector<string> required_symbols = extract_required_symbols(ltl_formula);
+    cout << "Store sites (" << report.architecture << ", " << report.instructions << " instructions";
+    if (report.undecodable != 0) {
+        cout << ", " << report.undecodable << " undecodable bytes";
+    }
+    cout << "):" << endl;
+    for (const StoreSite& site : report.sites) {
+        cout << "  0x" << hex << site.address << dec << (site.thumb ? " (thumb)" : "") << " writes 0x" << hex
+             << site.target << dec << ":";
+        for (size_t i = 0; i < variables.names.size(); ++i) {
+            if ((site.watches >> i) & 1) {
+                cout << " " << variables.names[i];
+            }
+        }
+        cout << endl;
+    }
 
-    // Find addresses without making adjustments with the base address
-    map<string, SymbolInfo> symbol_map = find_addresses(elf_file, required_symbols);
-
-    // Printing the symbol table before offset
-    // print_symbol_info(symbol_map);
-
-    // Using fork, create a child process which will have a ptrace traceme call followed by an execve call
-    // The child process will be traced by the parent process
-    // the child process will stop just after loading the ELF file in memory
-    // at this point the ELF file is loaded in memory and the symbols are resolved
-    // and the base address of the executable is known
-    // The child process pauses just before executing the first instruction
-    // parent was waiting for the child to stop using waitpid
-    // The parent process will then read the memory mappings of the child process
-    // from the /proc/<child_pid>/maps file
-    // and get the base address of the executable
-    // The parent process will then call the find_addresses function by passing the base address
-    // of the executable and the ELF file path and the list of required symbols to get the
-    // runtime virtual memory addresses of the symbols by adding the base address to the symbol address
-    // The parent process will then print the symbol information in a formatted table
+    map<string, size_t> per_function;
+    for (const UnresolvedStore& store : report.unresolved) {
+        ++per_function[store.function.empty() ? "(no function)" : store.function];
+    }
+    cout << "Unresolved stores: " << report.unresolved.size() << " in " << per_function.size() << " functions" << endl;
+    for (const auto& [function, count] : per_function) {
+        cout << "  " << function << ": " << count << endl;
+    }
+}
+
+// Function to stop a running process under ptrace without signalling it. PTRACE_SEIZE leaves it
+// running and PTRACE_INTERRUPT stops it where it is; signals that arrive first are delivered.
+void seize_process(pid_t pid) {
+    if (ptrace(PTRACE_SEIZE, pid, nullptr, nullptr) != 0) {
+        throw runtime_error("Could not attach to process " + to_string(pid) + ": " + strerror(errno) +
+                            (errno == EPERM ? " (see /proc/sys/kernel/yama/ptrace_scope)" : ""));
+    }
+    if (ptrace(PTRACE_INTERRUPT, pid, nullptr, nullptr) != 0) {
+        throw runtime_error(string("PTRACE_INTERRUPT failed: ") + strerror(errno));
+    }
+    for (;;) {
+        int status;
+        if (waitpid(pid, &status, __WALL) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw runtime_error(string("waitpid failed: ") + strerror(errno));
+        }
+        if (!WIFSTOPPED(status)) {
+            throw runtime_error("Process " + to_string(pid) + " exited");
+        }
+        if (status >> 16 == PTRACE_EVENT_STOP) {
+            return;
+        }
+        ptrace(PTRACE_CONT, pid, nullptr, (void*)(long)WSTOPSIG(status));
+    }
+}
+
+// Function to start the ELF file as a traced child, stopped at its exec before its first
+// instruction. It gets an empty environment plus whatever the backend needs in it.
+pid_t start_child(const string& elf_file, const vector<string>& environment) {
+    vector<const char*> envp_exec;
+    for (const string& entry : environment) {
+        envp_exec.push_back(entry.c_str());
+    }
+    envp_exec.push_back(nullptr);
 
     pid_t pid = fork();
-    
     if (pid == 0) {
-
         // Signals when the parent dies
         prctl(PR_SET_PDEATHSIG, SIGTERM);
-
-        // Child process
         ptrace(PTRACE_TRACEME, 0, NULL, NULL);
 
         const char* argv_exec[] = {elf_file.c_str(), nullptr};
-        const char* envp_exec[] = {nullptr};
-
-        execve(elf_file.c_str(), (char* const*) argv_exec, (char* const*)envp_exec);
+        execve(elf_file.c_str(), (char* const*) argv_exec, (char* const*)envp_exec.data());
         perror("execve failed...\n");
         _exit(errno);
+    }
+    if (pid < 0) {
+        throw runtime_error(string("Fork failed: ") + strerror(errno));
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    if (!WIFSTOPPED(status) || WSTOPSIG(status) != SIGTRAP) {
+        throw runtime_error(elf_file + " did not start");
+    }
+    return pid;
+}
 
-    } else if (pid > 0) {
-
-        // Parent process
-        try {
-
-            int status;
-            waitpid(pid, &status, 0);
-            uint64_t base_address;
+// Function to tell whether two paths name the same file
+bool same_file(const string& a, const string& b) {
+    struct stat first, second;
+    return stat(a.c_str(), &first) == 0 && stat(b.c_str(), &second) == 0 && first.st_dev == second.st_dev &&
+           first.st_ino == second.st_ino;
+}
 
-            if (WIFSTOPPED(status) && WSTOPSIG(status) == SIGTRAP) {
-                string map_path = "/proc/" + to_string(pid) + "/maps";
-                ifstream maps_file(map_path);
+int main(int argc, char* argv[]) {
+    Options options;
+    try {
+        options = parse_options(argc, argv);
+    } catch (const invalid_argument& e) {
+        cerr << "Error: " << e.what() << endl;
+        print_usage(argv[0]);
+        return 1;
+    }
 
-                if (!maps_file.is_open()) {
-                    throw runtime_error("Could not open maps file: " + map_path);
+    if (!options.replay.empty() || !options.check.empty()) {
+        try {
+            if (!options.replay.empty()) {
+                if (options.latency) {
+                    enable_latency();
+                    dump_latency_on_signal(options.latency_json);
                 }
-
-                string line;
-                if (getline(maps_file, line)){
-                    stringstream ss(line);
-                    string address_range;
-                    ss >> address_range;
-                    size_t dash_pos = address_range.find('-');
-                    string base_str = address_range.substr(0, dash_pos);
-                    base_address = stoull(base_str, nullptr, 16);
-                    cout << "Base address of the executable: 0x" << hex << base_address << dec << endl;
+                replay_trace(options);
+                if (options.latency) {
+                    stop_latency_dump();
                 }
-                
-                // Update the symbol table with runtime addresses
-                symbol_map = update_with_base_address(symbol_map, base_address);
-                print_symbol_info(symbol_map);
+            } else {
+                check_event_log(options);
+            }
+        } catch (const exception& e) {
+            cerr << "Error: " << e.what() << endl;
+            return 1;
+        }
+        return 0;
+    }
 
-                cout << "pid of the child process: " << pid << endl;
-                cout << "Press Enter to continue execution of the child process..." << endl;
-                cin.get();
+    string elf_file = options.elf_file;
+    string ltl_formula = options.ltl_formula;
+    
+    // Parse the properties; their variables are the watches and their symbols the ones to resolve
+    vector<Property> properties;
+    Variables variables;
+    try {
+        properties = parse_properties(ltl_formula, variables);
+    } catch (const invalid_argument& e) {
+        cerr << "Error: " << e.what() << endl;
+        return 1;
+    }
+    vector<string> required_symbols;
+    for (const string& symbol : variables.symbols) {
+        if (find(required_symbols.begin(), required_symbols.end(), symbol) == required_symbols.end()) {
+            required_symbols.push_back(symbol);
+        }
+    }
+    // Watch::Kind lists the kinds of variables in the same order
+    vector<Watch::Kind> watch_kinds;
+    for (VariableKind kind : variables.kinds) {
+        watch_kinds.push_back((Watch::Kind)kind);
+    }
 
-                ptrace(PTRACE_CONT, pid, NULL, NULL);
-                
-                // Parent waits for the child to finish
-                waitpid(pid, &status, 0);
+    // Compile the formulas to their monitors and pick the capture backend
+    unique_ptr<Backend> backend;
+    try {
+        // Masks of watches are 64 bits wide
+        if (variables.names.size() > 64) {
+            throw runtime_error("The properties have " + to_string(variables.names.size()) +
+                                " variables, at most 64 can be watched");
+        }
+        for (Property& property : properties) {
+            property.automaton = MonitorAutomaton::compile(property.formula);
+        }
+        backend = make_backend(options.backend, options.backend_options);
+        for (Watch::Kind kind : watch_kinds) {
+            if (!backend->supports(kind) && !options.list_store_sites) {
+                throw runtime_error(kind == Watch::Call || kind == Watch::Return
+                                        ? "call() and ret() need a backend with breakpoints, use --backend sites"
+                                        : "calls() and returns() need kernel counters, use --backend uprobe");
             }
-        } catch (const exception& e) {
+        }
+    } catch (const exception& e) {
+        cerr << "Error: " << e.what() << endl;
+        return 1;
+    }
+    print_monitors(properties);
+
+    // Find addresses without making adjustments with the base address
+    map<string, SymbolInfo> symbol_map;
+    try {
+        symbol_map = options.use_cache
+            ? SymbolCache(options.cache_dir).find_addresses(elf_file, required_symbols)
+            : find_addresses(elf_file, required_symbols);
+    } catch (const exception& e) {
+        cerr << "Error: " << e.what() << endl;
+        return 1;
+    }
 
+    if (options.list_store_sites) {
+        try {
+            list_store_sites(elf_file, variables, symbol_map);
+        } catch (const exception& e) {
             cerr << "Error: " << e.what() << endl;
             return 1;
-
         }
-    } else {
+        return 0;
+    }
 
-        cerr << "Fork failed..." << strerror(errno) << endl;
+    // The processes to monitor, stopped under ptrace, each with its own backend: copies of the ELF
+    // file started as children, stopped at their exec before their first instruction, or with
+    // --pid running processes, stopped where they are
+    bool children = options.pids.empty();
+    size_t count = children ? options.instances : options.pids.size();
+    vector<pid_t> pids;
+    vector<unique_ptr<Backend>> backends;
+    try {
+        for (size_t i = 0; i < count; ++i) {
+            unique_ptr<Backend> instance = i == 0 ? move(backend) : make_backend(options.backend, options.backend_options);
+            if (children) {
+                pids.push_back(start_child(elf_file, instance->environment()));
+            } else {
+                if (!same_file("/proc/" + to_string(options.pids[i]) + "/exe", elf_file)) {
+                    throw runtime_error("Process " + to_string(options.pids[i]) + " does not run " + elf_file);
+                }
+                seize_process(options.pids[i]);
+                pids.push_back(options.pids[i]);
+            }
+            backends.push_back(move(instance));
+        }
+    } catch (const exception& e) {
+        cerr << "Error: " << e.what() << endl;
         return 1;
+    }
+    const char* process = children ? "child" : "process";
+    const char* processes = children ? "children" : "processes";
+    // After the children started, which would keep SIGUSR1 blocked through their exec
+    if (options.latency) {
+        enable_latency();
+        dump_latency_on_signal(options.latency_json);
+    }
+
+    // Declared out of the try, so that a failure leaves no process instrumented
+    vector<unique_ptr<Session>> sessions;
+    try {
+        // The symbols move by the load bias of each executable, found in the live mappings
+        ELFIO::elfio reader;
+        if (!reader.load_mapped(elf_file)) {
+            throw runtime_error("Could not load ELF file: " + elf_file);
+        }
+        SessionOptions session_options;
+        session_options.verbose = options.verbose;
+        session_options.detach_on_verdict = options.detach_on_verdict;
+        // Declared after the sessions, so its workers are done with their shards before they go
+        unique_ptr<Pipeline> pipeline;
+        if (options.pipeline.workers > 0) {
+            pipeline = make_unique<Pipeline>(options.pipeline);
+        }
+        if (count > 1) {
+            print_symbol_info(symbol_map);
+        }
+        for (size_t i = 0; i < count; ++i) {
+            pid_t pid = pids[i];
+            string prefix = count > 1 ? "[" + to_string(pid) + "] " : "";
+            uint64_t bias = load_bias(pid, reader);
+            cout << prefix << "Load bias of the executable: 0x" << hex << bias << dec << endl;
+            map<string, SymbolInfo> runtime_map = symbol_map;
+            update_with_base_address(runtime_map, bias);
+            if (count == 1) {
+                print_symbol_info(runtime_map);
+                cout << "pid of the " << process << ": " << pid << endl;
+            }
 
+            vector<Watch> watches;
+            for (uint32_t v = 0; v < variables.names.size(); ++v) {
+                const SymbolInfo& info = runtime_map[variables.symbols[v]];
+                Watch::Kind kind = watch_kinds[v];
+                if (kind != Watch::Value && info.type != "function") {
+                    throw runtime_error(variables.names[v] + ": " + variables.symbols[v] + " is not a function");
+                }
+                watches.push_back({v, variables.names[v], info.address, info.size ? info.size : 8, kind});
+            }
+            unique_ptr<TraceWriter> recorder;
+            if (!options.record.empty()) {
+                TraceHeader header;
+                header.formula = ltl_formula;
+                header.elf_file = elf_file;
+                header.backend = options.backend;
+                header.pid = pid;
+                for (const Watch& watch : watches) {
+                    header.variables.push_back({watch.name, variables.symbols[watch.variable], watch.kind,
+                                                watch.address, watch.size, 0});
+                }
+                recorder = make_unique<TraceWriter>(count > 1 ? options.record + "." + to_string(pid) : options.record,
+                                                    move(header), options.compression);
+            }
+            sessions.push_back(make_unique<Session>(pid, children, move(backends[i]), move(watches), properties,
+                                                    session_options, prefix, pipeline.get()));
+            if (recorder) {
+                sessions.back()->record(move(recorder));
+            }
+        }
+        if (options.pause) {
+            cout << "Press Enter to continue execution of the " << (count > 1 ? processes : process) << "..." << endl;
+            cin.get();
+        }
+        OverheadMeter meter(pids, children);
+        // Prints the cost once the meter stopped, against copies run unmonitored afterwards
+        auto print_overhead = [&] {
+            Usage unmonitored;
+            if (options.baseline) {
+                cout << "Running the " << (count > 1 ? processes : process) << " unmonitored for the baseline..."
+                     << endl;
+                unmonitored = run_unmonitored(elf_file, count);
+            }
+            meter.print(cout, options.backend, options.baseline ? &unmonitored : nullptr);
+        };
+        meter.start();
+
+        // A child is stepped without an event loop; running processes are always supervised, so
+        // that SIGINT and SIGTERM detach from them instead of leaving them instrumented
+        if (count == 1 && children) {
+            Session& session = *sessions.front();
+            session.start();
+            while (session.advance()) {
+            }
+            meter.stop();
+            session.report(cout);
+            if (pipeline) {
+                pipeline->print_stats(cout);
+            }
+            if (options.overhead) {
+                print_overhead();
+            }
+            if (options.latency) {
+                stop_latency_dump();
+            }
+            return 0;
+        }
+
+        // One tracer takes turns between all of them
+        Supervisor supervisor;
+        for (unique_ptr<Session>& session : sessions) {
+            session->start();
+            supervisor.add(*session);
+        }
+        supervisor.run([](Session& session) { session.report(cout); });
+        meter.stop();
+        if (supervisor.interrupted()) {
+            cout << "Interrupted (" << strsignal(supervisor.interrupted()) << "), detached from every "
+                 << process << endl;
+        }
+        if (count > 1) {
+            map<Verdict, size_t> verdicts;
+            for (const unique_ptr<Session>& session : sessions) {
+                for (const unique_ptr<Shard>& shard : session->shards()) {
+                    ++verdicts[shard->verdict()];
+                }
+            }
+            cout << "Verdicts of " << count << " " << processes;
+            if (properties.size() > 1) {
+                cout << " and " << properties.size() << " properties";
+            }
+            cout << ": " << verdicts[Verdict::True] << " true, " << verdicts[Verdict::False] << " false, "
+                 << verdicts[Verdict::Inconclusive] << " inconclusive" << endl;
+        }
+        if (pipeline) {
+            pipeline->print_stats(cout);
+        }
+        if (options.overhead) {
+            print_overhead();
+        }
+        if (options.latency) {
+            stop_latency_dump();
+        }
+        if (supervisor.interrupted()) {
+            return 128 + supervisor.interrupted();
+        }
+    } catch (const exception& e) {
+        cerr << "Error: " << e.what() << endl;
+        for (unique_ptr<Session>& session : sessions) {
+            try {
+                session->detach();
+            } catch (const exception&) {
+            }
+        }
+        return 1;
     }
 
     return 0;
-}
\ No newline at end of file
+}